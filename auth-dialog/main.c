@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <poll.h>
 #include <gtk/gtk.h>
 
 #include <libsecret/secret.h>
@@ -52,35 +53,113 @@ static const SecretSchema network_manager_secret_schema = {
 
 #define UI_KEYFILE_GROUP "VPN Plugin UI"
 
-static char *
-keyring_lookup_secret (const char *uuid, const char *secret_name)
+/* All secrets of the connection are fetched with a single search by UUID.
+ * It is started right away and runs while we find out which secrets are
+ * required. It doesn't unlock the keyring: that may prompt the user, so it
+ * is only done if a required secret is in a locked collection. */
+typedef struct {
+	char *uuid;
+	GHashTable *secrets;  /* setting-key -> secret */
+	gboolean has_locked;
+	gboolean unlock;
+	gboolean done;
+} KeyringLookup;
+
+static void
+keyring_lookup_cb (GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+	KeyringLookup *lookup = user_data;
+	GList *list, *iter;
+
+	list = secret_service_search_finish (NULL, result, NULL);
+	for (iter = list; iter; iter = iter->next) {
+		SecretItem *item = iter->data;
+		gs_unref_hashtable GHashTable *attrs = NULL;
+		SecretValue *value;
+		const char *secret_name;
+
+		attrs = secret_item_get_attributes (item);
+		secret_name = g_hash_table_lookup (attrs, KEYRING_SK_TAG);
+		if (!secret_name || g_hash_table_contains (lookup->secrets, secret_name))
+			continue;
+
+		if (secret_item_get_locked (item)) {
+			lookup->has_locked = TRUE;
+			continue;
+		}
+
+		value = secret_item_get_secret (item);
+		if (value) {
+			g_hash_table_insert (lookup->secrets,
+			                     g_strdup (secret_name),
+			                     g_strdup (secret_value_get (value, NULL)));
+			secret_value_unref (value);
+		}
+	}
+
+	g_list_free_full (list, g_object_unref);
+	lookup->done = TRUE;
+}
+
+static void
+keyring_lookup_search (KeyringLookup *lookup)
 {
 	GHashTable *attrs;
-	GList *list;
-	char *secret = NULL;
+	SecretSearchFlags flags = SECRET_SEARCH_ALL | SECRET_SEARCH_LOAD_SECRETS;
+
+	if (lookup->unlock)
+		flags |= SECRET_SEARCH_UNLOCK;
+
+	lookup->done = FALSE;
+	lookup->has_locked = FALSE;
 
 	attrs = secret_attributes_build (&network_manager_secret_schema,
-	                                 KEYRING_UUID_TAG, uuid,
+	                                 KEYRING_UUID_TAG, lookup->uuid,
 	                                 KEYRING_SN_TAG, NM_SETTING_VPN_SETTING_NAME,
-	                                 KEYRING_SK_TAG, secret_name,
 	                                 NULL);
+	secret_service_search (NULL, &network_manager_secret_schema, attrs,
+	                       flags, NULL, keyring_lookup_cb, lookup);
+	g_hash_table_unref (attrs);
+}
 
-	list = secret_service_search_sync (NULL, &network_manager_secret_schema, attrs,
-	                                   SECRET_SEARCH_ALL | SECRET_SEARCH_UNLOCK | SECRET_SEARCH_LOAD_SECRETS,
-	                                   NULL, NULL);
-	if (list && list->data) {
-		SecretItem *item = list->data;
-		SecretValue *value = secret_item_get_secret (item);
+static void
+keyring_lookup_start (KeyringLookup *lookup, const char *uuid)
+{
+	g_return_if_fail (!lookup->secrets);
 
-		if (value) {
-			secret = g_strdup (secret_value_get (value, NULL));
-			secret_value_unref (value);
-		}
+	lookup->uuid = g_strdup (uuid);
+	lookup->secrets = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                         g_free, (GDestroyNotify) nm_free_secret);
+	keyring_lookup_search (lookup);
+}
+
+static char *
+keyring_lookup_secret (KeyringLookup *lookup, const char *secret_name)
+{
+	const char *secret;
+
+	if (!lookup->secrets)
+		return NULL;
+
+	for (;;) {
+		while (!lookup->done)
+			g_main_context_iteration (NULL, TRUE);
+
+		secret = g_hash_table_lookup (lookup->secrets, secret_name);
+		if (secret || !lookup->has_locked || lookup->unlock)
+			return g_strdup (secret);
+
+		/* the secret is required and may be in a locked collection. */
+		lookup->unlock = TRUE;
+		keyring_lookup_search (lookup);
 	}
+}
 
-	g_list_free_full (list, g_object_unref);
-	g_hash_table_unref (attrs);
-	return secret;
+static void
+keyring_lookup_clear (KeyringLookup *lookup)
+{
+	nm_clear_g_free (&lookup->uuid);
+	nm_clear_pointer (&lookup->secrets, g_hash_table_unref);
 }
 
 /*****************************************************************/
@@ -231,6 +310,8 @@ std_ask_user (const char *vpn_name,
 	g_return_val_if_fail (out_new_certpass != NULL, FALSE);
 	g_return_val_if_fail (out_new_proxypass != NULL, FALSE);
 
+	/* GTK is only initialized when we actually prompt the user. Its
+	 * command line options were already parsed in main(). */
 	gtk_init (NULL, NULL);
 
 	dialog = NMA_VPN_PASSWORD_DIALOG (nma_vpn_password_dialog_new (_("Authenticate VPN"), prompt, NULL));
@@ -271,26 +352,39 @@ std_ask_user (const char *vpn_name,
 static void
 wait_for_quit (void)
 {
-	GString *str;
-	char c;
-	ssize_t n;
-	time_t start;
-
-	str = g_string_sized_new (10);
-	start = time (NULL);
-	do {
-		errno = 0;
-		n = read (0, &c, 1);
-		if (n == 0 || (n < 0 && errno == EAGAIN))
-			g_usleep (G_USEC_PER_SEC / 10);
-		else if (n == 1) {
-			g_string_append_c (str, c);
-			if (strstr (str->str, "QUIT") || (str->len > 10))
-				break;
-		} else
+	char buf[16];
+	gsize len = 0;
+	gint64 deadline;
+
+	/* Wait until NetworkManager tells us to go away with "QUIT", closes
+	 * stdin, or 20 seconds passed. */
+	deadline = g_get_monotonic_time () + 20 * G_USEC_PER_SEC;
+	for (;;) {
+		struct pollfd pfd = { .fd = 0, .events = POLLIN };
+		gint64 now;
+		ssize_t n;
+		int r;
+
+		now = g_get_monotonic_time ();
+		if (now >= deadline)
 			break;
-	} while (time (NULL) < start + 20);
-	g_string_free (str, TRUE);
+
+		r = poll (&pfd, 1, (deadline - now + 999) / 1000);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
+
+		n = read (0, &buf[len], sizeof (buf) - len);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (n <= 0)
+			break;
+
+		len += n;
+		if (memmem (buf, len, "QUIT", NM_STRLEN ("QUIT")) || len > 10)
+			break;
+	}
 }
 
 static void
@@ -325,7 +419,7 @@ std_finish (const char *vpn_name,
 static void
 get_existing_passwords (GHashTable *vpn_data,
                         GHashTable *existing_secrets,
-                        const char *vpn_uuid,
+                        KeyringLookup *keyring,
                         gboolean need_password,
                         gboolean need_certpass,
                         gboolean need_proxypass,
@@ -346,7 +440,7 @@ get_existing_passwords (GHashTable *vpn_data,
 		if (!(pw_flags & NM_SETTING_SECRET_FLAG_NOT_SAVED)) {
 			*out_password = g_strdup (g_hash_table_lookup (existing_secrets, NM_OPENVPN_KEY_PASSWORD));
 			if (!*out_password)
-				*out_password = keyring_lookup_secret (vpn_uuid, NM_OPENVPN_KEY_PASSWORD);
+				*out_password = keyring_lookup_secret (keyring, NM_OPENVPN_KEY_PASSWORD);
 		}
 	}
 
@@ -355,7 +449,7 @@ get_existing_passwords (GHashTable *vpn_data,
 		if (!(cp_flags & NM_SETTING_SECRET_FLAG_NOT_SAVED)) {
 			*out_certpass = g_strdup (g_hash_table_lookup (existing_secrets, NM_OPENVPN_KEY_CERTPASS));
 			if (!*out_certpass)
-				*out_certpass = keyring_lookup_secret (vpn_uuid, NM_OPENVPN_KEY_CERTPASS);
+				*out_certpass = keyring_lookup_secret (keyring, NM_OPENVPN_KEY_CERTPASS);
 		}
 	}
 
@@ -364,7 +458,7 @@ get_existing_passwords (GHashTable *vpn_data,
 		if (!(proxy_flags & NM_SETTING_SECRET_FLAG_NOT_SAVED)) {
 			*out_proxypass = g_strdup (g_hash_table_lookup (existing_secrets, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD));
 			if (!*out_proxypass)
-				*out_proxypass = keyring_lookup_secret (vpn_uuid, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD);
+				*out_proxypass = keyring_lookup_secret (keyring, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD);
 		}
 	}
 }
@@ -455,6 +549,7 @@ main (int argc, char *argv[])
 	nm_auto_free_secret char *existing_password = NULL;
 	nm_auto_free_secret char *existing_certpass = NULL;
 	nm_auto_free_secret char *existing_proxypass = NULL;
+	nm_auto (keyring_lookup_clear) KeyringLookup keyring = { 0 };
 	gboolean external_ui_mode = FALSE;
 	gboolean ask_user;
 	NoSecretsRequiredFunc no_secrets_required_func;
@@ -509,6 +604,8 @@ main (int argc, char *argv[])
 		finish_func = std_finish;
 	}
 
+	keyring_lookup_start (&keyring, vpn_uuid);
+
 	/* Determine which passwords are actually required, either from hints or
 	 * from looking at the VPN configuration.
 	 */
@@ -524,7 +621,7 @@ main (int argc, char *argv[])
 
 	get_existing_passwords (data,
 	                        secrets,
-	                        vpn_uuid,
+	                        &keyring,
 	                        need_password,
 	                        need_certpass,
 	                        need_proxypass,
@@ -404,34 +404,177 @@ _strbuf_append_c (char **buf, gsize *len, char ch)
 	*buf = &(*buf)[1];
 }
 
+static void
+_strbuf_append (char **buf, gsize *len, const char *str, gsize n)
+{
+	nm_assert (buf);
+	nm_assert (len);
+
+	g_return_if_fail (*len >= n);
+
+	memcpy (*buf, str, n);
+	(*len) -= n;
+	*buf = &(*buf)[n];
+}
+
+/* character classes for args_parse_line(). Words are copied in runs of
+ * ordinary characters, instead of one character at a time. _CH_SPACE
+ * matches exactly what g_ascii_isspace() accepts. */
+#define _CH_SPACE  0x01
+#define _CH_ESCAPE 0x02
+#define _CH_DQUOTE 0x04
+
+static const guint8 _ch_class[256] = {
+	['\t'] = _CH_SPACE,
+	['\n'] = _CH_SPACE,
+	['\v'] = _CH_SPACE,
+	['\f'] = _CH_SPACE,
+	['\r'] = _CH_SPACE,
+	[' ']  = _CH_SPACE,
+	['\\'] = _CH_ESCAPE,
+	['"']  = _CH_DQUOTE,
+};
+
+static gsize
+_ch_span (const char *str, gsize len, guint8 stop_classes)
+{
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		if (_ch_class[(guchar) str[i]] & stop_classes)
+			break;
+	}
+	return i;
+}
+
+static void
+_ch_step (const char **str, gsize *len, gsize n)
+{
+	nm_assert (n <= *len);
+
+	*str += n;
+	*len -= n;
+}
+
+/* returns the offset of the first '\n' or '\0', or @len if there is none.
+ * memchr() and strnlen() are vectorized by the C library, which picks
+ * the best implementation for the CPU at runtime. Look at the input in
+ * blocks, so that a missing newline doesn't make us scan everything
+ * to the end for each '\0'. */
+static gsize
+_ch_find_line_end (const char *str, gsize len)
+{
+	gsize offset = 0;
+
+	while (offset < len) {
+		gsize block = MIN (len - offset, (gsize) 4096);
+		const char *nl = memchr (&str[offset], '\n', block);
+		gsize n;
+
+		if (nl)
+			block = nl - &str[offset];
+		n = strnlen (&str[offset], block);
+		offset += n;
+		if (nl || n < block)
+			break;
+	}
+	return offset;
+}
+
+/* Scratch memory for args_parse_line(). The tokens of a line are only needed
+ * until the next line is parsed, so the arena is reset for every line and the
+ * same memory gets reused for the entire import. The inline buffer covers all
+ * usual lines; only exceptionally long lines make the arena grow on the heap. */
+#define ARGS_ARENA_INLINE_SIZE 2048
+
+/* number of arguments that are tracked without allocating an index array. */
+#define ARGS_INDEX_INLINE 32
+
+typedef struct {
+	char *buf;
+	gsize allocated;
+	gsize used;
+	guint n_heap_allocs;
+	union {
+		char c[ARGS_ARENA_INLINE_SIZE];
+		gpointer _align;
+	} buf_inline;
+} ArgsArena;
+
+static void
+args_arena_init (ArgsArena *arena)
+{
+	arena->buf = arena->buf_inline.c;
+	arena->allocated = sizeof (arena->buf_inline.c);
+	arena->used = 0;
+	arena->n_heap_allocs = 0;
+}
+
+static void
+args_arena_clear (ArgsArena *arena)
+{
+	if (arena->buf != arena->buf_inline.c)
+		g_free (arena->buf);
+	arena->buf = NULL;
+	arena->allocated = 0;
+	arena->used = 0;
+}
+
+/* ensure there are @size more bytes available. Note that this may move
+ * the buffer, so callers must refer to earlier allocations by offset. */
+static void
+args_arena_ensure (ArgsArena *arena, gsize size)
+{
+	char *buf;
+	gsize allocated;
+
+	if (arena->allocated - arena->used >= size)
+		return;
+
+	allocated = MAX (arena->used + size, arena->allocated * 2);
+	buf = g_malloc (allocated);
+	memcpy (buf, arena->buf, arena->used);
+	if (arena->buf != arena->buf_inline.c)
+		g_free (arena->buf);
+	arena->buf = buf;
+	arena->allocated = allocated;
+	arena->n_heap_allocs++;
+}
+
 static gboolean
-args_parse_line (const char *line,
+args_parse_line (ArgsArena *arena,
+                 const char *line,
                  gsize line_len,
                  const char ***out_p,
                  char **out_error)
 {
-	gs_unref_array GArray *index = NULL;
-	gs_free char *str_buf_orig = NULL;
+	gsize index_inline[ARGS_INDEX_INLINE];
+	gs_unref_array GArray *index_slow = NULL;
+	const gsize *index;
+	gsize index_len = 0;
 	char *str_buf;
 	gsize str_buf_len;
+	gsize ptr_offset;
 	gsize i;
 	const char *line_start = line;
-	char **data;
-	char *pdata;
+	const char **data;
 
-	/* reimplement openvpn's parse_line(). */
+	/* reimplement openvpn's parse_line().
+	 *
+	 * The result lives in @arena and is only valid until the arena is
+	 * used for the next line. */
 
+	g_return_val_if_fail (arena, FALSE);
 	g_return_val_if_fail (line, FALSE);
 	g_return_val_if_fail (out_p && !*out_p, FALSE);
 	g_return_val_if_fail (out_error && !*out_error, FALSE);
 
 	*out_p = NULL;
+	arena->used = 0;
 
-	/* we expect no newline during the first line_len chars. */
-	for (i = 0; i < line_len; i++) {
-		if (NM_IN_SET (line[i], '\0', '\n'))
-			g_return_val_if_reached (FALSE);
-	}
+	/* we expect no newline during the first line_len chars. args_next_line()
+	 * already guarantees that. */
+	nm_assert (_ch_find_line_end (line, line_len) == line_len);
 
 	/* if the line ends with '\r', drop that right way (covers \r\n). */
 	if (line_len > 0 && line[line_len - 1] == '\r')
@@ -450,65 +593,101 @@ args_parse_line (const char *line,
 	}
 
 	/* the maximum required buffer is @line_len+1 characters. We don't produce
-	 * *more* characters then given in the input (plus trailing '\0'). */
+	 * *more* characters then given in the input (plus trailing '\0').
+	 * Also reserve room for the strv of the common case, so that only
+	 * lines with more then ARGS_INDEX_INLINE arguments may grow the arena
+	 * afterwards. */
 	str_buf_len = line_len + 1;
-	str_buf_orig = g_malloc (str_buf_len);
-	str_buf = str_buf_orig;
-
-	index = g_array_new (FALSE, FALSE, sizeof (gsize));
+	args_arena_ensure (arena,
+	                     str_buf_len
+	                   + sizeof (gpointer) - 1
+	                   + sizeof (const char *) * (ARGS_INDEX_INLINE + 1));
+	str_buf = arena->buf;
 
 	for (;;) {
-		char quote, ch0;
 		gssize word_start = line - line_start;
+		const char *quote_end;
 		gsize index_i;
+		gsize n;
 
-		index_i = str_buf - str_buf_orig;
-		g_array_append_val (index, index_i);
+		index_i = str_buf - arena->buf;
+		if (G_LIKELY (index_len < ARGS_INDEX_INLINE))
+			index_inline[index_len] = index_i;
+		else {
+			if (!index_slow) {
+				index_slow = g_array_sized_new (FALSE, FALSE, sizeof (gsize), 2 * ARGS_INDEX_INLINE);
+				g_array_append_vals (index_slow, index_inline, ARGS_INDEX_INLINE);
+				arena->n_heap_allocs++;
+			}
+			g_array_append_val (index_slow, index_i);
+		}
+		index_len++;
 
-		switch ((ch0 = _ch_step_1 (&line, &line_len))) {
-		case '"':
+		switch (line[0]) {
 		case '\'':
-			quote = ch0;
+			_ch_step (&line, &line_len, 1);
+
+			/* no escaping inside single quotes. */
+			quote_end = memchr (line, '\'', line_len);
+			if (!quote_end) {
+				*out_error = g_strdup_printf (_("unterminated %s at position %lld"),
+				                              _("single quote"),
+				                              (long long) word_start);
+				return FALSE;
+			}
+			n = quote_end - line;
+			_strbuf_append (&str_buf, &str_buf_len, line, n);
+
+			/* openvpn terminates parsing of quoted paramaters after the closing quote.
+			 * E.g. "'a'b" gives "a", "b". */
+			_ch_step (&line, &line_len, n + 1);
+			break;
+		case '"':
+			_ch_step (&line, &line_len, 1);
 
-			while (line_len > 0 && line[0] != quote) {
-				if (quote == '"' && line[0] == '\\') {
-					_ch_step_1 (&line, &line_len);
-					if (line_len <= 0)
-						break;
+			for (;;) {
+				n = _ch_span (line, line_len, _CH_ESCAPE | _CH_DQUOTE);
+				_strbuf_append (&str_buf, &str_buf_len, line, n);
+				_ch_step (&line, &line_len, n);
+
+				if (line_len > 0 && line[0] == '\\') {
+					_ch_step (&line, &line_len, 1);
+					if (line_len > 0) {
+						_strbuf_append_c (&str_buf, &str_buf_len, _ch_step_1 (&line, &line_len));
+						continue;
+					}
 				}
-				_strbuf_append_c (&str_buf, &str_buf_len, _ch_step_1 (&line, &line_len));
+				break;
 			}
 
 			if (line_len <= 0) {
 				*out_error = g_strdup_printf (_("unterminated %s at position %lld"),
-				                              quote == '"' ? _("double quote") : _("single quote"),
+				                              _("double quote"),
 				                              (long long) word_start);
 				return FALSE;
 			}
 
-			/* openvpn terminates parsing of quoted paramaters after the closing quote.
-			 * E.g. "'a'b" gives "a", "b". */
-			_ch_step_1 (&line, &line_len);
+			_ch_step (&line, &line_len, 1);
 			break;
 		default:
 			/* once openvpn encounters a non-quoted word, it doesn't consider quoting
 			 * inside the word.
 			 * E.g. "a'b'" gives "a'b'". */
 			for (;;) {
-				if (ch0 == '\\') {
-					if (line_len <= 0) {
-						*out_error = g_strdup_printf (_("trailing escaping backslash at position %lld"),
-						                              (long long) word_start);
-						return FALSE;
-					}
-					ch0 = _ch_step_1 (&line, &line_len);
-				}
-				_strbuf_append_c (&str_buf, &str_buf_len, ch0);
-				if (line_len <= 0)
-					break;
-				ch0 = _ch_step_1 (&line, &line_len);
-				if (g_ascii_isspace (ch0))
+				n = _ch_span (line, line_len, _CH_SPACE | _CH_ESCAPE);
+				_strbuf_append (&str_buf, &str_buf_len, line, n);
+				_ch_step (&line, &line_len, n);
+
+				if (line_len <= 0 || line[0] != '\\')
 					break;
+
+				if (line_len == 1) {
+					*out_error = g_strdup_printf (_("trailing escaping backslash at position %lld"),
+					                              (long long) word_start);
+					return FALSE;
+				}
+				_strbuf_append_c (&str_buf, &str_buf_len, line[1]);
+				_ch_step (&line, &line_len, 2);
 			}
 			break;
 		}
@@ -526,19 +705,21 @@ args_parse_line (const char *line,
 		}
 	}
 
-	str_buf_len = str_buf - str_buf_orig;
+	index = index_slow ? &g_array_index (index_slow, gsize, 0) : index_inline;
 
-	/* pack the result in a strv array */
-	data = g_malloc ((sizeof (const char *) * (index->len + 1)) + str_buf_len);
+	/* place the strv behind the words, aligned. */
+	ptr_offset = str_buf - arena->buf;
+	ptr_offset = (ptr_offset + sizeof (gpointer) - 1) & ~((gsize) (sizeof (gpointer) - 1));
+	arena->used = ptr_offset;
+	args_arena_ensure (arena, sizeof (const char *) * (index_len + 1));
 
-	pdata = (char *) &data[index->len + 1];
-	memcpy (pdata, str_buf_orig, str_buf_len);
-
-	for (i = 0; i < index->len; i++)
-		data[i] = &pdata[g_array_index (index, gsize, i)];
+	data = (const char **) &arena->buf[ptr_offset];
+	for (i = 0; i < index_len; i++)
+		data[i] = &arena->buf[index[i]];
 	data[i] = NULL;
+	arena->used += sizeof (const char *) * (index_len + 1);
 
-	*out_p = (const char **) data;
+	*out_p = data;
 
 	return TRUE;
 }
@@ -549,7 +730,40 @@ _nmovpn_test_args_parse_line (const char *line,
                               const char ***out_p,
                               char **out_error)
 {
-	return args_parse_line (line, line_len, out_p, out_error);
+	ArgsArena arena;
+	const char **p = NULL;
+	gsize n, str_len;
+	char **data;
+	char *pdata;
+	gsize i;
+
+	g_return_val_if_fail (out_p && !*out_p, FALSE);
+	g_return_val_if_fail (_ch_find_line_end (line, line_len) == line_len, FALSE);
+
+	args_arena_init (&arena);
+
+	if (!args_parse_line (&arena, line, line_len, &p, out_error)) {
+		args_arena_clear (&arena);
+		return FALSE;
+	}
+
+	if (p) {
+		/* hand out a self-contained copy, packed like a strv where the
+		 * words follow the pointer array. */
+		n = NM_PTRARRAY_LEN (p);
+		str_len = (p[n - 1] + strlen (p[n - 1]) + 1) - p[0];
+
+		data = g_malloc ((sizeof (const char *) * (n + 1)) + str_len);
+		pdata = (char *) &data[n + 1];
+		memcpy (pdata, p[0], str_len);
+		for (i = 0; i < n; i++)
+			data[i] = &pdata[p[i] - p[0]];
+		data[n] = NULL;
+		*out_p = (const char **) data;
+	}
+
+	args_arena_clear (&arena);
+	return TRUE;
 }
 
 static gboolean
@@ -575,17 +789,14 @@ args_next_line (const char **content,
 
 	*cur_line = s = *content;
 
-	while (l > 0 && !NM_IN_SET (s[0], '\0', '\n'))
-		_ch_step_1 (&s, &l);
-
-	offset = s - *content;
+	offset = _ch_find_line_end (s, l);
 	*cur_line_len = offset;
 
 	/* cur_line_delimiter will point to a (static) string
 	 * containing the dropped character.
 	 * Or NULL if we reached the end of content. */
-	if (l > 0) {
-		if (s[0] == '\0')
+	if (offset < l) {
+		if (s[offset] == '\0')
 			*cur_line_delimiter = "\0";
 		else
 			*cur_line_delimiter = "\n";
@@ -599,6 +810,43 @@ args_next_line (const char **content,
 	return TRUE;
 }
 
+gboolean
+_nmovpn_test_args_parse_lines (const char *contents,
+                               gsize contents_len,
+                               guint *out_n_args,
+                               guint *out_n_heap_allocs)
+{
+	ArgsArena arena;
+	const char *cur_line;
+	gsize cur_line_len;
+	const char *cur_line_delimiter;
+	guint n_args = 0;
+	gboolean success = TRUE;
+
+	args_arena_init (&arena);
+
+	while (args_next_line (&contents,
+	                       &contents_len,
+	                       &cur_line,
+	                       &cur_line_len,
+	                       &cur_line_delimiter)) {
+		gs_free char *line_error = NULL;
+		const char **params = NULL;
+
+		if (!args_parse_line (&arena, cur_line, cur_line_len, &params, &line_error)) {
+			success = FALSE;
+			break;
+		}
+		if (params)
+			n_args += NM_PTRARRAY_LEN (params);
+	}
+
+	NM_SET_OUT (out_n_args, n_args);
+	NM_SET_OUT (out_n_heap_allocs, arena.n_heap_allocs);
+	args_arena_clear (&arena);
+	return success;
+}
+
 /*****************************************************************************/
 
 static gboolean
@@ -663,11 +911,24 @@ parse_http_proxy_auth (const char *default_path,
 
 /*****************************************************************************/
 
+typedef struct {
+	const char *str;
+	gsize len;
+} InlineBlobSlice;
+
 typedef struct {
 	char *token;
 	char *path;
 	gsize token_start_line;
-	GString *blob_data;
+
+	/* The blob is not copied, but refers to the imported content, which
+	 * stays alive during do_import(). Consecutive lines are merged into
+	 * one slice, so unless the lines are indented, this is a single slice. */
+	GArray *slices;
+
+	/* set if the blob is base64 encoded and got decoded into a new buffer. */
+	guint8 *decoded;
+
 	const char *key;
 } InlineBlobData;
 
@@ -678,7 +939,8 @@ inline_blob_data_free (InlineBlobData *data)
 
 	g_free (data->token);
 	g_free (data->path);
-	g_string_free (data->blob_data, TRUE);
+	g_array_unref (data->slices);
+	g_free (data->decoded);
 	g_slice_free (InlineBlobData, data);
 }
 
@@ -730,16 +992,297 @@ inline_blob_mkdir_parents (const InlineBlobData *data, const char *filepath, cha
 	return TRUE;
 }
 
+/* do_import_files() imports on several threads. The umask is process wide,
+ * so blobs are written one at a time. */
+static GMutex inline_blob_write_lock;
+
+/* Public inline blobs (certificates and CRLs) are stored once per content,
+ * in a subdirectory named by their SHA-256 sum. The per-connection file
+ * "<basename>-<token>.pem" is a hard link to it, so that 500 profiles of a
+ * provider embedding the same CA share one file. */
+#define INLINE_BLOB_STORE_DIR "blobs"
+
+static gsize
+inline_blob_get_len (const InlineBlobData *data)
+{
+	gsize len = 0;
+	guint i;
+
+	for (i = 0; i < data->slices->len; i++)
+		len += g_array_index (data->slices, InlineBlobSlice, i).len;
+	return len;
+}
+
+static char *
+inline_blob_checksum (const InlineBlobData *data)
+{
+	GChecksum *sum;
+	char *str;
+	guint i;
+
+	sum = g_checksum_new (G_CHECKSUM_SHA256);
+	for (i = 0; i < data->slices->len; i++) {
+		const InlineBlobSlice *slice = &g_array_index (data->slices, InlineBlobSlice, i);
+
+		g_checksum_update (sum, (const guchar *) slice->str, slice->len);
+	}
+	str = g_strdup (g_checksum_get_string (sum));
+	g_checksum_free (sum);
+	return str;
+}
+
+static gboolean
+_fd_read_full (int fd, char *buf, gsize len)
+{
+	while (len > 0) {
+		gssize n = read (fd, buf, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		if (n == 0)
+			return FALSE;
+		buf += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+static gboolean
+_fd_write_full (int fd, const char *buf, gsize len)
+{
+	while (len > 0) {
+		gssize n = write (fd, buf, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		buf += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+/* checks whether the regular file @path with stat @st has exactly the
+ * content of the blob. */
+static gboolean
+inline_blob_equals_file (const InlineBlobData *data, const char *path, const struct stat *st)
+{
+	nm_auto_close int fd = -1;
+	char buf[16384];
+	guint i;
+
+	if (   !S_ISREG (st->st_mode)
+	    || st->st_size != (off_t) inline_blob_get_len (data))
+		return FALSE;
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return FALSE;
+
+	for (i = 0; i < data->slices->len; i++) {
+		const InlineBlobSlice *slice = &g_array_index (data->slices, InlineBlobSlice, i);
+		gsize offset, n;
+
+		for (offset = 0; offset < slice->len; offset += n) {
+			n = MIN (sizeof (buf), slice->len - offset);
+			if (!_fd_read_full (fd, buf, n))
+				return FALSE;
+			if (memcmp (buf, &slice->str[offset], n) != 0)
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* the SHA-256 sum of a file, or %NULL. */
+static char *
+_file_checksum (const char *path)
+{
+	nm_auto_close int fd = -1;
+	GChecksum *sum;
+	char buf[16384];
+	char *str;
+	gssize n;
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	sum = g_checksum_new (G_CHECKSUM_SHA256);
+	while ((n = read (fd, buf, sizeof (buf))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			g_checksum_free (sum);
+			return NULL;
+		}
+		g_checksum_update (sum, (const guchar *) buf, n);
+	}
+	str = g_strdup (g_checksum_get_string (sum));
+	g_checksum_free (sum);
+	return str;
+}
+
+/* like g_file_set_contents(), but writes the slices of the blob. */
+static gboolean
+inline_blob_write_file (const InlineBlobData *data, const char *path)
+{
+	gs_free char *tmp_path = NULL;
+	int fd;
+	guint i;
+
+	tmp_path = g_strdup_printf ("%s.XXXXXX", path);
+	fd = g_mkstemp_full (tmp_path, O_RDWR | O_CLOEXEC, 0666);
+	if (fd < 0)
+		return FALSE;
+
+	for (i = 0; i < data->slices->len; i++) {
+		const InlineBlobSlice *slice = &g_array_index (data->slices, InlineBlobSlice, i);
+
+		if (!_fd_write_full (fd, slice->str, slice->len))
+			goto fail;
+	}
+
+	if (fsync (fd) != 0)
+		goto fail;
+	if (close (fd) != 0) {
+		fd = -1;
+		goto fail;
+	}
+	fd = -1;
+
+	if (rename (tmp_path, path) != 0)
+		goto fail;
+	return TRUE;
+
+fail:
+	if (fd >= 0)
+		close (fd);
+	unlink (tmp_path);
+	return FALSE;
+}
+
+/* Only public material is shared through the store. Keys and other secrets
+ * get a file of their own per connection, so that editing the key of one
+ * profile in place doesn't silently change every profile sharing it. */
+static gboolean
+inline_blob_is_public (const InlineBlobData *data)
+{
+	return NM_IN_STRSET (data->token, INLINE_BLOB_CA,
+	                                  INLINE_BLOB_CERT,
+	                                  INLINE_BLOB_EXTRA_CERTS,
+	                                  INLINE_BLOB_CRL_VERIFY);
+}
+
+static gboolean
+inline_blob_write_locked (const InlineBlobData *data)
+{
+	gs_free char *dirname = NULL;
+	gs_free char *store_dir = NULL;
+	gs_free char *store_path = NULL;
+	gs_free char *checksum = NULL;
+	gs_free char *old_checksum = NULL;
+	gs_free char *old_store_path = NULL;
+	gs_free char *link_path = NULL;
+	struct stat st, st_store;
+	gboolean exists;
+	gboolean is_public;
+
+	dirname = g_path_get_dirname (data->path);
+	store_dir = g_build_filename (dirname, INLINE_BLOB_STORE_DIR, NULL);
+	is_public = inline_blob_is_public (data);
+
+	exists = (lstat (data->path, &st) == 0);
+	if (exists) {
+		if (is_public) {
+			/* skip the rewrite if the file already has the right content. */
+			checksum = inline_blob_checksum (data);
+			store_path = g_build_filename (store_dir, checksum, NULL);
+			if (   stat (store_path, &st_store) == 0
+			    && st.st_dev == st_store.st_dev
+			    && st.st_ino == st_store.st_ino)
+				return TRUE;
+		}
+		/* a secret that is still linked into the store gets unshared. */
+		if (   (is_public || st.st_nlink == 1)
+		    && inline_blob_equals_file (data, data->path, &st))
+			return TRUE;
+
+		/* remember which blob the file linked to before, so that it can be
+		 * dropped from the store once no connection uses it anymore. */
+		if (   S_ISREG (st.st_mode)
+		    && st.st_nlink > 1) {
+			old_checksum = _file_checksum (data->path);
+			if (old_checksum)
+				old_store_path = g_build_filename (store_dir, old_checksum, NULL);
+		}
+	}
+
+	if (!is_public)
+		goto copy;
+
+	if (   mkdir (store_dir, 0755) != 0
+	    && errno != EEXIST)
+		goto copy;
+
+	if (!store_path) {
+		checksum = inline_blob_checksum (data);
+		store_path = g_build_filename (store_dir, checksum, NULL);
+	}
+
+	/* the file is named by its content, so if it exists, it is the blob. */
+	if (   stat (store_path, &st_store) != 0
+	    || !S_ISREG (st_store.st_mode)
+	    || st_store.st_size != (off_t) inline_blob_get_len (data)) {
+		if (!inline_blob_write_file (data, store_path))
+			goto copy;
+	}
+
+	link_path = g_strdup_printf ("%s.%ld.lnk", data->path, (long) getpid ());
+	unlink (link_path);
+	if (link (store_path, link_path) != 0)
+		goto copy;
+	if (rename (link_path, data->path) != 0) {
+		unlink (link_path);
+		goto copy;
+	}
+	goto out;
+
+copy:
+	/* a secret, or e.g. the file system doesn't support hard links. */
+	if (!inline_blob_write_file (data, data->path))
+		return FALSE;
+
+out:
+	if (   old_store_path
+	    && stat (old_store_path, &st_store) == 0
+	    && st_store.st_dev == st.st_dev
+	    && st_store.st_ino == st.st_ino
+	    && st_store.st_nlink == 1)
+		unlink (old_store_path);
+
+	return TRUE;
+}
+
 static gboolean
 inline_blob_write_out (const InlineBlobData *data, GError **error)
 {
 	mode_t saved_umask;
+	gboolean success;
+
+	g_mutex_lock (&inline_blob_write_lock);
 
 	if (!_nmovpn_test_temp_path) {
 		gs_free char *err_msg = NULL;
 
 		/* in test mode we don't create the certificate directory. */
 		if (!inline_blob_mkdir_parents (data, data->path, &err_msg)) {
+			g_mutex_unlock (&inline_blob_write_lock);
 			g_set_error (error,
 			             NMV_EDITOR_PLUGIN_ERROR,
 			             NMV_EDITOR_PLUGIN_ERROR_FAILED,
@@ -756,7 +1299,12 @@ inline_blob_write_out (const InlineBlobData *data, GError **error)
 	/* The file is written with the default umask. Whether that is safe enough
 	 * to protect (potentally) private data or allows the openvpn service to
 	 * access the file later on is left as exercise for the user. */
-	if (!g_file_set_contents (data->path, data->blob_data->str, data->blob_data->len, NULL)) {
+	success = inline_blob_write_locked (data);
+
+	umask (saved_umask);
+	g_mutex_unlock (&inline_blob_write_lock);
+
+	if (!success) {
 		g_set_error (error,
 		             NMV_EDITOR_PLUGIN_ERROR,
 		             NMV_EDITOR_PLUGIN_ERROR_FAILED,
@@ -764,868 +1312,1052 @@ inline_blob_write_out (const InlineBlobData *data, GError **error)
 		             data->token,
 		             (long) data->token_start_line,
 		             data->path);
-		umask (saved_umask);
 		return FALSE;
 	}
-
-	umask (saved_umask);
 	return TRUE;
 }
 
 /*****************************************************************************/
 
-NMConnection *
-do_import (const char *path, const char *contents, gsize contents_len, GError **error)
-{
-	gs_unref_object NMConnection *connection = NULL;
-	NMSettingConnection *s_con;
+typedef struct {
+	const char *default_path;
+	const char *basename;
 	NMSettingIPConfig *s_ip4;
 	NMSettingVpn *s_vpn;
-	const char *cur_line, *cur_line_delimiter;
-	gsize cur_line_len;
+
+	/* the remaining content. Handlers of inline blobs consume further lines. */
+	const char *contents;
+	gsize contents_len;
 	gsize contents_cur_line;
-	gboolean have_client = FALSE, have_remote = FALSE;
-	gboolean have_pass = FALSE, have_sk = FALSE;
-	const char *ctype = NULL;
-	gs_free char *basename = NULL;
-	gs_free char *default_path = NULL;
-	char *tmp, *tmp2;
-	const char *ta_direction = NULL, *secret_direction = NULL;
-	gboolean allow_ta_direction = FALSE, allow_secret_direction = FALSE;
-	gboolean have_cert = FALSE, have_key = FALSE, have_ca = FALSE, have_pkcs12 = FALSE;
-	const char *cert_path = NULL, *key_path = NULL, *ca_path = NULL;
-	GSList *inline_blobs = NULL;
-	GSList *sl_iter;
 
-	g_return_val_if_fail (!error || !*error, NULL);
+	const char *ta_direction;
+	const char *secret_direction;
+	GSList *inline_blobs;
+
+	/* the entries of all "remote" lines. They are joined and set
+	 * only once, after parsing. */
+	GPtrArray *remotes;
+
+	bool have_client:1;
+	bool have_remote:1;
+	bool have_pass:1;
+	bool have_sk:1;
+	bool have_cert:1;
+	bool have_key:1;
+	bool have_ca:1;
+	bool have_pkcs12:1;
+	bool allow_ta_direction:1;
+	bool allow_secret_direction:1;
+} ImportData;
+
+typedef struct _ImportDirective ImportDirective;
+
+/* Handle one line of the configuration. The number of arguments is already
+ * checked against the directive's nargs_min/nargs_max. */
+typedef gboolean (*ImportDirectiveFunc) (ImportData *data,
+                                         const ImportDirective *directive,
+                                         const char **params,
+                                         char **out_error);
+
+struct _ImportDirective {
+	const char *name;
+	guint8 nargs_min;
+	guint8 nargs_max;
+	ImportDirectiveFunc func;
+
+	/* the setting key and range of integer values, for directives handled
+	 * by the generic functions. */
+	const char *key;
+	gint64 min;
+	gint64 max;
+};
 
-	connection = nm_simple_connection_new ();
+static gboolean
+import_flag (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	setting_vpn_add_data_item (data->s_vpn, directive->key, "yes");
+	return TRUE;
+}
 
-	s_con = NM_SETTING_CONNECTION (nm_setting_connection_new ());
-	nm_connection_add_setting (connection, NM_SETTING (s_con));
-	s_ip4 = NM_SETTING_IP_CONFIG (nm_setting_ip4_config_new ());
-	nm_connection_add_setting (connection, NM_SETTING (s_ip4));
-	g_object_set (s_ip4, NM_SETTING_IP_CONFIG_METHOD, NM_SETTING_IP4_CONFIG_METHOD_AUTO, NULL);
-	s_vpn = NM_SETTING_VPN (nm_setting_vpn_new ());
-	g_object_set (s_vpn, NM_SETTING_VPN_SERVICE_TYPE, NM_VPN_SERVICE_TYPE_OPENVPN, NULL);
-	nm_connection_add_setting (connection, NM_SETTING (s_vpn));
+static gboolean
+import_utf8 (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	if (!args_params_check_arg_utf8 (params, 1, NULL, out_error))
+		return FALSE;
+	setting_vpn_add_data_item (data->s_vpn, directive->key, params[1]);
+	return TRUE;
+}
 
-	/* Get the default path for ca, cert, key file, these files maybe
-	 * in same path with the configuration file */
-	if (g_path_is_absolute (path))
-		default_path = g_path_get_dirname (path);
-	else {
-		tmp = g_get_current_dir ();
-		tmp2 = g_path_get_dirname (path);
-		default_path = g_build_filename (tmp, tmp2, NULL);
-		g_free (tmp);
-		g_free (tmp2);
+static gboolean
+import_int64 (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	gint64 v_int64;
+
+	if (!args_params_parse_int64 (params, 1, directive->min, directive->max, &v_int64, out_error))
+		return FALSE;
+	setting_vpn_add_data_item_int64 (data->s_vpn, directive->key, v_int64);
+	return TRUE;
+}
+
+static gboolean
+import_client (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	data->have_client = TRUE;
+	return TRUE;
+}
+
+static gboolean
+import_key_direction (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	if (!args_params_parse_key_direction (params, 1, &data->ta_direction, out_error))
+		return FALSE;
+	data->secret_direction = data->ta_direction;
+	return TRUE;
+}
+
+static gboolean
+import_dev (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	if (!args_params_check_arg_nonempty (params, 1, NULL, out_error))
+		return FALSE;
+	setting_vpn_add_data_item_utf8safe (data->s_vpn, NM_OPENVPN_KEY_DEV, params[1]);
+	return TRUE;
+}
+
+static gboolean
+import_dev_type (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	if (!NM_IN_STRSET (params[1], "tun", "tap")) {
+		*out_error = args_params_error_message_invalid_arg (params, 1);
+		return FALSE;
 	}
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_DEV_TYPE, params[1]);
+	return TRUE;
+}
 
-	basename = g_path_get_basename (path);
-	tmp = strrchr (basename, '.');
-	if (tmp)
-		*tmp = '\0';
-	g_object_set (s_con, NM_SETTING_CONNECTION_ID, basename, NULL);
+static gboolean
+import_proto (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	/* Valid parameters are defined in shared/utils.h
+	 * 'tcp' isn't technically valid, but it used to be accepted so
+	 * we'll handle it here anyway.
+	 */
+	if (!NM_IN_STRSET (params[1], NMOVPN_PROTCOL_TYPES)) {
+		*out_error = g_strdup_printf (_("proto expects protocol type like “udp” or “tcp”"));
+		return FALSE;
+	}
+	if (!NM_IN_STRSET (params[1], "udp", "udp4", "udp6"))
+		setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_PROTO_TCP, "yes");
+	return TRUE;
+}
 
-	if (strncmp (contents, "\xEF\xBB\xBF", 3) == 0) {
-		/* skip over UTF-8 BOM */
-		contents += 3;
-		contents_len -= 3;
+static gboolean
+import_mssfix (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	gint64 v_int64;
+
+	if (params[1]) {
+		if (!args_params_parse_int64 (params, 1, 0, G_MAXINT32, &v_int64, out_error))
+			return FALSE;
+		setting_vpn_add_data_item_int64 (data->s_vpn, NM_OPENVPN_KEY_MSSFIX, v_int64);
+	} else
+		setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_MSSFIX, "yes");
+	return TRUE;
+}
+
+static gboolean
+import_mtu_disc (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	if (!NM_IN_STRSET (params[1], "no", "maybe", "yes")) {
+		*out_error = g_strdup_printf (_("unsupported mtu-disc argument"));
+		return FALSE;
 	}
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_MTU_DISC, params[1]);
+	return TRUE;
+}
 
-	contents_cur_line = 0;
-	while (args_next_line (&contents,
-	                       &contents_len,
-	                       &cur_line,
-	                       &cur_line_len,
-	                       &cur_line_delimiter)) {
-		gs_free const char **params = NULL;
-		char *line_error = NULL;
-		gint64 v_int64;
+static gboolean
+import_crl_verify (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	const char *file;
+	gs_free char *file_free = NULL;
 
-		contents_cur_line++;
+	if (!args_params_check_arg_nonempty (params, 1, NULL, out_error))
+		return FALSE;
+	if (params[2] && !nm_streq (params[2], "dir")) {
+		*out_error = g_strdup_printf (_("unsupported crl-verify argument"));
+		return FALSE;
+	}
 
-		if (!args_parse_line (cur_line, cur_line_len, &params, &line_error))
-			goto handle_line_error;
+	file = params[1];
+	if (!g_path_is_absolute (file))
+		file = file_free = g_build_filename (data->default_path, file, NULL);
 
-		if (!params) {
-			/* empty line of comments. */
-			continue;
-		}
+	if (params[2])
+		setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_CRL_VERIFY_DIR, file);
+	else
+		setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_CRL_VERIFY_FILE, file);
+	return TRUE;
+}
 
-		g_assert (params[0]);
+static gboolean
+import_ns_cert_type (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	if (!NM_IN_STRSET (params[1], NM_OPENVPN_NS_CERT_TYPE_CLIENT, NM_OPENVPN_NS_CERT_TYPE_SERVER)) {
+		*out_error = g_strdup_printf (_("invalid option"));
+		return FALSE;
+	}
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_NS_CERT_TYPE, params[1]);
+	return TRUE;
+}
 
-		/* allow for a leading double-dash and skip over it (bypass_doubledash). */
-		if (g_str_has_prefix (params[0], "--"))
-			params[0] = &params[0][2];
+static gboolean
+import_comp_lzo (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	const char *v;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_CLIENT, NMV_OVPN_TAG_TLS_CLIENT)) {
-			if (!args_params_check_nargs_n (params, 0, &line_error))
-				goto handle_line_error;
-			have_client = TRUE;
-			continue;
-		}
+	v = params[1] ?: "adaptive";
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_KEY_DIRECTION)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_key_direction (params, 1, &ta_direction, &line_error))
-				goto handle_line_error;
-			secret_direction = ta_direction;
-			continue;
-		}
+	if (nm_streq (v, "no")) {
+		/* old plasma-nm used to set "comp-lzo=no" to mean unset, thus it spoiled
+		 * the "no" option to be used in the connection. Workaround that, by instead
+		 * using "no-by-default" (bgo#769177). */
+		v = "no-by-default";
+	} else if (!NM_IN_STRSET (v, "yes", "adaptive")) {
+		*out_error = g_strdup_printf (_("unsupported comp-lzo argument"));
+		return FALSE;
+	}
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_COMP_LZO, v);
+	return TRUE;
+}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_DEV)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_nonempty (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item_utf8safe (s_vpn, NM_OPENVPN_KEY_DEV, params[1]);
-			continue;
+static gboolean
+import_compress (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	if (params[1]) {
+		if (!NM_IN_STRSET (params[1], "lzo", "lz4", "lz4-v2")) {
+			*out_error = g_strdup_printf (_("unsupported compress argument"));
+			return FALSE;
 		}
+		setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_COMPRESS, params[1]);
+	} else
+		setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_COMPRESS, "yes");
+	return TRUE;
+}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_DEV_TYPE)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!NM_IN_STRSET (params[1], "tun", "tap")) {
-				line_error = args_params_error_message_invalid_arg (params, 1);
-				goto handle_line_error;
-			}
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_DEV_TYPE, params[1]);
-			continue;
-		}
+static gboolean
+import_proxy (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	gint64 port = 0;
+	gs_free char *user = NULL;
+	gs_free char *pass = NULL;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_PROTO)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			/* Valid parameters are defined in shared/utils.h
-			 * 'tcp' isn't technically valid, but it used to be accepted so
-			 * we'll handle it here anyway.
-			 */
-			if (!NM_IN_STRSET (params[1], NMOVPN_PROTCOL_TYPES)) {
-				line_error = g_strdup_printf (_("proto expects protocol type like “udp” or “tcp”"));
-				goto handle_line_error;
-			}
-			if (!NM_IN_STRSET (params[1], "udp", "udp4", "udp6")) {
-				setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_PROTO_TCP, "yes");
-			}
-			continue;
-		}
+	if (!args_params_check_arg_utf8 (params, 1, "service", out_error))
+		return FALSE;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_MSSFIX)) {
-			if (!args_params_check_nargs_minmax (params, 0, 1, &line_error))
-				goto handle_line_error;
-			if (params[1]) {
-				if (!args_params_parse_int64 (params, 1, 0, G_MAXINT32, &v_int64, &line_error))
-					goto handle_line_error;
-				setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_MSSFIX, v_int64);
-			} else
-				setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_MSSFIX, "yes");
-			continue;
-		}
+	if (params[2]) {
+		if (!args_params_parse_port (params, 2, &port, out_error))
+			return FALSE;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_MTU_DISC)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!NM_IN_STRSET (params[1], "no", "maybe", "yes")) {
-				line_error = g_strdup_printf (_("unsupported mtu-disc argument"));
-				goto handle_line_error;
-			}
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_MTU_DISC, params[1]);
-			continue;
+		if (params[3]) {
+			if (!parse_http_proxy_auth (data->default_path, params[3], &user, &pass, out_error))
+				return FALSE;
 		}
+	}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_CRL_VERIFY)) {
-			const char *file;
-			gs_free char *file_free = NULL;
+	/* the key is the proxy type, "http" or "socks". */
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_PROXY_TYPE, directive->key);
+
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_PROXY_SERVER, params[1]);
+	if (port > 0)
+		setting_vpn_add_data_item_int64 (data->s_vpn, NM_OPENVPN_KEY_PROXY_PORT, port);
+	if (user)
+		setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_HTTP_PROXY_USERNAME, user);
+	if (pass) {
+		nm_setting_vpn_add_secret (data->s_vpn, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD, pass);
+		nm_setting_set_secret_flags (NM_SETTING (data->s_vpn),
+		                             NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD,
+		                             NM_SETTING_SECRET_FLAG_AGENT_OWNED,
+		                             NULL);
+	}
+	return TRUE;
+}
 
-			if (!args_params_check_nargs_minmax (params, 1, 2, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_nonempty (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			if (params[2] && !nm_streq (params[2], "dir")) {
-				line_error = g_strdup_printf (_("unsupported crl-verify argument"));
-				goto handle_line_error;
-			}
+static gboolean
+import_remote (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	GString *new_remote;
+	int port = -1;
+	gint64 v_int64;
+	gboolean host_has_colon;
+	struct in6_addr a;
 
-			file = params[1];
-			if (!g_path_is_absolute (file))
-				file = file_free = g_build_filename (default_path, file, NULL);
+	if (!args_params_check_arg_utf8 (params, 1, NULL, out_error))
+		return FALSE;
+	if (strchr (params[1], ' ')) {
+		*out_error = g_strdup_printf (_("remote cannot contain space"));
+		return FALSE;
+	}
+	if (strchr (params[1], ',')) {
+		*out_error = g_strdup_printf (_("remote cannot contain comma"));
+		return FALSE;
+	}
 
-			if (params[2])
-				setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_CRL_VERIFY_DIR, file);
-			else
-				setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_CRL_VERIFY_FILE, file);
-		}
+	if (params[2]) {
+		if (!args_params_parse_port (params, 2, &v_int64, out_error))
+			return FALSE;
+		port = v_int64;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_NS_CERT_TYPE)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!NM_IN_STRSET (params[1], NM_OPENVPN_NS_CERT_TYPE_CLIENT, NM_OPENVPN_NS_CERT_TYPE_SERVER)) {
-				line_error = g_strdup_printf (_("invalid option"));
-				goto handle_line_error;
+		if (params[3]) {
+			if (!NM_IN_STRSET (params[3], NMOVPN_PROTCOL_TYPES)) {
+				*out_error = g_strdup_printf (_("remote expects protocol type like “udp” or “tcp”"));
+				return FALSE;
 			}
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_NS_CERT_TYPE, params[1]);
-			continue;
 		}
+	}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_TUN_MTU)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_int64 (params, 1, 0, 0xffff, &v_int64, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_TUNNEL_MTU, v_int64);
-			continue;
-		}
+	new_remote = g_string_sized_new (64);
 
-		if (NM_IN_STRSET (params[0],
-		                  NMV_OVPN_TAG_CONNECT_TIMEOUT,
-		                  NMV_OVPN_TAG_SERVER_POLL_TIMEOUT)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_int64 (params, 1, 0, G_MAXINT, &v_int64, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_CONNECT_TIMEOUT, v_int64);
-			continue;
-		}
+	host_has_colon = (strchr (params[1], ':') != NULL);
+	if (   host_has_colon
+	    && inet_pton (AF_INET6, params[1], &a) == 1) {
+		/* need to escape the host. */
+		g_string_append_printf (new_remote, "[%s]", params[1]);
+	} else
+		g_string_append (new_remote, params[1]);
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_FRAGMENT)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_int64 (params, 1, 0, 0xffff, &v_int64, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_FRAGMENT_SIZE, v_int64);
-			continue;
-		}
+	if (params[2]) {
+		g_string_append_printf (new_remote, ":%d", port);
+		if (params[3]) {
+			g_string_append_c (new_remote, ':');
+			g_string_append (new_remote, params[3]);
+		} else if (host_has_colon)
+			g_string_append_c (new_remote, ':');
+	} else if (host_has_colon)
+		g_string_append (new_remote, "::");
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_COMP_LZO)) {
-			const char *v;
+	g_ptr_array_add (data->remotes, g_string_free (new_remote, FALSE));
 
-			if (!args_params_check_nargs_minmax (params, 0, 1, &line_error))
-				goto handle_line_error;
+	data->have_remote = TRUE;
+	return TRUE;
+}
 
-			v = params[1] ?: "adaptive";
+static gboolean
+import_file (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	const char *file;
+	gs_free char *file_free = NULL;
+	const char *s_direction = NULL;
 
-			if (nm_streq (v, "no")) {
-				/* old plasma-nm used to set "comp-lzo=no" to mean unset, thus it spoiled
-				 * the "no" option to be used in the connection. Workaround that, by instead
-				 * using "no-by-default" (bgo#769177). */
-				v = "no-by-default";
-			} else if (!NM_IN_STRSET (v, "yes", "adaptive")) {
-				line_error = g_strdup_printf (_("unsupported comp-lzo argument"));
-				goto handle_line_error;
-			}
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_COMP_LZO, v);
-			continue;
-		}
+	if (!args_params_check_arg_nonempty (params, 1, NULL, out_error))
+		return FALSE;
+	file = params[1];
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_COMPRESS)) {
-			if (!args_params_check_nargs_minmax (params, 0, 1, &line_error))
-				goto handle_line_error;
-			if (params[1]) {
-				if (!NM_IN_STRSET (params[1], "lzo", "lz4", "lz4-v2")) {
-					line_error = g_strdup_printf (_("unsupported compress argument"));
-					goto handle_line_error;
-				}
-				setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_COMPRESS, params[1]);
-			} else {
-				setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_COMPRESS, "yes");
-			}
-			continue;
-		}
+	if (params[2]) {
+		if (!args_params_parse_key_direction (params, 2, &s_direction, out_error))
+			return FALSE;
+	}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_FLOAT)) {
-			if (!args_params_check_nargs_n (params, 0, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_FLOAT, "yes");
-			continue;
-		}
+	if (!g_path_is_absolute (file))
+		file = file_free = g_build_filename (data->default_path, file, NULL);
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_RENEG_SEC)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_int64 (params, 1, 0, G_MAXINT, &v_int64, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_RENEG_SECONDS, v_int64);
-			continue;
+	if (nm_streq (directive->name, NMV_OVPN_TAG_PKCS12)) {
+		 /* OpenVPN allows --pkcs12 with external (PEM) --ca. Don't overwrite it with the PKCS#12 file. */
+		if (!data->have_ca) {
+			setting_vpn_add_data_item_path (data->s_vpn, NM_OPENVPN_KEY_CA, file);
+			data->have_ca = TRUE;
 		}
+		setting_vpn_add_data_item_path (data->s_vpn, NM_OPENVPN_KEY_CERT, file);
+		setting_vpn_add_data_item_path (data->s_vpn, NM_OPENVPN_KEY_KEY, file);
+		data->have_pkcs12 = TRUE;
+		return TRUE;
+	}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_MAX_ROUTES)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_int64 (params, 1, 0, 100000000, &v_int64, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_MAX_ROUTES, v_int64);
-			continue;
-		}
+	setting_vpn_add_data_item_path (data->s_vpn, directive->key, file);
+
+	if (nm_streq (directive->name, NMV_OVPN_TAG_CA))
+		data->have_ca = TRUE;
+	else if (nm_streq (directive->name, NMV_OVPN_TAG_CERT))
+		data->have_cert = TRUE;
+	else if (nm_streq (directive->name, NMV_OVPN_TAG_KEY))
+		data->have_key = TRUE;
+	else if (nm_streq (directive->name, NMV_OVPN_TAG_SECRET)) {
+		if (s_direction)
+			data->secret_direction = s_direction;
+		data->allow_secret_direction = TRUE;
+		data->have_sk = TRUE;
+	} else if (nm_streq (directive->name, NMV_OVPN_TAG_TLS_AUTH)) {
+		if (s_direction)
+			data->ta_direction = s_direction;
+		data->allow_ta_direction = TRUE;
+	}
+	return TRUE;
+}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_HTTP_PROXY_RETRY, NMV_OVPN_TAG_SOCKS_PROXY_RETRY)) {
-			if (!args_params_check_nargs_n (params, 0, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_PROXY_RETRY, "yes");
-			continue;
+static gboolean
+import_keepalive (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	gint64 v1, v2;
+
+	if (!args_params_parse_int64 (params, 1, 0, G_MAXINT, &v1, out_error))
+		return FALSE;
+	if (!args_params_parse_int64 (params, 2, 0, G_MAXINT, &v2, out_error))
+		return FALSE;
+	setting_vpn_add_data_item_int64 (data->s_vpn, NM_OPENVPN_KEY_PING, v1);
+	setting_vpn_add_data_item_int64 (data->s_vpn, NM_OPENVPN_KEY_PING_RESTART, v2);
+	return TRUE;
+}
+
+static gboolean
+import_verify_x509_name (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	const char *type = NM_OPENVPN_VERIFY_X509_NAME_TYPE_SUBJECT;
+	gs_free char *item = NULL;
+
+	if (!args_params_check_arg_utf8 (params, 1, NULL, out_error))
+		return FALSE;
+
+	if (params[2]) {
+		if (!NM_IN_STRSET (params[2],
+		                   NM_OPENVPN_VERIFY_X509_NAME_TYPE_SUBJECT,
+		                   NM_OPENVPN_VERIFY_X509_NAME_TYPE_NAME,
+		                   NM_OPENVPN_VERIFY_X509_NAME_TYPE_NAME_PREFIX)) {
+			*out_error = g_strdup_printf (_("invalid verify-x509-name type"));
+			return FALSE;
 		}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_HTTP_PROXY, NMV_OVPN_TAG_SOCKS_PROXY)) {
-			const char *proxy_type = NULL;
-			gint64 port = 0;
-			gs_free char *user = NULL;
-			gs_free char *pass = NULL;
+		type = params[2];
+	}
 
-			if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_HTTP_PROXY)) {
-				proxy_type = "http";
-				if (!args_params_check_nargs_minmax (params, 2, 4, &line_error))
-					goto handle_line_error;
-			} else {
-				proxy_type = "socks";
-				if (!args_params_check_nargs_minmax (params, 1, 3, &line_error))
-					goto handle_line_error;
-			}
+	item = g_strdup_printf ("%s:%s", type, params[1]);
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_VERIFY_X509_NAME, item);
+	return TRUE;
+}
 
-			if (!args_params_check_arg_utf8 (params, 1, "service", &line_error))
-				goto handle_line_error;
+static gboolean
+import_remote_cert_tls (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	if (!NM_IN_STRSET (params[1], NM_OPENVPN_REM_CERT_TLS_CLIENT, NM_OPENVPN_REM_CERT_TLS_SERVER)) {
+		*out_error = g_strdup_printf (_("invalid option"));
+		return FALSE;
+	}
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_REMOTE_CERT_TLS, params[1]);
+	return TRUE;
+}
 
-			if (params[2]) {
-				if (!args_params_parse_port (params, 2, &port, &line_error))
-					goto handle_line_error;
+static gboolean
+import_ifconfig (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	if (!args_params_check_arg_utf8 (params, 1, "local", out_error))
+		return FALSE;
+	if (!args_params_check_arg_utf8 (params, 2, "remote", out_error))
+		return FALSE;
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_LOCAL_IP, params[1]);
+	setting_vpn_add_data_item (data->s_vpn, NM_OPENVPN_KEY_REMOTE_IP, params[2]);
+	return TRUE;
+}
 
-				if (params[3]) {
-					if (!parse_http_proxy_auth (default_path, params[3], &user, &pass, &line_error))
-						goto handle_line_error;
-				}
-			}
+static gboolean
+import_auth_user_pass (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	data->have_pass = TRUE;
+	return TRUE;
+}
 
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_PROXY_TYPE, proxy_type);
-
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_PROXY_SERVER, params[1]);
-			if (port > 0)
-				setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_PROXY_PORT, port);
-			if (user)
-				setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_HTTP_PROXY_USERNAME, user);
-			if (pass) {
-				nm_setting_vpn_add_secret (s_vpn, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD, pass);
-				nm_setting_set_secret_flags (NM_SETTING (s_vpn),
-				                             NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD,
-				                             NM_SETTING_SECRET_FLAG_AGENT_OWNED,
-				                             NULL);
+static gboolean
+import_route (ImportData *data, const ImportDirective *directive, const char **params, char **out_error)
+{
+	in_addr_t network;
+	in_addr_t gateway = 0;
+	guint32 prefix = 32;
+	gint64 metric = -1;
+	gint64 v_int64;
+
+	if (!args_params_parse_ip4 (params, 1, TRUE, &network, out_error))
+		return FALSE;
+
+	if (params[2]) {
+		in_addr_t netmask;
+
+		if (!args_params_parse_ip4 (params, 2, FALSE, &netmask, out_error))
+			return FALSE;
+		prefix = nm_utils_ip4_netmask_to_prefix (netmask);
+
+		if (params[3]) {
+			if (!args_params_parse_ip4 (params, 3, TRUE, &gateway, out_error))
+				return FALSE;
+			if (params[4]) {
+				if (!args_params_parse_int64 (params, 4, 0, G_MAXUINT32, &v_int64, out_error))
+					return FALSE;
+				metric = (guint32) v_int64;
 			}
-			continue;
 		}
+	}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_REMOTE)) {
-			const char *prev;
-			GString *new_remote;
-			int port = -1;
-			gboolean host_has_colon;
-			struct in6_addr a;
+	if (prefix == 0 && network == 0) {
+		/* the default-route cannot be specified as normal route in NMSettingIPConfig.
+		 * Just set never-default=FALSE (which is already the default). */
+		g_object_set (data->s_ip4,
+		              NM_SETTING_IP_CONFIG_NEVER_DEFAULT,
+		              FALSE,
+		              NULL);
+		return TRUE;
+	}
 
-			if (!args_params_check_nargs_minmax (params, 1, 3, &line_error))
-				goto handle_line_error;
+	{
+#if ((NETWORKMANAGER_COMPILATION) & NM_NETWORKMANAGER_COMPILATION_WITH_LIBNM_UTIL)
+		NMIP4Route *route;
+
+		route = nm_ip4_route_new ();
+		nm_ip4_route_set_dest (route, network);
+		nm_ip4_route_set_prefix (route, prefix);
+		nm_ip4_route_set_next_hop (route, gateway);
+		if (metric >= 0)
+			nm_ip4_route_set_metric (route, metric);
+		nm_setting_ip4_config_add_route (data->s_ip4, route);
+		nm_ip4_route_unref (route);
+#else
+		NMIPRoute *route;
 
-			if (!args_params_check_arg_utf8 (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			if (strchr (params[1], ' ')) {
-				line_error = g_strdup_printf (_("remote cannot contain space"));
-				goto handle_line_error;
-			}
-			if (strchr (params[1], ',')) {
-				line_error = g_strdup_printf (_("remote cannot contain comma"));
-				goto handle_line_error;
-			}
+		route = nm_ip_route_new_binary (AF_INET, &network, prefix, params[3] ? &gateway : NULL, metric, NULL);
+		nm_setting_ip_config_add_route (data->s_ip4, route);
+		nm_ip_route_unref (route);
+#endif
+	}
+	return TRUE;
+}
 
-			if (params[2]) {
-				if (!args_params_parse_port (params, 2, &v_int64, &line_error))
-					goto handle_line_error;
-				port = v_int64;
+static const ImportDirective import_directives[] = {
+#define _D(_name, _nargs_min, _nargs_max, _func, ...) \
+	{ .name = _name, .nargs_min = _nargs_min, .nargs_max = _nargs_max, .func = _func, __VA_ARGS__ }
+	_D (NMV_OVPN_TAG_ALLOW_PULL_FQDN,        0, 0, import_flag,             .key = NM_OPENVPN_KEY_ALLOW_PULL_FQDN),
+	_D (NMV_OVPN_TAG_AUTH,                   1, 1, import_utf8,             .key = NM_OPENVPN_KEY_AUTH),
+	_D (NMV_OVPN_TAG_AUTH_USER_PASS,         0, 1, import_auth_user_pass),
+	_D (NMV_OVPN_TAG_CA,                     1, 1, import_file,             .key = NM_OPENVPN_KEY_CA),
+	_D (NMV_OVPN_TAG_CERT,                   1, 1, import_file,             .key = NM_OPENVPN_KEY_CERT),
+	_D (NMV_OVPN_TAG_CIPHER,                 1, 1, import_utf8,             .key = NM_OPENVPN_KEY_CIPHER),
+	_D (NMV_OVPN_TAG_CLIENT,                 0, 0, import_client),
+	_D (NMV_OVPN_TAG_COMP_LZO,               0, 1, import_comp_lzo),
+	_D (NMV_OVPN_TAG_COMPRESS,               0, 1, import_compress),
+	_D (NMV_OVPN_TAG_CONNECT_TIMEOUT,        1, 1, import_int64,            .key = NM_OPENVPN_KEY_CONNECT_TIMEOUT, .min = 0, .max = G_MAXINT),
+	_D (NMV_OVPN_TAG_CRL_VERIFY,             1, 2, import_crl_verify),
+	_D (NMV_OVPN_TAG_DEV,                    1, 1, import_dev),
+	_D (NMV_OVPN_TAG_DEV_TYPE,               1, 1, import_dev_type),
+	_D (NMV_OVPN_TAG_EXTRA_CERTS,            1, 1, import_file,             .key = NM_OPENVPN_KEY_EXTRA_CERTS),
+	_D (NMV_OVPN_TAG_FLOAT,                  0, 0, import_flag,             .key = NM_OPENVPN_KEY_FLOAT),
+	_D (NMV_OVPN_TAG_FRAGMENT,               1, 1, import_int64,            .key = NM_OPENVPN_KEY_FRAGMENT_SIZE, .min = 0, .max = 0xffff),
+	_D (NMV_OVPN_TAG_HTTP_PROXY,             2, 4, import_proxy,            .key = "http"),
+	_D (NMV_OVPN_TAG_HTTP_PROXY_RETRY,       0, 0, import_flag,             .key = NM_OPENVPN_KEY_PROXY_RETRY),
+	_D (NMV_OVPN_TAG_IFCONFIG,               2, 2, import_ifconfig),
+	_D (NMV_OVPN_TAG_KEEPALIVE,              2, 2, import_keepalive),
+	_D (NMV_OVPN_TAG_KEY,                    1, 1, import_file,             .key = NM_OPENVPN_KEY_KEY),
+	_D (NMV_OVPN_TAG_KEYSIZE,                1, 1, import_int64,            .key = NM_OPENVPN_KEY_KEYSIZE, .min = 1, .max = 65535),
+	_D (NMV_OVPN_TAG_KEY_DIRECTION,          1, 1, import_key_direction),
+	_D (NMV_OVPN_TAG_MAX_ROUTES,             1, 1, import_int64,            .key = NM_OPENVPN_KEY_MAX_ROUTES, .min = 0, .max = 100000000),
+	_D (NMV_OVPN_TAG_MSSFIX,                 0, 1, import_mssfix),
+	_D (NMV_OVPN_TAG_MTU_DISC,               1, 1, import_mtu_disc),
+	_D (NMV_OVPN_TAG_NS_CERT_TYPE,           1, 1, import_ns_cert_type),
+	_D (NMV_OVPN_TAG_PING,                   1, 1, import_int64,            .key = NM_OPENVPN_KEY_PING, .min = 0, .max = G_MAXINT),
+	_D (NMV_OVPN_TAG_PING_EXIT,              1, 1, import_int64,            .key = NM_OPENVPN_KEY_PING_EXIT, .min = 0, .max = G_MAXINT),
+	_D (NMV_OVPN_TAG_PING_RESTART,           1, 1, import_int64,            .key = NM_OPENVPN_KEY_PING_RESTART, .min = 0, .max = G_MAXINT),
+	_D (NMV_OVPN_TAG_PKCS12,                 1, 1, import_file),
+	_D (NMV_OVPN_TAG_PORT,                   1, 1, import_int64,            .key = NM_OPENVPN_KEY_PORT, .min = 1, .max = 65535),
+	_D (NMV_OVPN_TAG_PROTO,                  1, 1, import_proto),
+	_D (NMV_OVPN_TAG_PUSH_PEER_INFO,         0, 0, import_flag,             .key = NM_OPENVPN_KEY_PUSH_PEER_INFO),
+	_D (NMV_OVPN_TAG_REMOTE,                 1, 3, import_remote),
+	_D (NMV_OVPN_TAG_REMOTE_CERT_TLS,        1, 1, import_remote_cert_tls),
+	_D (NMV_OVPN_TAG_REMOTE_RANDOM,          0, 0, import_flag,             .key = NM_OPENVPN_KEY_REMOTE_RANDOM),
+	_D (NMV_OVPN_TAG_REMOTE_RANDOM_HOSTNAME, 0, 0, import_flag,             .key = NM_OPENVPN_KEY_REMOTE_RANDOM_HOSTNAME),
+	_D (NMV_OVPN_TAG_RENEG_SEC,              1, 1, import_int64,            .key = NM_OPENVPN_KEY_RENEG_SECONDS, .min = 0, .max = G_MAXINT),
+	_D (NMV_OVPN_TAG_ROUTE,                  1, 4, import_route),
+	_D (NMV_OVPN_TAG_RPORT,                  1, 1, import_int64,            .key = NM_OPENVPN_KEY_PORT, .min = 1, .max = 65535),
+	_D (NMV_OVPN_TAG_SECRET,                 1, 2, import_file,             .key = NM_OPENVPN_KEY_STATIC_KEY),
+	_D (NMV_OVPN_TAG_SERVER_POLL_TIMEOUT,    1, 1, import_int64,            .key = NM_OPENVPN_KEY_CONNECT_TIMEOUT, .min = 0, .max = G_MAXINT),
+	_D (NMV_OVPN_TAG_SOCKS_PROXY,            1, 3, import_proxy,            .key = "socks"),
+	_D (NMV_OVPN_TAG_SOCKS_PROXY_RETRY,      0, 0, import_flag,             .key = NM_OPENVPN_KEY_PROXY_RETRY),
+	_D (NMV_OVPN_TAG_TLS_AUTH,               1, 2, import_file,             .key = NM_OPENVPN_KEY_TA),
+	_D (NMV_OVPN_TAG_TLS_CIPHER,             1, 1, import_utf8,             .key = NM_OPENVPN_KEY_TLS_CIPHER),
+	_D (NMV_OVPN_TAG_TLS_CLIENT,             0, 0, import_client),
+	_D (NMV_OVPN_TAG_TLS_CRYPT,              1, 1, import_file,             .key = NM_OPENVPN_KEY_TLS_CRYPT),
+	_D (NMV_OVPN_TAG_TLS_CRYPT_V2,           1, 1, import_file,             .key = NM_OPENVPN_KEY_TLS_CRYPT_V2),
+	_D (NMV_OVPN_TAG_TLS_REMOTE,             1, 1, import_utf8,             .key = NM_OPENVPN_KEY_TLS_REMOTE),
+	_D (NMV_OVPN_TAG_TLS_VERSION_MAX,        1, 1, import_utf8,             .key = NM_OPENVPN_KEY_TLS_VERSION_MAX),
+	_D (NMV_OVPN_TAG_TLS_VERSION_MIN,        1, 1, import_utf8,             .key = NM_OPENVPN_KEY_TLS_VERSION_MIN),
+	_D (NMV_OVPN_TAG_TUN_IPV6,               0, 0, import_flag,             .key = NM_OPENVPN_KEY_TUN_IPV6),
+	_D (NMV_OVPN_TAG_TUN_MTU,                1, 1, import_int64,            .key = NM_OPENVPN_KEY_TUNNEL_MTU, .min = 0, .max = 0xffff),
+	_D (NMV_OVPN_TAG_VERIFY_X509_NAME,       1, 2, import_verify_x509_name),
+#undef _D
+};
+
+/* import_directives[] is indexed by a perfect hash of the directive name.
+ * The multiplier is searched for once, on first use, so that no two
+ * directives share a bucket. A lookup is then one hash, one bucket and
+ * one strcmp(), regardless of how many directives we support. */
+
+#define IMPORT_DIRECTIVE_BUCKETS 1024
+
+G_STATIC_ASSERT (G_N_ELEMENTS (import_directives) < G_MAXUINT8);
+
+static struct {
+	guint32 mult;
+	guint8 buckets[IMPORT_DIRECTIVE_BUCKETS];
+} import_directive_index;
+
+static inline guint
+import_directive_hash (const char *name, guint32 mult)
+{
+	guint32 h = 2166136261u;
 
-				if (params[3]) {
-					if (!NM_IN_STRSET (params[3], NMOVPN_PROTCOL_TYPES)) {
-						line_error = g_strdup_printf (_("remote expects protocol type like “udp” or “tcp”"));
-						goto handle_line_error;
-					}
-				}
-			}
+	for (; *name; name++)
+		h = (h ^ ((guchar) *name)) * mult;
+	h ^= h >> 16;
+	return h % IMPORT_DIRECTIVE_BUCKETS;
+}
 
-			new_remote = g_string_sized_new (64);
+static void
+import_directive_index_init (void)
+{
+	static gsize initialized = 0;
+	guint32 mult;
+	guint i, h;
 
-			prev = nm_setting_vpn_get_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE);
-			if (prev) {
-				g_string_assign (new_remote, prev);
-				g_string_append (new_remote, ", ");
-			}
+	if (!g_once_init_enter (&initialized))
+		return;
 
-			host_has_colon = (strchr (params[1], ':') != NULL);
-			if (   host_has_colon
-			    && inet_pton (AF_INET6, params[1], &a) == 1) {
-				/* need to escape the host. */
-				g_string_append_printf (new_remote, "[%s]", params[1]);
-			} else
-				g_string_append (new_remote, params[1]);
-
-			if (params[2]) {
-				g_string_append_printf (new_remote, ":%d", port);
-				if (params[3]) {
-					g_string_append_c (new_remote, ':');
-					g_string_append (new_remote, params[3]);
-				} else if (host_has_colon)
-					g_string_append_c (new_remote, ':');
-			} else if (host_has_colon)
-				g_string_append (new_remote, "::");
-
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE, new_remote->str);
-			g_string_free (new_remote, TRUE);
-
-			have_remote = TRUE;
-			continue;
+	for (mult = 16777619u; TRUE; mult += 2) {
+		memset (import_directive_index.buckets, 0, sizeof (import_directive_index.buckets));
+		for (i = 0; i < G_N_ELEMENTS (import_directives); i++) {
+			h = import_directive_hash (import_directives[i].name, mult);
+			if (import_directive_index.buckets[h])
+				break;
+			import_directive_index.buckets[h] = i + 1;
 		}
+		if (i == G_N_ELEMENTS (import_directives))
+			break;
+	}
+	import_directive_index.mult = mult;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_REMOTE_RANDOM)) {
-			if (!args_params_check_nargs_n (params, 0, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE_RANDOM, "yes");
-			continue;
-		}
+	g_once_init_leave (&initialized, 1);
+}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_REMOTE_RANDOM_HOSTNAME)) {
-			if (!args_params_check_nargs_n (params, 0, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE_RANDOM_HOSTNAME, "yes");
-			continue;
-		}
+static const ImportDirective *
+import_directive_find (const char *name)
+{
+	const ImportDirective *directive;
+	guint8 idx;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_ALLOW_PULL_FQDN)) {
-			if (!args_params_check_nargs_n (params, 0, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_ALLOW_PULL_FQDN, "yes");
-			continue;
-		}
+	idx = import_directive_index.buckets[import_directive_hash (name, import_directive_index.mult)];
+	if (!idx)
+		return NULL;
+	directive = &import_directives[idx - 1];
+	if (!nm_streq (directive->name, name))
+		return NULL;
+	return directive;
+}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_TUN_IPV6)) {
-			if (!args_params_check_nargs_n (params, 0, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_TUN_IPV6, "yes");
-			continue;
-		}
+const char *
+_nmovpn_test_import_directive_find (const char *name)
+{
+	const ImportDirective *directive;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_PUSH_PEER_INFO)) {
-			if (!args_params_check_nargs_n (params, 0, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_PUSH_PEER_INFO, "yes");
-			continue;
-		}
+	import_directive_index_init ();
+	directive = import_directive_find (name);
+	return directive ? directive->name : NULL;
+}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_PORT, NMV_OVPN_TAG_RPORT)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_port (params, 1, &v_int64, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_PORT, v_int64);
-			continue;
-		}
+static gboolean
+import_inline_blob (ImportData *data, const char **params, char **out_error)
+{
+	gs_free char *token = g_strndup (&params[0][1], strlen (params[0]) - 2);
+	gs_free char *end_token = NULL;
+	gsize end_token_len;
+	gsize my_contents_cur_line = data->contents_cur_line;
+	gboolean is_base64 = FALSE;
+	char *f_path;
+	const char *key;
+	const char *cur_line, *cur_line_delimiter;
+	gsize cur_line_len;
+	GArray *slices;
+	guint8 *decoded = NULL;
+	InlineBlobData *inline_blob_data;
+	GSList *sl_iter;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_PING, NMV_OVPN_TAG_PING_EXIT, NMV_OVPN_TAG_PING_RESTART)) {
-			const char *key = NULL;
+	if (nm_streq (token, INLINE_BLOB_CA)) {
+		key = NM_OPENVPN_KEY_CA;
+		data->have_ca = TRUE;
+	} else if (nm_streq (token, INLINE_BLOB_CERT)) {
+		key = NM_OPENVPN_KEY_CERT;
+		data->have_cert = TRUE;
+	} else if (nm_streq (token, INLINE_BLOB_KEY)) {
+		key = NM_OPENVPN_KEY_KEY;
+		data->have_key = TRUE;
+	} else if (nm_streq (token, INLINE_BLOB_PKCS12)) {
+		is_base64 = TRUE;
+		key = NULL;
+		data->have_pkcs12 = TRUE;
+	} else if (nm_streq (token, INLINE_BLOB_EXTRA_CERTS))
+		key = NM_OPENVPN_KEY_EXTRA_CERTS;
+	else if (nm_streq (token, INLINE_BLOB_CRL_VERIFY))
+		key = NM_OPENVPN_KEY_CRL_VERIFY_FILE;
+	else if (nm_streq (token, INLINE_BLOB_TLS_CRYPT))
+		key = NM_OPENVPN_KEY_TLS_CRYPT;
+	else if (nm_streq (token, INLINE_BLOB_TLS_CRYPT_V2))
+		key = NM_OPENVPN_KEY_TLS_CRYPT_V2;
+	else if (nm_streq (token, INLINE_BLOB_TLS_AUTH)) {
+		key = NM_OPENVPN_KEY_TA;
+		data->allow_ta_direction = TRUE;
+	} else if (nm_streq (token, INLINE_BLOB_SECRET)) {
+		key = NM_OPENVPN_KEY_STATIC_KEY;
+		data->allow_secret_direction = TRUE;
+	} else {
+		*out_error = g_strdup_printf (_("unsupported blob/xml element"));
+		return FALSE;
+	}
 
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_int64 (params, 1, 0, G_MAXINT, &v_int64, &line_error))
-				goto handle_line_error;
+	end_token = g_strdup_printf ("</%s>", token);
+	end_token_len = strlen (end_token);
 
-			if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_PING))
-				key = NM_OPENVPN_KEY_PING;
-			else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_PING_EXIT))
-				key = NM_OPENVPN_KEY_PING_EXIT;
-			else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_PING_RESTART))
-				key = NM_OPENVPN_KEY_PING_RESTART;
+	slices = g_array_new (FALSE, FALSE, sizeof (InlineBlobSlice));
 
-			setting_vpn_add_data_item_int64 (s_vpn, key, v_int64);
-			continue;
-		}
+	while (args_next_line (&data->contents,
+	                       &data->contents_len,
+	                       &cur_line,
+	                       &cur_line_len,
+	                       &cur_line_delimiter)) {
+		InlineBlobSlice *slice;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_TLS_VERSION_MIN)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_utf8 (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_TLS_VERSION_MIN, params[1]);
-			continue;
-		}
+		my_contents_cur_line++;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_TLS_VERSION_MAX)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_utf8 (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_TLS_VERSION_MAX, params[1]);
-			continue;
+		/* skip over trailing space like openvpn does. */
+		_ch_skip_over_leading_whitespace (&cur_line, &cur_line_len);
+
+		if (   cur_line_len >= end_token_len
+		    && !memcmp (cur_line, end_token, end_token_len)) {
+			end_token_len = 0;
+			break;
 		}
 
-		if (NM_IN_STRSET (params[0],
-		                  NMV_OVPN_TAG_CA,
-		                  NMV_OVPN_TAG_CERT,
-		                  NMV_OVPN_TAG_EXTRA_CERTS,
-		                  NMV_OVPN_TAG_KEY,
-		                  NMV_OVPN_TAG_PKCS12,
-		                  NMV_OVPN_TAG_SECRET,
-		                  NMV_OVPN_TAG_TLS_AUTH,
-		                  NMV_OVPN_TAG_TLS_CRYPT,
-		                  NMV_OVPN_TAG_TLS_CRYPT_V2)) {
-			const char *file;
-			gs_free char *file_free = NULL;
-			gboolean can_have_direction;
-			const char *s_direction = NULL;
-
-			can_have_direction = NM_IN_STRSET (params[0],
-			                                   NMV_OVPN_TAG_SECRET,
-			                                   NMV_OVPN_TAG_TLS_AUTH);
-
-			if (!args_params_check_nargs_minmax (params, 1, can_have_direction ? 2 : 1, &line_error))
-				goto handle_line_error;
+		/* the line is followed by its delimiter in the content, so that
+		 * the slice can include it. */
+		if (cur_line_delimiter)
+			cur_line_len++;
 
-			if (!args_params_check_arg_nonempty (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			file = params[1];
+		slice = slices->len > 0 ? &g_array_index (slices, InlineBlobSlice, slices->len - 1) : NULL;
+		if (slice && &slice->str[slice->len] == cur_line)
+			slice->len += cur_line_len;
+		else if (cur_line_len > 0) {
+			g_array_set_size (slices, slices->len + 1);
+			slice = &g_array_index (slices, InlineBlobSlice, slices->len - 1);
+			slice->str = cur_line;
+			slice->len = cur_line_len;
+		}
+	}
+	if (end_token_len) {
+		*out_error = g_strdup_printf (_("unterminated blob element <%s>"), token);
+		g_array_unref (slices);
+		return FALSE;
+	}
 
-			if (params[2]) {
-				if (!args_params_parse_key_direction (params, 2, &s_direction, &line_error))
-					goto handle_line_error;
-			}
+	if (is_base64) {
+		InlineBlobSlice decoded_slice;
+		int state = 0;
+		guint save = 0;
+		gsize l = 0;
+		guint i;
 
-			if (!g_path_is_absolute (file))
-				file = file_free = g_build_filename (default_path, file, NULL);
+		for (i = 0; i < slices->len; i++)
+			l += g_array_index (slices, InlineBlobSlice, i).len;
+		decoded = g_malloc ((l / 4) * 3 + 3);
 
-			if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_PKCS12)) {
-				 /* OpenVPN allows --pkcs12 with external (PEM) --ca. Don't overwrite it with the PKCS#12 file. */
-				if (!have_ca) {
-					setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_CA, file);
-					have_ca = TRUE;
-				}
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_CERT, file);
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_KEY, file);
-				have_pkcs12 = TRUE;
-			} else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_CA)) {
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_CA, file);
-				have_ca = TRUE;
-			} else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_CERT)) {
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_CERT, file);
-				have_cert = TRUE;
-			} else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_KEY)) {
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_KEY, file);
-				have_key = TRUE;
-			} else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_SECRET)) {
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_STATIC_KEY, file);
-				if (s_direction)
-					secret_direction = s_direction;
-				allow_secret_direction = TRUE;
-				have_sk = TRUE;
-			} else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_TLS_AUTH)) {
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_TA, file);
-				if (s_direction)
-					ta_direction = s_direction;
-				allow_ta_direction = TRUE;
-			} else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_TLS_CRYPT))
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_TLS_CRYPT, file);
-			else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_TLS_CRYPT_V2))
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_TLS_CRYPT_V2, file);
-			else if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_EXTRA_CERTS))
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_EXTRA_CERTS, file);
-			else
-				g_assert_not_reached ();
-			continue;
-		}
+		l = 0;
+		for (i = 0; i < slices->len; i++) {
+			const InlineBlobSlice *slice = &g_array_index (slices, InlineBlobSlice, i);
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_CIPHER)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_utf8 (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_CIPHER, params[1]);
-			continue;
+			l += g_base64_decode_step (slice->str, slice->len, &decoded[l], &state, &save);
 		}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_TLS_CIPHER)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_utf8 (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_TLS_CIPHER, params[1]);
-			continue;
-		}
+		decoded_slice.str = (const char *) decoded;
+		decoded_slice.len = l;
+		g_array_set_size (slices, 0);
+		g_array_append_val (slices, decoded_slice);
+	}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_KEEPALIVE)) {
-			gint64 v2;
+	/* the latest cert wins... */
+	for (sl_iter = data->inline_blobs; sl_iter; sl_iter = sl_iter->next) {
+		InlineBlobData *d = sl_iter->data;
 
-			if (!args_params_check_nargs_n (params, 2, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_int64 (params, 1, 0, G_MAXINT, &v_int64, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_int64 (params, 2, 0, G_MAXINT, &v2, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_PING, v_int64);
-			setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_PING_RESTART, v2);
-			continue;
+		if (nm_streq (d->token, token)) {
+			data->inline_blobs = g_slist_delete_link (data->inline_blobs, sl_iter);
+			inline_blob_data_free (d);
+			break;
 		}
+	}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_KEYSIZE)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_parse_int64 (params, 1, 1, 65535, &v_int64, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item_int64 (s_vpn, NM_OPENVPN_KEY_KEYSIZE, v_int64);
-			continue;
-		}
+	f_path = inline_blob_construct_path (data->basename, token);
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_TLS_REMOTE)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_utf8 (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_TLS_REMOTE, params[1]);
-			continue;
-		}
+	inline_blob_data = g_slice_new (InlineBlobData);
+	inline_blob_data->slices = slices;
+	inline_blob_data->decoded = decoded;
+	inline_blob_data->token_start_line = data->contents_cur_line;
+	inline_blob_data->path = f_path;
+	inline_blob_data->token = token;
+	inline_blob_data->key = key;
+	token = NULL;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_VERIFY_X509_NAME)) {
-			const char *type = NM_OPENVPN_VERIFY_X509_NAME_TYPE_SUBJECT;
-			gs_free char *item = NULL;
+	data->inline_blobs = g_slist_prepend (data->inline_blobs, inline_blob_data);
+	data->contents_cur_line = my_contents_cur_line;
 
-			if (!args_params_check_nargs_minmax (params, 1, 2, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_utf8 (params, 1, NULL, &line_error))
-				goto handle_line_error;
+	if (key)
+		setting_vpn_add_data_item_path (data->s_vpn, key, f_path);
+	else {
+		nm_assert (nm_streq (inline_blob_data->token, INLINE_BLOB_PKCS12));
+		setting_vpn_add_data_item_path (data->s_vpn, NM_OPENVPN_KEY_CA, f_path);
+		setting_vpn_add_data_item_path (data->s_vpn, NM_OPENVPN_KEY_CERT, f_path);
+		setting_vpn_add_data_item_path (data->s_vpn, NM_OPENVPN_KEY_KEY, f_path);
+	}
+	return TRUE;
+}
 
-			if (params[2]) {
-				if (!NM_IN_STRSET (params[2],
-				                   NM_OPENVPN_VERIFY_X509_NAME_TYPE_SUBJECT,
-				                   NM_OPENVPN_VERIFY_X509_NAME_TYPE_NAME,
-				                   NM_OPENVPN_VERIFY_X509_NAME_TYPE_NAME_PREFIX)) {
-					line_error = g_strdup_printf (_("invalid verify-x509-name type"));
-					goto handle_line_error;
-				}
+/* do_import_sniff() only looks at this much of the file. */
+#define IMPORT_SNIFF_PREFIX_SIZE (16 * 1024)
 
-				type = params[2];
-			}
+/* if the prefix of a longer file has at least this many lines, and none
+ * of them is a directive that we know, the file is rejected. */
+#define IMPORT_SNIFF_MIN_LINES 4
 
-			item = g_strdup_printf ("%s:%s", type, params[1]);
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_VERIFY_X509_NAME, item);
-			continue;
-		}
+/**
+ * do_import_sniff:
+ * @contents: the content of the file
+ * @contents_len: the length of @contents
+ *
+ * Guesses whether @contents is an OpenVPN configuration, by tokenizing
+ * at most the first %IMPORT_SNIFF_PREFIX_SIZE bytes. The content of
+ * inline blobs is skipped. Unlike do_import(), this has no side effects.
+ *
+ * The file is rejected if none of the lines it looks at is a directive that
+ * we know. That is the case for certificates, keys or configuration files
+ * of other VPN types, and do_import() would reject those too. It is
+ * accepted if it contains --client, --tls-client or --secret and the
+ * known directives (with --remote, --dev and <ca> counting double)
+ * outweigh the unknown ones.
+ *
+ * Returns: whether do_import() is worth a try. On %IMPORT_SNIFF_UNSURE,
+ *   it still is.
+ */
+ImportSniffResult
+do_import_sniff (const char *contents, gsize contents_len)
+{
+	const char *cur_line, *cur_line_delimiter;
+	gsize cur_line_len;
+	ArgsArena arena;
+	gboolean truncated = FALSE;
+	gboolean in_blob = FALSE;
+	gboolean have_client = FALSE;
+	guint n_known = 0;
+	guint n_unknown = 0;
+	int score = 0;
+
+	import_directive_index_init ();
+
+	if (   contents_len >= 3
+	    && memcmp (contents, "\xEF\xBB\xBF", 3) == 0) {
+		contents += 3;
+		contents_len -= 3;
+	}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_REMOTE_CERT_TLS)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!NM_IN_STRSET (params[1], NM_OPENVPN_REM_CERT_TLS_CLIENT, NM_OPENVPN_REM_CERT_TLS_SERVER)) {
-				line_error = g_strdup_printf (_("invalid option"));
-				goto handle_line_error;
-			}
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE_CERT_TLS, params[1]);
-			continue;
+	if (contents_len > IMPORT_SNIFF_PREFIX_SIZE) {
+		contents_len = IMPORT_SNIFF_PREFIX_SIZE;
+		truncated = TRUE;
+	}
+
+	args_arena_init (&arena);
+
+	while (args_next_line (&contents,
+	                       &contents_len,
+	                       &cur_line,
+	                       &cur_line_len,
+	                       &cur_line_delimiter)) {
+		const char **params = NULL;
+		const ImportDirective *directive;
+		gs_free char *line_error = NULL;
+		const char *name;
+		gsize name_len;
+
+		if (truncated && !cur_line_delimiter) {
+			/* the last line was cut off. */
+			break;
 		}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_IFCONFIG)) {
-			if (!args_params_check_nargs_n (params, 2, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_utf8 (params, 1, "local", &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_utf8 (params, 2, "remote", &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_LOCAL_IP, params[1]);
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE_IP, params[2]);
+		if (in_blob) {
+			/* like import_inline_blob(), allow space before the end tag. */
+			_ch_skip_over_leading_whitespace (&cur_line, &cur_line_len);
+			if (cur_line_len >= 2 && cur_line[0] == '<' && cur_line[1] == '/')
+				in_blob = FALSE;
 			continue;
 		}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_AUTH_USER_PASS)) {
-			if (!args_params_check_nargs_minmax (params, 0, 1, &line_error))
-				goto handle_line_error;
-			have_pass = TRUE;
+		if (!args_parse_line (&arena, cur_line, cur_line_len, &params, &line_error)) {
+			n_unknown++;
+			score--;
 			continue;
 		}
+		if (!params)
+			continue;
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_AUTH)) {
-			if (!args_params_check_nargs_n (params, 1, &line_error))
-				goto handle_line_error;
-			if (!args_params_check_arg_utf8 (params, 1, NULL, &line_error))
-				goto handle_line_error;
-			setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_AUTH, params[1]);
+		name = params[0];
+		if (g_str_has_prefix (name, "--"))
+			name = &name[2];
+		name_len = strlen (name);
+
+		if (   name_len > 2
+		    && name[0] == '<'
+		    && name[name_len - 1] == '>') {
+			gs_free char *token = g_strndup (&name[1], name_len - 2);
+
+			in_blob = TRUE;
+			directive = import_directive_find (token);
+			if (directive && nm_streq (directive->name, INLINE_BLOB_CA))
+				score++;
+		} else
+			directive = import_directive_find (name);
+
+		if (!directive) {
+			n_unknown++;
+			score--;
 			continue;
 		}
 
-		if (NM_IN_STRSET (params[0], NMV_OVPN_TAG_ROUTE)) {
-			in_addr_t network;
-			in_addr_t gateway = 0;
-			guint32 prefix = 32;
-			gint64 metric = -1;
-
-			if (!args_params_check_nargs_minmax (params, 1, 4, &line_error))
-				goto handle_line_error;
-
-			if (!args_params_parse_ip4 (params, 1, TRUE, &network, &line_error))
-				goto handle_line_error;
-
-			if (params[2]) {
-				in_addr_t netmask;
-
-				if (!args_params_parse_ip4 (params, 2, FALSE, &netmask, &line_error))
-					goto handle_line_error;
-				prefix = nm_utils_ip4_netmask_to_prefix (netmask);
+		n_known++;
+		score++;
+		if (NM_IN_STRSET (directive->name, NMV_OVPN_TAG_REMOTE,
+		                                   NMV_OVPN_TAG_DEV))
+			score++;
+		else if (   !in_blob
+		         && NM_IN_STRSET (directive->name, NMV_OVPN_TAG_CLIENT,
+		                                           NMV_OVPN_TAG_TLS_CLIENT,
+		                                           NMV_OVPN_TAG_SECRET))
+			have_client = TRUE;
+	}
 
-				if (params[3]) {
-					if (!args_params_parse_ip4 (params, 3, TRUE, &gateway, &line_error))
-						goto handle_line_error;
-					if (params[4]) {
-						if (!args_params_parse_int64 (params, 4, 0, G_MAXUINT32, &v_int64, &line_error))
-							goto handle_line_error;
-						metric = (guint32) v_int64;
-					}
-				}
-			}
+	args_arena_clear (&arena);
 
-			if (prefix == 0 && network == 0) {
-				/* the default-route cannot be specified as normal route in NMSettingIPConfig.
-				 * Just set never-default=FALSE (which is already the default). */
-				g_object_set (s_ip4,
-				              NM_SETTING_IP_CONFIG_NEVER_DEFAULT,
-				              FALSE,
-				              NULL);
-				continue;
-			}
+	if (n_known == 0) {
+		if (!truncated || n_unknown >= IMPORT_SNIFF_MIN_LINES)
+			return IMPORT_SNIFF_REJECT;
+		return IMPORT_SNIFF_UNSURE;
+	}
+	if (have_client && score > 0)
+		return IMPORT_SNIFF_ACCEPT;
+	return IMPORT_SNIFF_UNSURE;
+}
 
-			{
-#if ((NETWORKMANAGER_COMPILATION) & NM_NETWORKMANAGER_COMPILATION_WITH_LIBNM_UTIL)
-				NMIP4Route *route;
-
-				route = nm_ip4_route_new ();
-				nm_ip4_route_set_dest (route, network);
-				nm_ip4_route_set_prefix (route, prefix);
-				nm_ip4_route_set_next_hop (route, gateway);
-				if (metric >= 0)
-					nm_ip4_route_set_metric (route, metric);
-				nm_setting_ip4_config_add_route (s_ip4, route);
-				nm_ip4_route_unref (route);
-#else
-				NMIPRoute *route;
+NMConnection *
+do_import (const char *path, const char *contents, gsize contents_len, GError **error)
+{
+	gs_unref_object NMConnection *connection = NULL;
+	NMSettingConnection *s_con;
+	NMSettingIPConfig *s_ip4;
+	NMSettingVpn *s_vpn;
+	const char *cur_line, *cur_line_delimiter;
+	gsize cur_line_len;
+	ImportData data = { 0 };
+	gs_unref_ptrarray GPtrArray *remotes = NULL;
+	ArgsArena arena;
+	const char *ctype = NULL;
+	gs_free char *basename = NULL;
+	gs_free char *default_path = NULL;
+	char *tmp, *tmp2;
+	const char *cert_path = NULL, *key_path = NULL, *ca_path = NULL;
+	GSList *sl_iter;
 
-				route = nm_ip_route_new_binary (AF_INET, &network, prefix, params[3] ? &gateway : NULL, metric, NULL);
-				nm_setting_ip_config_add_route (s_ip4, route);
-				nm_ip_route_unref (route);
-#endif
-			}
-		}
+	g_return_val_if_fail (!error || !*error, NULL);
 
-		if (params[0][0] == '<' && params[0][strlen (params[0]) - 1] == '>') {
-			gs_free char *token = g_strndup (&params[0][1], strlen (params[0]) - 2);
-			gs_free char *end_token = NULL;
-			gsize end_token_len;
-			gsize my_contents_cur_line = contents_cur_line;
-			gboolean is_base64 = FALSE;
-			char *f_path;
-			const char *key;
-			GString *blob_data;
-			InlineBlobData *inline_blob_data;
-
-			if (nm_streq (token, INLINE_BLOB_CA)) {
-				key = NM_OPENVPN_KEY_CA;
-				have_ca = TRUE;
-			} else if (nm_streq (token, INLINE_BLOB_CERT)) {
-				key = NM_OPENVPN_KEY_CERT;
-				have_cert = TRUE;
-			} else if (nm_streq (token, INLINE_BLOB_KEY)) {
-				key = NM_OPENVPN_KEY_KEY;
-				have_key = TRUE;
-			} else if (nm_streq (token, INLINE_BLOB_PKCS12)) {
-				is_base64 = TRUE;
-				key = NULL;
-				have_pkcs12 = TRUE;
-			} else if (nm_streq (token, INLINE_BLOB_EXTRA_CERTS))
-				key = NM_OPENVPN_KEY_EXTRA_CERTS;
-			else if (nm_streq (token, INLINE_BLOB_CRL_VERIFY))
-				key = NM_OPENVPN_KEY_CRL_VERIFY_FILE;
-			else if (nm_streq (token, INLINE_BLOB_TLS_CRYPT))
-				key = NM_OPENVPN_KEY_TLS_CRYPT;
-			else if (nm_streq (token, INLINE_BLOB_TLS_CRYPT_V2))
-				key = NM_OPENVPN_KEY_TLS_CRYPT_V2;
-			else if (nm_streq (token, INLINE_BLOB_TLS_AUTH)) {
-				key = NM_OPENVPN_KEY_TA;
-				allow_ta_direction = TRUE;
-			} else if (nm_streq (token, INLINE_BLOB_SECRET)) {
-				key = NM_OPENVPN_KEY_STATIC_KEY;
-				allow_secret_direction = TRUE;
-			} else {
-				line_error = g_strdup_printf (_("unsupported blob/xml element"));
-				goto handle_line_error;
-			}
+	import_directive_index_init ();
 
-			end_token = g_strdup_printf ("</%s>", token);
-			end_token_len = strlen (end_token);
+	connection = nm_simple_connection_new ();
 
-			blob_data = g_string_new (NULL);
+	s_con = NM_SETTING_CONNECTION (nm_setting_connection_new ());
+	nm_connection_add_setting (connection, NM_SETTING (s_con));
+	s_ip4 = NM_SETTING_IP_CONFIG (nm_setting_ip4_config_new ());
+	nm_connection_add_setting (connection, NM_SETTING (s_ip4));
+	g_object_set (s_ip4, NM_SETTING_IP_CONFIG_METHOD, NM_SETTING_IP4_CONFIG_METHOD_AUTO, NULL);
+	s_vpn = NM_SETTING_VPN (nm_setting_vpn_new ());
+	g_object_set (s_vpn, NM_SETTING_VPN_SERVICE_TYPE, NM_VPN_SERVICE_TYPE_OPENVPN, NULL);
+	nm_connection_add_setting (connection, NM_SETTING (s_vpn));
 
-			while (args_next_line (&contents,
-			                       &contents_len,
-			                       &cur_line,
-			                       &cur_line_len,
-			                       &cur_line_delimiter)) {
-				my_contents_cur_line++;
+	/* Get the default path for ca, cert, key file, these files maybe
+	 * in same path with the configuration file */
+	if (g_path_is_absolute (path))
+		default_path = g_path_get_dirname (path);
+	else {
+		tmp = g_get_current_dir ();
+		tmp2 = g_path_get_dirname (path);
+		default_path = g_build_filename (tmp, tmp2, NULL);
+		g_free (tmp);
+		g_free (tmp2);
+	}
 
-				/* skip over trailing space like openvpn does. */
-				_ch_skip_over_leading_whitespace (&cur_line, &cur_line_len);
+	basename = g_path_get_basename (path);
+	tmp = strrchr (basename, '.');
+	if (tmp)
+		*tmp = '\0';
+	g_object_set (s_con, NM_SETTING_CONNECTION_ID, basename, NULL);
 
-				if (!strncmp (cur_line, end_token, end_token_len)) {
-					end_token_len = 0;
-					break;
-				}
+	/* the content is not necessarily NUL terminated. */
+	if (   contents_len >= 3
+	    && memcmp (contents, "\xEF\xBB\xBF", 3) == 0) {
+		/* skip over UTF-8 BOM */
+		contents += 3;
+		contents_len -= 3;
+	}
 
-				g_string_append_len (blob_data, cur_line, cur_line_len);
-				if (cur_line_delimiter)
-					g_string_append_c (blob_data, cur_line_delimiter[0]);
-			}
-			if (end_token_len) {
-				line_error = g_strdup_printf (_("unterminated blob element <%s>"), token);
-				g_string_free (blob_data, TRUE);
-				goto handle_line_error;
-			}
+	data.default_path = default_path;
+	data.basename = basename;
+	data.s_ip4 = s_ip4;
+	data.s_vpn = s_vpn;
+	data.contents = contents;
+	data.contents_len = contents_len;
+	data.remotes = remotes = g_ptr_array_new_with_free_func (g_free);
 
-			if (is_base64) {
-				gs_free guint8 *d = NULL;
-				gsize l;
+	args_arena_init (&arena);
 
-				d = g_base64_decode (blob_data->str, &l);
-				g_string_truncate (blob_data, 0);
-				g_string_append_len (blob_data, (const char *) d, l);
-			}
+	while (args_next_line (&data.contents,
+	                       &data.contents_len,
+	                       &cur_line,
+	                       &cur_line_len,
+	                       &cur_line_delimiter)) {
+		const char **params = NULL;
+		const ImportDirective *directive;
+		char *line_error = NULL;
 
-			/* the latest cert wins... */
-			for (sl_iter = inline_blobs; sl_iter; sl_iter = sl_iter->next) {
-				InlineBlobData *d = sl_iter->data;
+		data.contents_cur_line++;
 
-				if (nm_streq (d->token, token)) {
-					inline_blobs = g_slist_delete_link (inline_blobs, sl_iter);
-					inline_blob_data_free (d);
-					break;
-				}
-			}
+		if (!args_parse_line (&arena, cur_line, cur_line_len, &params, &line_error))
+			goto handle_line_error;
+
+		if (!params) {
+			/* empty line of comments. */
+			continue;
+		}
 
-			f_path = inline_blob_construct_path (basename, token);
+		g_assert (params[0]);
 
-			inline_blob_data = g_slice_new (InlineBlobData);
-			inline_blob_data->blob_data = blob_data;
-			inline_blob_data->token_start_line = contents_cur_line;
-			inline_blob_data->path = f_path;
-			inline_blob_data->token = token;
-			inline_blob_data->key = key;
-			token = NULL;
+		/* allow for a leading double-dash and skip over it (bypass_doubledash). */
+		if (g_str_has_prefix (params[0], "--"))
+			params[0] = &params[0][2];
 
-			inline_blobs = g_slist_prepend (inline_blobs, inline_blob_data);
-			contents_cur_line = my_contents_cur_line;
+		directive = import_directive_find (params[0]);
+		if (directive) {
+			if (!args_params_check_nargs_minmax (params, directive->nargs_min, directive->nargs_max, &line_error))
+				goto handle_line_error;
+			if (!directive->func (&data, directive, params, &line_error))
+				goto handle_line_error;
+			continue;
+		}
 
-			if (key)
-				setting_vpn_add_data_item_path (s_vpn, key, f_path);
-			else {
-				nm_assert (nm_streq (token, INLINE_BLOB_PKCS12));
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_CA, f_path);
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_CERT, f_path);
-				setting_vpn_add_data_item_path (s_vpn, NM_OPENVPN_KEY_KEY, f_path);
-			}
+		if (params[0][0] == '<' && params[0][strlen (params[0]) - 1] == '>') {
+			if (!import_inline_blob (&data, params, &line_error))
+				goto handle_line_error;
 			continue;
 		}
 
@@ -1638,17 +2370,28 @@ handle_line_error:
 		             NMV_EDITOR_PLUGIN_ERROR_FILE_INVALID,
 		             _("configuration error: %s (line %ld)"),
 		             line_error ? : _("unknown or unsupported option"),
-		             (long) contents_cur_line);
+		             (long) data.contents_cur_line);
 		g_free (line_error);
+		args_arena_clear (&arena);
 		goto out_error;
 	}
 
-	if (allow_secret_direction && secret_direction)
-		setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_STATIC_KEY_DIRECTION, secret_direction);
-	if (allow_ta_direction && ta_direction)
-		setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_TA_DIR, ta_direction);
+	args_arena_clear (&arena);
+
+	if (remotes->len > 0) {
+		gs_free char *remote = NULL;
+
+		g_ptr_array_add (remotes, NULL);
+		remote = g_strjoinv (", ", (char **) remotes->pdata);
+		setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE, remote);
+	}
+
+	if (data.allow_secret_direction && data.secret_direction)
+		setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_STATIC_KEY_DIRECTION, data.secret_direction);
+	if (data.allow_ta_direction && data.ta_direction)
+		setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_TA_DIR, data.ta_direction);
 
-	if (!have_client && !have_sk) {
+	if (!data.have_client && !data.have_sk) {
 		g_set_error_literal (error,
 		                     NMV_EDITOR_PLUGIN_ERROR,
 		                     NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
@@ -1656,7 +2399,7 @@ handle_line_error:
 		goto out_error;
 	}
 
-	if (!have_remote) {
+	if (!data.have_remote) {
 		g_set_error_literal (error,
 		                     NMV_EDITOR_PLUGIN_ERROR,
 		                     NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
@@ -1666,8 +2409,8 @@ handle_line_error:
 
 	/* Validate PKCS#12/PEM/CA settings. PKCS#12 and PEM cannot be mixed,
 	 * with the exception of PKCS#12 cert + PEM CA. */
-	if (have_client && have_pkcs12) {
-		if (have_cert || have_key) {
+	if (data.have_client && data.have_pkcs12) {
+		if (data.have_cert || data.have_key) {
 			g_set_error_literal (error,
 			                     NMV_EDITOR_PLUGIN_ERROR,
 			                     NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
@@ -1675,7 +2418,7 @@ handle_line_error:
 			goto out_error;
 		}
 
-		if (have_ca) {
+		if (data.have_ca) {
 			ca_path = nm_setting_vpn_get_data_item (s_vpn, NM_OPENVPN_KEY_CA);
 			if (is_pkcs12 (ca_path)) {
 				g_set_error_literal (error,
@@ -1685,8 +2428,8 @@ handle_line_error:
 				goto out_error;
 			}
 		}
-	} else if (have_client && !have_pkcs12) {
-		if (!have_ca) {
+	} else if (data.have_client && !data.have_pkcs12) {
+		if (!data.have_ca) {
 			g_set_error_literal (error,
 			                     NMV_EDITOR_PLUGIN_ERROR,
 			                     NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
@@ -1696,7 +2439,7 @@ handle_line_error:
 
 		ca_path = nm_setting_vpn_get_data_item (s_vpn, NM_OPENVPN_KEY_CA);
 
-		if ((have_cert || have_key) && !(have_cert && have_key)) {
+		if ((data.have_cert || data.have_key) && !(data.have_cert && data.have_key)) {
 			g_set_error_literal (error,
 			                     NMV_EDITOR_PLUGIN_ERROR,
 			                     NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
@@ -1725,14 +2468,14 @@ handle_line_error:
 	}
 
 	/* Determine connection type */
-	if (have_pass) {
-		if (have_cert || have_pkcs12)
+	if (data.have_pass) {
+		if (data.have_cert || data.have_pkcs12)
 			ctype = NM_OPENVPN_CONTYPE_PASSWORD_TLS;
-		else if (have_ca)
+		else if (data.have_ca)
 			ctype = NM_OPENVPN_CONTYPE_PASSWORD;
-	} else if (have_cert || have_pkcs12) {
+	} else if (data.have_cert || data.have_pkcs12) {
 		ctype = NM_OPENVPN_CONTYPE_TLS;
-	} else if (have_sk)
+	} else if (data.have_sk)
 		ctype = NM_OPENVPN_CONTYPE_STATIC_KEY;
 
 	if (!ctype)
@@ -1741,13 +2484,13 @@ handle_line_error:
 	setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_CONNECTION_TYPE, ctype);
 
 	/* Default secret flags to be agent-owned */
-	if (have_pass) {
+	if (data.have_pass) {
 		nm_setting_set_secret_flags (NM_SETTING (s_vpn),
 		                             NM_OPENVPN_KEY_PASSWORD,
 		                             NM_SETTING_SECRET_FLAG_AGENT_OWNED,
 		                             NULL);
 	}
-	if (have_key || have_pkcs12) {
+	if (data.have_key || data.have_pkcs12) {
 		gs_free char *key_path_free = NULL;
 
 		if (is_encrypted (nm_utils_str_utf8safe_unescape (key_path, &key_path_free))) {
@@ -1760,29 +2503,29 @@ handle_line_error:
 		}
 	}
 
-	if (inline_blobs) {
+	if (data.inline_blobs) {
 		GSList *tmp_list = NULL;
 
 		/* filter out blobs that are shadowed and not used. */
-		while ((sl_iter = inline_blobs)) {
-			InlineBlobData *data = sl_iter->data;
+		while ((sl_iter = data.inline_blobs)) {
+			InlineBlobData *blob = sl_iter->data;
 			gboolean is_good = TRUE;
 
-			inline_blobs = inline_blobs->next;
+			data.inline_blobs = data.inline_blobs->next;
 
 			/* Check whether the setting was not overwritten by a later entry in the config-file. */
-			if (nm_streq (data->token, INLINE_BLOB_PKCS12)) {
-				if (   !setting_vpn_eq_data_item_utf8safe (s_vpn, NM_OPENVPN_KEY_CA, data->path)
-				    && !setting_vpn_eq_data_item_utf8safe (s_vpn, NM_OPENVPN_KEY_CERT, data->path)
-				    && !setting_vpn_eq_data_item_utf8safe (s_vpn, NM_OPENVPN_KEY_KEY, data->path))
+			if (nm_streq (blob->token, INLINE_BLOB_PKCS12)) {
+				if (   !setting_vpn_eq_data_item_utf8safe (s_vpn, NM_OPENVPN_KEY_CA, blob->path)
+				    && !setting_vpn_eq_data_item_utf8safe (s_vpn, NM_OPENVPN_KEY_CERT, blob->path)
+				    && !setting_vpn_eq_data_item_utf8safe (s_vpn, NM_OPENVPN_KEY_KEY, blob->path))
 					is_good = FALSE;
 			} else {
-				if (!setting_vpn_eq_data_item_utf8safe (s_vpn, data->key, data->path))
+				if (!setting_vpn_eq_data_item_utf8safe (s_vpn, blob->key, blob->path))
 					is_good = FALSE;
 			}
 			if (!is_good) {
 				g_slist_free_1 (sl_iter);
-				inline_blob_data_free (data);
+				inline_blob_data_free (blob);
 				continue;
 			}
 
@@ -1792,48 +2535,563 @@ handle_line_error:
 			sl_iter->next = tmp_list;
 			tmp_list = sl_iter;
 		}
-		inline_blobs = tmp_list;
+		data.inline_blobs = tmp_list;
 	}
 
-	for (sl_iter = inline_blobs; sl_iter; sl_iter = sl_iter->next) {
+	for (sl_iter = data.inline_blobs; sl_iter; sl_iter = sl_iter->next) {
 		if (!inline_blob_write_out (sl_iter->data, error))
 			goto out_error;
 	}
 
-	g_slist_free_full (inline_blobs, (GDestroyNotify) inline_blob_data_free);
+	g_slist_free_full (data.inline_blobs, (GDestroyNotify) inline_blob_data_free);
 
 	g_return_val_if_fail (!error || !*error, connection);
 	return g_steal_pointer (&connection);
 
 out_error:
-	g_slist_free_full (inline_blobs, (GDestroyNotify) inline_blob_data_free);
+	g_slist_free_full (data.inline_blobs, (GDestroyNotify) inline_blob_data_free);
 	g_return_val_if_fail (!error || *error, NULL);
 	return NULL;
 }
 
+/* files that are read instead of mapped are not read beyond this size. */
+#define IMPORT_FILE_READ_MAX_SIZE (64 * 1024 * 1024)
+
+/* reads all of @fd, for files that cannot be mapped, like pipes. */
+static char *
+import_file_read (int fd, const char *path, gsize *out_len, GError **error)
+{
+	GByteArray *buf;
+	gsize len = 0;
+
+	buf = g_byte_array_sized_new (16384);
+	for (;;) {
+		gssize n;
+
+		if (buf->len - len < 16384)
+			g_byte_array_set_size (buf, len + 16384);
+
+		n = read (fd, &buf->data[len], buf->len - len);
+		if (n < 0) {
+			int errsv = errno;
+
+			if (errsv == EINTR)
+				continue;
+			g_set_error (error,
+			             G_FILE_ERROR,
+			             g_file_error_from_errno (errsv),
+			             _("Failed to read file “%s”: %s"),
+			             path,
+			             g_strerror (errsv));
+			g_byte_array_free (buf, TRUE);
+			return NULL;
+		}
+		if (n == 0)
+			break;
+		len += n;
+		if (len > IMPORT_FILE_READ_MAX_SIZE) {
+			g_set_error (error,
+			             NMV_EDITOR_PLUGIN_ERROR,
+			             NMV_EDITOR_PLUGIN_ERROR_FILE_INVALID,
+			             _("The file to import is too large"));
+			g_byte_array_free (buf, TRUE);
+			return NULL;
+		}
+	}
+
+	g_byte_array_set_size (buf, len);
+	*out_len = len;
+	return (char *) g_byte_array_free (buf, FALSE);
+}
+
+/**
+ * do_import_file:
+ * @path: the file to import
+ * @flags: how to read the file
+ * @error: (allow-none): the error on failure
+ *
+ * The file is read in chunks. Only if @flags contains
+ * %IMPORT_FILE_FLAG_MMAP, regular files are mapped instead. Other files,
+ * like pipes, or files that cannot be mapped are read anyway.
+ *
+ * Returns: (transfer full): the imported connection, or %NULL.
+ */
+NMConnection *
+do_import_file (const char *path, ImportFileFlags flags, GError **error)
+{
+	nm_auto_close int fd = -1;
+	GMappedFile *mfile = NULL;
+	gs_free char *buf = NULL;
+	NMConnection *connection;
+	const char *contents;
+	gsize contents_len;
+	struct stat st;
+
+	g_return_val_if_fail (path, NULL);
+	g_return_val_if_fail (!error || !*error, NULL);
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		int errsv = errno;
+
+		g_set_error (error,
+		             G_FILE_ERROR,
+		             g_file_error_from_errno (errsv),
+		             _("Failed to open file “%s”: %s"),
+		             path,
+		             g_strerror (errsv));
+		return NULL;
+	}
+
+	/* when asked, map the file instead of reading it. Inline blobs are
+	 * written directly from the mapping, so the import needs little memory
+	 * besides it. But a file that is truncated while it is mapped raises
+	 * SIGBUS, so only callers that own the files may ask for it. */
+	if (   NM_FLAGS_HAS (flags, IMPORT_FILE_FLAG_MMAP)
+	    && fstat (fd, &st) == 0
+	    && S_ISREG (st.st_mode))
+		mfile = g_mapped_file_new_from_fd (fd, FALSE, NULL);
+
+	if (mfile) {
+		contents_len = g_mapped_file_get_length (mfile);
+		contents = g_mapped_file_get_contents (mfile) ? : "";
+	} else {
+		buf = import_file_read (fd, path, &contents_len, error);
+		if (!buf)
+			return NULL;
+		contents = buf;
+	}
+
+	/* only the first pages of the mapping are read for rejecting
+	 * files that are obviously not for us. Files the sniffer is unsure
+	 * about get the full parse, which only writes out inline blobs once
+	 * the file validated as a client configuration. */
+	if (do_import_sniff (contents, contents_len) == IMPORT_SNIFF_REJECT) {
+		g_set_error_literal (error,
+		                     NMV_EDITOR_PLUGIN_ERROR,
+		                     NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
+		                     _("The file to import wasn’t a valid OpenVPN client configuration"));
+		connection = NULL;
+	} else
+		connection = do_import (path, contents, contents_len, error);
+
+	if (mfile)
+		g_mapped_file_unref (mfile);
+	return connection;
+}
+
+void
+import_file_result_free (ImportFileResult *result)
+{
+	if (!result)
+		return;
+	g_free (result->path);
+	g_clear_object (&result->connection);
+	g_clear_error (&result->error);
+	g_slice_free (ImportFileResult, result);
+}
+
+static void
+_import_files_worker (gpointer task_data, gpointer user_data)
+{
+	ImportFileResult *result = task_data;
+
+	result->connection = do_import_file (result->path, GPOINTER_TO_UINT (user_data), &result->error);
+}
+
+/**
+ * do_import_files:
+ * @paths: the files to import
+ * @n_paths: the number of files in @paths
+ * @n_threads: the number of worker threads, or 0 to use one
+ *   per CPU.
+ * @flags: how to read the files, see do_import_file()
+ *
+ * Imports the files in parallel. do_import() only has side effects when
+ * writing out inline blobs, and those are serialized.
+ *
+ * Returns: (transfer full): an array of #ImportFileResult, in the same order
+ *   as @paths.
+ */
+GPtrArray *
+do_import_files (const char *const *paths, guint n_paths, guint n_threads, ImportFileFlags flags)
+{
+	GPtrArray *results;
+	GThreadPool *pool = NULL;
+	guint i;
+
+	g_return_val_if_fail (paths || n_paths == 0, NULL);
+
+	results = g_ptr_array_new_full (n_paths, (GDestroyNotify) import_file_result_free);
+	for (i = 0; i < n_paths; i++) {
+		ImportFileResult *result = g_slice_new0 (ImportFileResult);
+
+		result->path = g_strdup (paths[i]);
+		g_ptr_array_add (results, result);
+	}
+
+	if (n_threads == 0) {
+		long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+		n_threads = n > 0 ? n : 1;
+	}
+	n_threads = MIN (n_threads, n_paths);
+
+	if (n_threads > 1)
+		pool = g_thread_pool_new (_import_files_worker, GUINT_TO_POINTER (flags), n_threads, TRUE, NULL);
+
+	for (i = 0; i < n_paths; i++) {
+		if (pool)
+			g_thread_pool_push (pool, results->pdata[i], NULL);
+		else
+			_import_files_worker (results->pdata[i], GUINT_TO_POINTER (flags));
+	}
+
+	/* waits for all files to be imported. */
+	if (pool)
+		g_thread_pool_free (pool, FALSE, TRUE);
+
+	return results;
+}
+
+/**
+ * do_import_files_check:
+ * @results: the array returned by do_import_files()
+ * @error: (allow-none): on failure, the combined error of all failed
+ *   files.
+ *
+ * Returns: %TRUE if all files were imported successfully.
+ */
+gboolean
+do_import_files_check (const GPtrArray *results, GError **error)
+{
+	nm_auto_free_gstring GString *msg = NULL;
+	guint n_failed = 0;
+	guint i;
+
+	g_return_val_if_fail (results, FALSE);
+
+	for (i = 0; i < results->len; i++) {
+		const ImportFileResult *result = results->pdata[i];
+
+		if (result->connection)
+			continue;
+		if (!msg)
+			msg = g_string_new (NULL);
+		else
+			g_string_append_c (msg, '\n');
+		g_string_append_printf (msg, "%s: %s",
+		                        result->path,
+		                        result->error ? result->error->message : _("unknown error"));
+		n_failed++;
+	}
+
+	if (n_failed == 0)
+		return TRUE;
+
+	g_set_error (error,
+	             NMV_EDITOR_PLUGIN_ERROR,
+	             NMV_EDITOR_PLUGIN_ERROR_FAILED,
+	             ngettext ("failed to import %u of %u file:\n%s",
+	                       "failed to import %u of %u files:\n%s",
+	                       results->len),
+	             n_failed,
+	             results->len,
+	             msg->str);
+	return FALSE;
+}
+
+static int
+_import_dir_cmp (gconstpointer a, gconstpointer b)
+{
+	return strcmp (*((const char *const *) a), *((const char *const *) b));
+}
+
+/**
+ * do_import_dir:
+ * @dirname: the directory with the profiles
+ * @n_threads: the number of worker threads, see do_import_files()
+ * @flags: how to read the files, see do_import_file()
+ * @error: (allow-none): the error if the directory cannot be read
+ *
+ * Imports all "*.ovpn" and "*.conf" files in @dirname, sorted
+ * by their file name.
+ *
+ * Returns: (transfer full): an array of #ImportFileResult, or %NULL
+ *   on failure to read the directory.
+ */
+GPtrArray *
+do_import_dir (const char *dirname, guint n_threads, ImportFileFlags flags, GError **error)
+{
+	GDir *dir;
+	const char *name;
+	gs_unref_ptrarray GPtrArray *paths = NULL;
+
+	g_return_val_if_fail (dirname, NULL);
+	g_return_val_if_fail (!error || !*error, NULL);
+
+	dir = g_dir_open (dirname, 0, error);
+	if (!dir)
+		return NULL;
+
+	paths = g_ptr_array_new_with_free_func (g_free);
+	while ((name = g_dir_read_name (dir))) {
+		if (   !g_str_has_suffix (name, ".ovpn")
+		    && !g_str_has_suffix (name, ".conf"))
+			continue;
+		g_ptr_array_add (paths, g_build_filename (dirname, name, NULL));
+	}
+	g_dir_close (dir);
+
+	/* g_dir_read_name() returns the names in no particular order. */
+	g_ptr_array_sort (paths, _import_dir_cmp);
+
+	return do_import_files ((const char *const *) paths->pdata, paths->len, n_threads, flags);
+}
+
+/*****************************************************************************/
+
+static void
+_collect_item (const char *key, const char *value, gpointer user_data)
+{
+	g_ptr_array_add (user_data, (gpointer) key);
+}
+
+static GPtrArray *
+_setting_vpn_get_keys (NMSettingVpn *s_vpn, gboolean secrets)
+{
+	GPtrArray *keys = g_ptr_array_new ();
+
+	if (secrets)
+		nm_setting_vpn_foreach_secret (s_vpn, _collect_item, keys);
+	else
+		nm_setting_vpn_foreach_data_item (s_vpn, _collect_item, keys);
+	return keys;
+}
+
+/* the VPN data items that do_import() sets from directives of the file.
+ * Other items, like the secret flags, are set by the user in the editor
+ * and survive a re-import. */
+static const char *const import_update_keys[] = {
+	NM_OPENVPN_KEY_ALLOW_PULL_FQDN,
+	NM_OPENVPN_KEY_AUTH,
+	NM_OPENVPN_KEY_CA,
+	NM_OPENVPN_KEY_CERT,
+	NM_OPENVPN_KEY_CIPHER,
+	NM_OPENVPN_KEY_COMPRESS,
+	NM_OPENVPN_KEY_COMP_LZO,
+	NM_OPENVPN_KEY_CONNECTION_TYPE,
+	NM_OPENVPN_KEY_CONNECT_TIMEOUT,
+	NM_OPENVPN_KEY_CRL_VERIFY_DIR,
+	NM_OPENVPN_KEY_CRL_VERIFY_FILE,
+	NM_OPENVPN_KEY_DEV,
+	NM_OPENVPN_KEY_DEV_TYPE,
+	NM_OPENVPN_KEY_EXTRA_CERTS,
+	NM_OPENVPN_KEY_FLOAT,
+	NM_OPENVPN_KEY_FRAGMENT_SIZE,
+	NM_OPENVPN_KEY_HTTP_PROXY_USERNAME,
+	NM_OPENVPN_KEY_KEY,
+	NM_OPENVPN_KEY_KEYSIZE,
+	NM_OPENVPN_KEY_LOCAL_IP,
+	NM_OPENVPN_KEY_MAX_ROUTES,
+	NM_OPENVPN_KEY_MSSFIX,
+	NM_OPENVPN_KEY_MTU_DISC,
+	NM_OPENVPN_KEY_NS_CERT_TYPE,
+	NM_OPENVPN_KEY_PING,
+	NM_OPENVPN_KEY_PING_EXIT,
+	NM_OPENVPN_KEY_PING_RESTART,
+	NM_OPENVPN_KEY_PORT,
+	NM_OPENVPN_KEY_PROTO_TCP,
+	NM_OPENVPN_KEY_PROXY_PORT,
+	NM_OPENVPN_KEY_PROXY_RETRY,
+	NM_OPENVPN_KEY_PROXY_SERVER,
+	NM_OPENVPN_KEY_PROXY_TYPE,
+	NM_OPENVPN_KEY_PUSH_PEER_INFO,
+	NM_OPENVPN_KEY_REMOTE,
+	NM_OPENVPN_KEY_REMOTE_CERT_TLS,
+	NM_OPENVPN_KEY_REMOTE_IP,
+	NM_OPENVPN_KEY_REMOTE_RANDOM,
+	NM_OPENVPN_KEY_REMOTE_RANDOM_HOSTNAME,
+	NM_OPENVPN_KEY_RENEG_SECONDS,
+	NM_OPENVPN_KEY_STATIC_KEY,
+	NM_OPENVPN_KEY_STATIC_KEY_DIRECTION,
+	NM_OPENVPN_KEY_TA,
+	NM_OPENVPN_KEY_TA_DIR,
+	NM_OPENVPN_KEY_TLS_CIPHER,
+	NM_OPENVPN_KEY_TLS_CRYPT,
+	NM_OPENVPN_KEY_TLS_CRYPT_V2,
+	NM_OPENVPN_KEY_TLS_REMOTE,
+	NM_OPENVPN_KEY_TLS_VERSION_MAX,
+	NM_OPENVPN_KEY_TLS_VERSION_MIN,
+	NM_OPENVPN_KEY_TUNNEL_MTU,
+	NM_OPENVPN_KEY_TUN_IPV6,
+	NM_OPENVPN_KEY_VERIFY_X509_NAME,
+};
+
+static gboolean
+import_update_is_owned_key (const char *key)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (import_update_keys); i++) {
+		if (nm_streq (import_update_keys[i], key))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* the routes are the only part of the IPv4 setting that comes from the
+ * file. The method, DNS and never-default are left to the user. */
+static gboolean
+import_update_routes (NMSetting *s_ip4, NMSetting *s_ip4_new)
+{
+	gs_unref_object NMSetting *s_tmp = NULL;
+	GValue value = G_VALUE_INIT;
+	GParamSpec *pspec;
+	gboolean changed = FALSE;
+
+	pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (s_ip4_new), "routes");
+	g_return_val_if_fail (pspec, FALSE);
+
+	g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
+	g_object_get_property (G_OBJECT (s_ip4_new), "routes", &value);
+
+	/* compare a copy that has the new routes with the original, so
+	 * that only the routes are compared. */
+	s_tmp = nm_setting_duplicate (s_ip4);
+	g_object_set_property (G_OBJECT (s_tmp), "routes", &value);
+	if (!nm_setting_compare (s_ip4, s_tmp, NM_SETTING_COMPARE_FLAG_EXACT)) {
+		g_object_set_property (G_OBJECT (s_ip4), "routes", &value);
+		changed = TRUE;
+	}
+
+	g_value_unset (&value);
+	return changed;
+}
+
+/**
+ * do_import_update:
+ * @connection: the existing connection, which gets updated in place
+ * @imported: the connection from importing the file again
+ * @out_changed: (allow-none): if given, the names of the changed
+ *   VPN data items and secrets, and "routes" or the name of the
+ *   IPv4 setting if it was added, are appended as newly allocated
+ *   strings.
+ *
+ * Applies the changes of a re-imported file to the existing connection,
+ * item by item. Only the items that do_import() sets from the file are
+ * updated or removed. Items that are equal are not touched, so that a
+ * connection whose configuration didn't change stays the same.
+ * Other items, like the secret flags, are only added if they are
+ * missing. Secrets are never removed, because they are usually not part
+ * of the file but were entered by the user. For comparing secrets, they
+ * must be loaded into @connection, e.g. with
+ * nm_remote_connection_get_secrets().
+ *
+ * Returns: the number of changes.
+ */
+guint
+do_import_update (NMConnection *connection, NMConnection *imported, GPtrArray *out_changed)
+{
+	NMSettingVpn *s_vpn, *s_vpn_new;
+	NMSetting *s_ip4, *s_ip4_new;
+	gs_unref_ptrarray GPtrArray *keys = NULL;
+	guint n_changed = 0;
+	guint i;
+
+	g_return_val_if_fail (NM_IS_CONNECTION (connection), 0);
+	g_return_val_if_fail (NM_IS_CONNECTION (imported), 0);
+
+	s_vpn = nm_connection_get_setting_vpn (connection);
+	s_vpn_new = nm_connection_get_setting_vpn (imported);
+	g_return_val_if_fail (s_vpn && s_vpn_new, 0);
+
+#define _changed(name) \
+	G_STMT_START { \
+		n_changed++; \
+		if (out_changed) \
+			g_ptr_array_add (out_changed, g_strdup (name)); \
+	} G_STMT_END
+
+	keys = _setting_vpn_get_keys (s_vpn, FALSE);
+	for (i = 0; i < keys->len; i++) {
+		const char *key = keys->pdata[i];
+
+		if (   import_update_is_owned_key (key)
+		    && !nm_setting_vpn_get_data_item (s_vpn_new, key)) {
+			_changed (key);
+			nm_setting_vpn_remove_data_item (s_vpn, key);
+		}
+	}
+	g_ptr_array_unref (keys);
+
+	keys = _setting_vpn_get_keys (s_vpn_new, FALSE);
+	for (i = 0; i < keys->len; i++) {
+		const char *key = keys->pdata[i];
+		const char *value = nm_setting_vpn_get_data_item (s_vpn_new, key);
+		const char *old_value = nm_setting_vpn_get_data_item (s_vpn, key);
+
+		if (   nm_streq0 (old_value, value)
+		    || (old_value && !import_update_is_owned_key (key)))
+			continue;
+		nm_setting_vpn_add_data_item (s_vpn, key, value);
+		_changed (key);
+	}
+	g_ptr_array_unref (keys);
+
+	keys = _setting_vpn_get_keys (s_vpn_new, TRUE);
+	for (i = 0; i < keys->len; i++) {
+		const char *key = keys->pdata[i];
+		const char *value = nm_setting_vpn_get_secret (s_vpn_new, key);
+
+		if (!nm_streq0 (nm_setting_vpn_get_secret (s_vpn, key), value)) {
+			nm_setting_vpn_add_secret (s_vpn, key, value);
+			_changed (key);
+		}
+	}
+
+	s_ip4 = nm_connection_get_setting_by_name (connection, NM_SETTING_IP4_CONFIG_SETTING_NAME);
+	s_ip4_new = nm_connection_get_setting_by_name (imported, NM_SETTING_IP4_CONFIG_SETTING_NAME);
+	if (s_ip4_new) {
+		if (!s_ip4) {
+			nm_connection_add_setting (connection, nm_setting_duplicate (s_ip4_new));
+			_changed (NM_SETTING_IP4_CONFIG_SETTING_NAME);
+		} else if (import_update_routes (s_ip4, s_ip4_new))
+			_changed ("routes");
+	}
+
+#undef _changed
+
+	return n_changed;
+}
+
 /*****************************************************************************/
 
-static const char *
-escape_arg (const char *value, char **buf)
+/* appends @value to @f, quoted and escaped as needed. One scan over
+ * @value decides about the quoting and the size of the result, which
+ * is then written directly into the buffer of @f. */
+static void
+args_write_arg (GString *f, const char *value)
 {
 	const char *s;
-	char *result, *i_result;
+	char *d;
 	gboolean needs_double_quotes = FALSE;
 	gboolean needs_quotation = FALSE;
+	gsize n_escape = 0;
 	gsize len;
+	gsize pos;
 
 	nm_assert (value);
-	nm_assert (buf && !*buf);
 
-	if (value[0] == '\0')
-		return (*buf = g_strdup ("''"));
+	if (value[0] == '\0') {
+		g_string_append_len (f, "''", 2);
+		return;
+	}
 
 	/* check if the string contains only benign characters... */
-	len = 0;
 	for (s = value; s[0]; s++) {
 		char c = s[0];
 
-		len++;
 		if (   (c >= '0' && c <= '9')
 		    || (c >= 'a' && c <= 'z')
 		    || (c >= 'A' && c <= 'Z')
@@ -1843,40 +3101,44 @@ escape_arg (const char *value, char **buf)
 		needs_quotation = TRUE;
 		if (NM_IN_SET (c, '\'', '\n'))
 			needs_double_quotes = TRUE;
+		if (NM_IN_SET (c, '\\', '"', '\n'))
+			n_escape++;
+	}
+	len = s - value;
+
+	if (!needs_quotation) {
+		g_string_append_len (f, value, len);
+		return;
 	}
-	if (!needs_quotation)
-		return value;
 
 	if (!needs_double_quotes) {
-		result = g_malloc (len + 2 + 1);
-		result[0] = '\'';
-		memcpy (&result[1], value, len);
-		result[1 + len] = '\'';
-		result[2 + len] = '\0';
-	} else {
-		i_result = result = g_malloc (len * 2 + 3);
-		*(i_result++) = '"';
-		for (s = value; s[0]; s++) {
-			if (s[0] == '\n') {
-				/* Openvpn does not support encoding '\n' in the ovpn configuration file.
-				 * This configuration cannot be expressed in an ovpn file.
-				 *
-				 * Still escape it as '\n', although openvpn's parser will warn
-				 * about the invalid escape sequence. */
-				*(i_result++) = '\\';
-				*(i_result++) = 'n';
-			} else {
-				if (NM_IN_SET (s[0], '\\', '"'))
-					*(i_result++) = '\\';
-				*(i_result++) = s[0];
-			}
-		}
-		*(i_result++) = '"';
-		*(i_result++) = '\0';
+		g_string_append_c (f, '\'');
+		g_string_append_len (f, value, len);
+		g_string_append_c (f, '\'');
+		return;
 	}
 
-	*buf = result;
-	return result;
+	pos = f->len;
+	g_string_set_size (f, pos + len + n_escape + 2);
+	d = &f->str[pos];
+	*(d++) = '"';
+	for (s = value; s[0]; s++) {
+		if (s[0] == '\n') {
+			/* Openvpn does not support encoding '\n' in the ovpn configuration file.
+			 * This configuration cannot be expressed in an ovpn file.
+			 *
+			 * Still escape it as '\n', although openvpn's parser will warn
+			 * about the invalid escape sequence. */
+			*(d++) = '\\';
+			*(d++) = 'n';
+		} else {
+			if (NM_IN_SET (s[0], '\\', '"'))
+				*(d++) = '\\';
+			*(d++) = s[0];
+		}
+	}
+	*(d++) = '"';
+	nm_assert (d == &f->str[f->len]);
 }
 
 static void
@@ -1889,8 +3151,6 @@ args_write_line_v (GString *f, gsize nargs, const char **args)
 	nm_assert (args[0]);
 
 	for (i = 0; i < nargs; i++) {
-		gs_free char *tmp = NULL;
-
 		/* NULL is skipped. This is for convenience to specify
 		 * optional arguments. */
 		if (!args[i])
@@ -1899,7 +3159,7 @@ args_write_line_v (GString *f, gsize nargs, const char **args)
 		if (printed)
 			g_string_append_c (f, ' ');
 		printed = TRUE;
-		g_string_append (f, escape_arg (args[i], &tmp));
+		args_write_arg (f, args[i]);
 	}
 	g_string_append_c (f, '\n');
 }
@@ -1951,8 +3211,39 @@ args_write_line_setting_value (GString *f,
 
 /*****************************************************************************/
 
-static GString *
-do_export_create (NMConnection *connection, const char *path, GError **error)
+/* when exporting to a file descriptor, the configuration is written out
+ * whenever this much accumulated, so that a connection with many routes
+ * is not composed in memory as a whole. */
+#define EXPORT_FLUSH_SIZE (64 * 1024)
+
+/* writes @f to @fd, if it holds at least @threshold bytes. Does nothing
+ * for a negative @fd. */
+static gboolean
+export_flush (GString *f, int fd, gsize threshold, GError **error)
+{
+	int errsv;
+
+	if (fd < 0 || f->len < threshold)
+		return TRUE;
+
+	if (!_fd_write_full (fd, f->str, f->len)) {
+		errsv = errno;
+		g_set_error (error,
+		             NMV_EDITOR_PLUGIN_ERROR,
+		             NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
+		             _("failed to write file: %s"),
+		             g_strerror (errsv));
+		return FALSE;
+	}
+	g_string_truncate (f, 0);
+	return TRUE;
+}
+
+/* appends the configuration for @connection to @f. If @fd is not -1,
+ * parts of it may be written to @fd already, and only the rest is left
+ * in @f. */
+static gboolean
+do_export_create (NMConnection *connection, const char *path, GString *f, int fd, GError **error)
 {
 	NMSettingConnection *s_con;
 	NMSettingIPConfig *s_ip4;
@@ -1965,14 +3256,13 @@ do_export_create (NMConnection *connection, const char *path, GError **error)
 	const char *remote_ip = NULL;
 	const char *proxy_type = NULL;
 	guint i, num;
-	nm_auto(_auto_free_gstring_p) GString *f = NULL;
 
 	if (!path || !path[0]) {
 		g_set_error_literal (error,
 		                     NMV_EDITOR_PLUGIN_ERROR,
 		                     NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
 		                     _("missing path argument"));
-		return NULL;
+		return FALSE;
 	}
 
 	s_con = nm_connection_get_setting_connection (connection);
@@ -1982,7 +3272,7 @@ do_export_create (NMConnection *connection, const char *path, GError **error)
 		                     NMV_EDITOR_PLUGIN_ERROR,
 		                     NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
 		                     _("connection is not a valid OpenVPN connection"));
-		return NULL;
+		return FALSE;
 	}
 
 	gateways = nmovpn_arg_is_set (nm_setting_vpn_get_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE));
@@ -1991,13 +3281,11 @@ do_export_create (NMConnection *connection, const char *path, GError **error)
 		                     NMV_EDITOR_PLUGIN_ERROR,
 		                     NMV_EDITOR_PLUGIN_ERROR_FILE_NOT_VPN,
 		                     _("connection was incomplete (missing gateway)"));
-		return NULL;
+		return FALSE;
 	}
 
 	connection_type = nmovpn_arg_is_set (nm_setting_vpn_get_data_item (s_vpn, NM_OPENVPN_KEY_CONNECTION_TYPE));
 
-	f = g_string_sized_new (512);
-
 	if (NM_IN_STRSET (connection_type, NM_OPENVPN_CONTYPE_TLS,
 	                                   NM_OPENVPN_CONTYPE_PASSWORD,
 	                                   NM_OPENVPN_CONTYPE_PASSWORD_TLS))
@@ -2348,6 +3636,8 @@ do_export_create (NMConnection *connection, const char *path, GError **error)
 			                 netmask_str,
 			                 next_hop_str,
 			                 metric == -1 ? NULL : nm_sprintf_buf (metric_buf, "%u", (unsigned) metric));
+			if (!export_flush (f, fd, EXPORT_FLUSH_SIZE, error))
+				return FALSE;
 		}
 	}
 
@@ -2360,17 +3650,16 @@ do_export_create (NMConnection *connection, const char *path, GError **error)
 	args_write_line (f, NMV_OVPN_TAG_USER, NM_OPENVPN_USER);
 	args_write_line (f, NMV_OVPN_TAG_GROUP, NM_OPENVPN_GROUP);
 
-	return g_steal_pointer (&f);
+	return TRUE;
 }
 
-gboolean
-do_export (const char *path, NMConnection *connection, GError **error)
+static gboolean
+_export_to_file (const char *path, NMConnection *connection, GString *f, GError **error)
 {
-	nm_auto(_auto_free_gstring_p) GString *f = NULL;
 	gs_free_error GError *local = NULL;
 
-	f = do_export_create (connection, path, error);
-	if (!f)
+	g_string_truncate (f, 0);
+	if (!do_export_create (connection, path, f, -1, error))
 		return FALSE;
 
 	if (!g_file_set_contents (path, f->str, f->len, &local)) {
@@ -2384,3 +3673,73 @@ do_export (const char *path, NMConnection *connection, GError **error)
 
 	return TRUE;
 }
+
+gboolean
+do_export (const char *path, NMConnection *connection, GError **error)
+{
+	nm_auto_free_gstring GString *f = g_string_sized_new (512);
+
+	return _export_to_file (path, connection, f, error);
+}
+
+/**
+ * do_export_fd:
+ * @fd: the file descriptor to write to
+ * @path: the path the configuration is meant for. Auxiliary files,
+ *   like the authfile of a HTTP proxy, are written next to it.
+ * @connection: the connection to export
+ * @error: (allow-none): the error on failure
+ *
+ * Like do_export(), but writes the configuration to @fd, for example
+ * to a pipe. It is written in parts while it is composed. @fd is not
+ * closed.
+ *
+ * Returns: %TRUE on success. On failure, part of the configuration may
+ *   already be written.
+ */
+gboolean
+do_export_fd (int fd, const char *path, NMConnection *connection, GError **error)
+{
+	nm_auto_free_gstring GString *f = g_string_sized_new (512);
+
+	g_return_val_if_fail (fd >= 0, FALSE);
+
+	if (!do_export_create (connection, path, f, fd, error))
+		return FALSE;
+
+	return export_flush (f, fd, 0, error);
+}
+
+/**
+ * do_export_batch:
+ * @paths: the files to write
+ * @connections: the connections to export, one for each path
+ * @n_connections: the number of elements in @paths and @connections
+ * @error: (allow-none): the error on failure
+ *
+ * Exports each connection to its path, like do_export(). All
+ * configurations are composed in the same buffer.
+ *
+ * Returns: %TRUE on success. On failure, the connections before the
+ *   failing one are already written.
+ */
+gboolean
+do_export_batch (const char *const *paths,
+                 NMConnection *const *connections,
+                 guint n_connections,
+                 GError **error)
+{
+	nm_auto_free_gstring GString *f = g_string_sized_new (4096);
+	guint i;
+
+	g_return_val_if_fail (paths || n_connections == 0, FALSE);
+	g_return_val_if_fail (connections || n_connections == 0, FALSE);
+
+	for (i = 0; i < n_connections; i++) {
+		if (!_export_to_file (paths[i], connections[i], f, error)) {
+			g_prefix_error (error, "%s: ", paths[i]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
@@ -29,8 +29,57 @@ gboolean _nmovpn_test_args_parse_line (const char *line,
                                        const char ***out_p,
                                        char **out_error);
 
+gboolean _nmovpn_test_args_parse_lines (const char *contents,
+                                        gsize contents_len,
+                                        guint *out_n_args,
+                                        guint *out_n_heap_allocs);
+
+const char *_nmovpn_test_import_directive_find (const char *name);
+
+typedef enum {
+	IMPORT_SNIFF_REJECT,
+	IMPORT_SNIFF_UNSURE,
+	IMPORT_SNIFF_ACCEPT,
+} ImportSniffResult;
+
+ImportSniffResult do_import_sniff (const char *contents, gsize contents_len);
+
 NMConnection *do_import (const char *path, const char *contents, gsize contents_len, GError **error);
 
+typedef enum {
+	IMPORT_FILE_FLAG_NONE = 0,
+
+	/* map the file instead of reading it. Only for files that are not
+	 * modified while they are imported: if one gets truncated, accessing
+	 * the mapping raises SIGBUS. */
+	IMPORT_FILE_FLAG_MMAP = (1LL << 0),
+} ImportFileFlags;
+
+NMConnection *do_import_file (const char *path, ImportFileFlags flags, GError **error);
+
+typedef struct {
+	char *path;
+	NMConnection *connection;
+	GError *error;
+} ImportFileResult;
+
+void import_file_result_free (ImportFileResult *result);
+
+GPtrArray *do_import_files (const char *const *paths, guint n_paths, guint n_threads, ImportFileFlags flags);
+
+gboolean do_import_files_check (const GPtrArray *results, GError **error);
+
+GPtrArray *do_import_dir (const char *dirname, guint n_threads, ImportFileFlags flags, GError **error);
+
+guint do_import_update (NMConnection *connection, NMConnection *imported, GPtrArray *out_changed);
+
 gboolean do_export (const char *path, NMConnection *connection, GError **error);
 
+gboolean do_export_fd (int fd, const char *path, NMConnection *connection, GError **error);
+
+gboolean do_export_batch (const char *const *paths,
+                          NMConnection *const *connections,
+                          guint n_connections,
+                          GError **error);
+
 #endif
@@ -0,0 +1,507 @@
+/*
+ * network-manager-openvpn - OpenVPN integration with NetworkManager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ */
+
+/* Imports a bundle of OpenVPN profiles, like the ones shipped by VPN
+ * providers, and optionally adds them to NetworkManager.
+ *
+ * With --watch, it keeps watching the directory and re-imports the files
+ * that change. Only the items that differ are applied to the existing
+ * connection, and connections whose file didn't effectively change are
+ * left alone, so that their active tunnels are not restarted. Removing a
+ * file doesn't delete its connection either. */
+
+#include "nm-default.h"
+
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "import-export.h"
+
+typedef struct {
+	GMainLoop *loop;
+	NMRemoteConnection *remote;
+	GVariant *secrets;
+	GError *error;
+} AddData;
+
+static void
+add_connection_cb (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	AddData *add_data = user_data;
+
+	add_data->remote = nm_client_add_connection_finish (NM_CLIENT (source), result, &add_data->error);
+	g_main_loop_quit (add_data->loop);
+}
+
+static NMRemoteConnection *
+add_connection (NMClient *client, NMConnection *connection, GError **error)
+{
+	AddData add_data = { 0 };
+
+	add_data.loop = g_main_loop_new (NULL, FALSE);
+	nm_client_add_connection_async (client, connection, TRUE, NULL, add_connection_cb, &add_data);
+	g_main_loop_run (add_data.loop);
+	g_main_loop_unref (add_data.loop);
+
+	if (add_data.error) {
+		g_propagate_error (error, add_data.error);
+		return NULL;
+	}
+	return add_data.remote;
+}
+
+static void
+commit_changes_cb (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	AddData *add_data = user_data;
+
+	nm_remote_connection_commit_changes_finish (NM_REMOTE_CONNECTION (source), result, &add_data->error);
+	g_main_loop_quit (add_data->loop);
+}
+
+static gboolean
+commit_changes (NMRemoteConnection *remote, GError **error)
+{
+	AddData add_data = { 0 };
+
+	add_data.loop = g_main_loop_new (NULL, FALSE);
+	nm_remote_connection_commit_changes_async (remote, TRUE, NULL, commit_changes_cb, &add_data);
+	g_main_loop_run (add_data.loop);
+	g_main_loop_unref (add_data.loop);
+
+	if (add_data.error) {
+		g_propagate_error (error, add_data.error);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void
+get_secrets_cb (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	AddData *add_data = user_data;
+
+	add_data->secrets = nm_remote_connection_get_secrets_finish (NM_REMOTE_CONNECTION (source), result, &add_data->error);
+	g_main_loop_quit (add_data->loop);
+}
+
+/* the connections of NMClient come without secrets. Load the VPN secrets,
+ * so that the re-imported ones can be compared with them. */
+static gboolean
+load_secrets (NMRemoteConnection *remote, GError **error)
+{
+	AddData add_data = { 0 };
+	gs_unref_variant GVariant *vpn_secrets = NULL;
+	gboolean success;
+
+	add_data.loop = g_main_loop_new (NULL, FALSE);
+	nm_remote_connection_get_secrets_async (remote, NM_SETTING_VPN_SETTING_NAME, NULL, get_secrets_cb, &add_data);
+	g_main_loop_run (add_data.loop);
+	g_main_loop_unref (add_data.loop);
+
+	if (add_data.error) {
+		g_propagate_error (error, add_data.error);
+		return FALSE;
+	}
+
+	/* there may be no system-owned secrets at all. */
+	vpn_secrets = g_variant_lookup_value (add_data.secrets, NM_SETTING_VPN_SETTING_NAME, NULL);
+	success =    !vpn_secrets
+	          || nm_connection_update_secrets (NM_CONNECTION (remote), NM_SETTING_VPN_SETTING_NAME, add_data.secrets, error);
+	g_variant_unref (add_data.secrets);
+	return success;
+}
+
+static NMRemoteConnection *
+find_connection (NMClient *client, NMConnection *connection)
+{
+	const GPtrArray *connections = nm_client_get_connections (client);
+	const char *id = nm_connection_get_id (connection);
+	guint i;
+
+	for (i = 0; i < connections->len; i++) {
+		NMConnection *candidate = connections->pdata[i];
+		NMSettingVpn *s_vpn = nm_connection_get_setting_vpn (candidate);
+
+		if (   s_vpn
+		    && nm_streq0 (nm_setting_vpn_get_service_type (s_vpn), NM_VPN_SERVICE_TYPE_OPENVPN)
+		    && nm_streq0 (nm_connection_get_id (candidate), id))
+			return connections->pdata[i];
+	}
+	return NULL;
+}
+
+/*****************************************************************************/
+
+typedef struct {
+	NMClient *client;
+	gboolean quiet;
+
+	/* path => the connection for it. Either a NMRemoteConnection,
+	 * with --add, or the imported NMConnection. */
+	GHashTable *connections;
+
+	/* path => the GSource ID of the pending re-import. */
+	GHashTable *pending;
+} WatchData;
+
+/* applies the imported connection for @path. If there is already a
+ * connection for it, only the changes get applied. */
+static gboolean
+apply_connection (WatchData *watch_data, const char *path, NMConnection *imported, GError **error)
+{
+	NMConnection *connection;
+	gs_unref_ptrarray GPtrArray *changed = NULL;
+	gs_free char *changed_str = NULL;
+
+	connection = g_hash_table_lookup (watch_data->connections, path);
+	if (!connection && watch_data->client)
+		connection = (NMConnection *) find_connection (watch_data->client, imported);
+
+	if (!connection) {
+		if (watch_data->client) {
+			connection = (NMConnection *) add_connection (watch_data->client, imported, error);
+			if (!connection)
+				return FALSE;
+		} else
+			connection = g_object_ref (imported);
+		g_hash_table_insert (watch_data->connections, g_strdup (path), connection);
+		if (!watch_data->quiet)
+			g_print ("%s: %s\n", path, nm_connection_get_id (connection));
+		return TRUE;
+	}
+
+	if (!g_hash_table_lookup (watch_data->connections, path))
+		g_hash_table_insert (watch_data->connections, g_strdup (path), g_object_ref (connection));
+
+	if (   watch_data->client
+	    && nm_setting_vpn_get_num_secrets (nm_connection_get_setting_vpn (imported)) > 0
+	    && !load_secrets (NM_REMOTE_CONNECTION (connection), error))
+		return FALSE;
+
+	changed = g_ptr_array_new_with_free_func (g_free);
+	if (do_import_update (connection, imported, changed) == 0) {
+		if (!watch_data->quiet)
+			g_print ("%s: %s (unchanged)\n", path, nm_connection_get_id (connection));
+		return TRUE;
+	}
+
+	if (   watch_data->client
+	    && !commit_changes (NM_REMOTE_CONNECTION (connection), error))
+		return FALSE;
+
+	g_ptr_array_add (changed, NULL);
+	changed_str = g_strjoinv (", ", (char **) changed->pdata);
+	if (!watch_data->quiet)
+		g_print ("%s: %s (updated %s)\n", path, nm_connection_get_id (connection), changed_str);
+	return TRUE;
+}
+
+typedef struct {
+	WatchData *watch_data;
+	char *path;
+} ReimportData;
+
+static void
+reimport_data_free (gpointer user_data)
+{
+	ReimportData *reimport_data = user_data;
+
+	g_free (reimport_data->path);
+	g_slice_free (ReimportData, reimport_data);
+}
+
+static gboolean
+reimport_cb (gpointer user_data)
+{
+	ReimportData *reimport_data = user_data;
+	WatchData *watch_data = reimport_data->watch_data;
+	const char *path = reimport_data->path;
+	gs_unref_object NMConnection *imported = NULL;
+	GError *error = NULL;
+
+	imported = do_import_file (path, IMPORT_FILE_FLAG_NONE, &error);
+	if (   !imported
+	    || !apply_connection (watch_data, path, imported, &error)) {
+		g_printerr ("%s: %s\n", path, error->message);
+		g_clear_error (&error);
+	}
+
+	/* this also frees @reimport_data. */
+	g_hash_table_remove (watch_data->pending, path);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+is_profile_name (const char *name)
+{
+	return    g_str_has_suffix (name, ".ovpn")
+	       || g_str_has_suffix (name, ".conf");
+}
+
+static void
+schedule_reimport (WatchData *watch_data, const char *path)
+{
+	ReimportData *reimport_data;
+	guint id;
+
+	/* configuration management may write a file in several steps. Wait
+	 * until it settles, and parse it only once. */
+	id = GPOINTER_TO_UINT (g_hash_table_lookup (watch_data->pending, path));
+	if (id)
+		g_hash_table_remove (watch_data->pending, path);
+
+	reimport_data = g_slice_new (ReimportData);
+	reimport_data->watch_data = watch_data;
+	reimport_data->path = g_strdup (path);
+	id = g_timeout_add_full (G_PRIORITY_DEFAULT, 300, reimport_cb, reimport_data, reimport_data_free);
+	g_hash_table_insert (watch_data->pending, g_strdup (path), GUINT_TO_POINTER (id));
+}
+
+static void
+profile_removed (WatchData *watch_data, const char *path)
+{
+	NMConnection *connection;
+
+	g_hash_table_remove (watch_data->pending, path);
+
+	/* a profile may only be moved away for a moment, and deleting the
+	 * connection would tear down its tunnel. Leave it to the user. */
+	connection = g_hash_table_lookup (watch_data->connections, path);
+	if (!watch_data->quiet) {
+		if (connection)
+			g_print ("%s: removed, connection %s left alone\n", path, nm_connection_get_id (connection));
+		else
+			g_print ("%s: removed\n", path);
+	}
+	g_hash_table_remove (watch_data->connections, path);
+}
+
+static void
+monitor_changed_cb (GFileMonitor *monitor,
+                    GFile *file,
+                    GFile *other_file,
+                    GFileMonitorEvent event_type,
+                    gpointer user_data)
+{
+	WatchData *watch_data = user_data;
+	gs_free char *path = NULL;
+	gs_free char *other_path = NULL;
+
+	path = g_file_get_path (file);
+	if (other_file)
+		other_path = g_file_get_path (other_file);
+
+	switch (event_type) {
+	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+	case G_FILE_MONITOR_EVENT_CREATED:
+#if GLIB_CHECK_VERSION (2, 46, 0)
+	case G_FILE_MONITOR_EVENT_MOVED_IN:
+#endif
+		if (path && is_profile_name (path))
+			schedule_reimport (watch_data, path);
+		break;
+	case G_FILE_MONITOR_EVENT_DELETED:
+#if GLIB_CHECK_VERSION (2, 46, 0)
+	case G_FILE_MONITOR_EVENT_MOVED_OUT:
+#endif
+		if (path && is_profile_name (path))
+			profile_removed (watch_data, path);
+		break;
+#if GLIB_CHECK_VERSION (2, 46, 0)
+	case G_FILE_MONITOR_EVENT_RENAMED:
+		if (path && is_profile_name (path))
+			profile_removed (watch_data, path);
+		if (other_path && is_profile_name (other_path))
+			schedule_reimport (watch_data, other_path);
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+static void
+_pending_source_remove (gpointer data)
+{
+	g_source_remove (GPOINTER_TO_UINT (data));
+}
+
+static int
+watch (const char *dirname, WatchData *watch_data)
+{
+	gs_unref_object GFile *dir = NULL;
+	gs_unref_object GFileMonitor *monitor = NULL;
+	GMainLoop *loop;
+	GError *error = NULL;
+
+	dir = g_file_new_for_path (dirname);
+#if GLIB_CHECK_VERSION (2, 46, 0)
+	monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+#else
+	/* moves are reported as deleted and created files. */
+	monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_NONE, NULL, &error);
+#endif
+	if (!monitor) {
+		g_printerr ("Error watching directory: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+
+	g_signal_connect (monitor, "changed", G_CALLBACK (monitor_changed_cb), watch_data);
+
+	if (!watch_data->quiet)
+		g_print ("watching %s for changes\n", dirname);
+
+	loop = g_main_loop_new (NULL, FALSE);
+	g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+	return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char *argv[])
+{
+	gs_unref_object NMClient *client = NULL;
+	gs_unref_ptrarray GPtrArray *results = NULL;
+	GOptionContext *context;
+	GError *error = NULL;
+	WatchData watch_data = { 0 };
+	int jobs = 0;
+	gboolean add = FALSE;
+	gboolean quiet = FALSE;
+	gboolean do_watch = FALSE;
+	gboolean is_dir;
+	ImportFileFlags flags;
+	gint64 t;
+	guint i;
+	int exit_status = EXIT_SUCCESS;
+	GOptionEntry entries[] = {
+		{ "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs, "Number of parallel imports (default: one per CPU)", "N" },
+		{ "add", 'a', 0, G_OPTION_ARG_NONE, &add, "Add the imported connections to NetworkManager, or update the existing ones", NULL },
+		{ "watch", 'w', 0, G_OPTION_ARG_NONE, &do_watch, "Keep watching the directory and apply the changes of modified files", NULL },
+		{ "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet, "Only report failures", NULL },
+		{ NULL }
+	};
+
+	setlocale (LC_ALL, "");
+
+	bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
+	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+	textdomain (GETTEXT_PACKAGE);
+
+	context = g_option_context_new ("DIRECTORY | FILE...");
+	g_option_context_add_main_entries (context, entries, NULL);
+	g_option_context_set_summary (context, "Import a bundle of OpenVPN profiles.");
+	g_option_context_set_description (context,
+	                                  "Each FILE, or each *.ovpn and *.conf file in DIRECTORY, is parsed like\n"
+	                                  "\"nmcli connection import type openvpn\" does, and failures are reported\n"
+	                                  "per file. Without --add, nothing is changed.\n"
+	                                  "\n"
+	                                  "With --add, an OpenVPN connection with the same ID (the profile's file\n"
+	                                  "name) is updated in place, keeping its UUID and the settings the profile\n"
+	                                  "doesn't cover. Otherwise a new connection is added.\n"
+	                                  "\n"
+	                                  "With --watch, the tool keeps running and re-imports modified or new\n"
+	                                  "files. Connections of removed files are left alone.\n"
+	                                  "\n"
+	                                  "Exits with 1 if any profile failed to import.");
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("Error parsing options: %s\n", error->message);
+		g_option_context_free (context);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+
+	if (argc < 2 || jobs < 0) {
+		g_printerr ("Usage: %s [-j N] [--add] [--watch] DIRECTORY | FILE...\n", g_get_prgname ());
+		return EXIT_FAILURE;
+	}
+
+	is_dir = argc == 2 && g_file_test (argv[1], G_FILE_TEST_IS_DIR);
+	if (do_watch && !is_dir) {
+		g_printerr ("--watch requires a directory\n");
+		return EXIT_FAILURE;
+	}
+
+	/* map the files of a one-time import. Those of a watched directory
+	 * may be rewritten at any time, and a mapped file that gets truncated
+	 * raises SIGBUS. */
+	flags = do_watch ? IMPORT_FILE_FLAG_NONE : IMPORT_FILE_FLAG_MMAP;
+
+	t = g_get_monotonic_time ();
+	if (is_dir) {
+		results = do_import_dir (argv[1], jobs, flags, &error);
+		if (!results) {
+			g_printerr ("Error reading directory: %s\n", error->message);
+			g_error_free (error);
+			return EXIT_FAILURE;
+		}
+	} else
+		results = do_import_files ((const char *const *) &argv[1], argc - 1, jobs, flags);
+	t = g_get_monotonic_time () - t;
+
+	if (!do_import_files_check (results, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_clear_error (&error);
+		exit_status = EXIT_FAILURE;
+	}
+
+	if (add) {
+		client = nm_client_new (NULL, &error);
+		if (!client) {
+			g_printerr ("Error connecting to NetworkManager: %s\n", error->message);
+			g_error_free (error);
+			return EXIT_FAILURE;
+		}
+	}
+
+	watch_data.client = client;
+	watch_data.quiet = quiet;
+	watch_data.connections = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	watch_data.pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, _pending_source_remove);
+
+	for (i = 0; i < results->len; i++) {
+		const ImportFileResult *result = results->pdata[i];
+
+		if (!result->connection)
+			continue;
+
+		if (!apply_connection (&watch_data, result->path, result->connection, &error)) {
+			g_printerr ("%s: failed to add or update connection: %s\n", result->path, error->message);
+			g_clear_error (&error);
+			exit_status = EXIT_FAILURE;
+		}
+	}
+
+	if (!quiet) {
+		g_print ("imported %u files in %" G_GINT64_FORMAT " msec\n",
+		         results->len, t / 1000);
+	}
+
+	if (do_watch)
+		exit_status = watch (argv[1], &watch_data);
+
+	g_hash_table_destroy (watch_data.pending);
+	g_hash_table_destroy (watch_data.connections);
+	return exit_status;
+}
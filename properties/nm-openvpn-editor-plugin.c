@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <dlfcn.h>
 
 #if ((NETWORKMANAGER_COMPILATION) & NM_NETWORKMANAGER_COMPILATION_WITH_LIBNM_UTIL)
 #include "nm-openvpn-editor.h"
@@ -42,6 +43,9 @@
 #define OPENVPN_PLUGIN_NAME    _("OpenVPN")
 #define OPENVPN_PLUGIN_DESC    _("Compatible with the OpenVPN server.")
 
+#define OPENVPN_EDITOR_MODULE  NM_PLUGIN_DIR"/libnm-vpn-plugin-openvpn-editor.so"
+#define OPENVPN_EDITOR_FACTORY "nm_vpn_editor_factory_openvpn"
+
 /*****************************************************************************/
 
 enum {
@@ -62,17 +66,7 @@ G_DEFINE_TYPE_EXTENDED (OpenvpnEditorPlugin, openvpn_editor_plugin, G_TYPE_OBJEC
 static NMConnection *
 import (NMVpnEditorPlugin *iface, const char *path, GError **error)
 {
-	NMConnection *connection = NULL;
-	char *contents = NULL;
-	gsize contents_len;
-
-	if (!g_file_get_contents (path, &contents, &contents_len, error))
-		return NULL;
-
-	connection = do_import (path, contents, contents_len, error);
-
-	g_free (contents);
-	return connection;
+	return do_import_file (path, IMPORT_FILE_FLAG_NONE, error);
 }
 
 static gboolean
@@ -121,6 +115,38 @@ _call_editor_factory (gpointer factory,
 	                                       connection,
 	                                       error);
 }
+
+/* Loads the editor module without creating an editor, so that the first
+ * get_editor() only has to construct the widgets. The handle is leaked
+ * like nm_vpn_plugin_utils_load_editor() does, whose dlopen() of the
+ * same path then just returns it. */
+static gboolean
+editor_preload_cb (gpointer user_data)
+{
+	void *dl_module;
+
+	dl_module = dlopen (OPENVPN_EDITOR_MODULE, RTLD_LAZY | RTLD_LOCAL);
+	if (!dl_module) {
+		/* get_editor() reports the error. */
+		dlerror ();
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void
+editor_preload (void)
+{
+	static gsize preloaded = 0;
+
+	/* Only preload the editor into processes that use GTK already. Others,
+	 * like nmcli, likely never ask for an editor and should not get GTK
+	 * mapped into them. */
+	if (g_once_init_enter (&preloaded)) {
+		if (dlsym (RTLD_DEFAULT, "gtk_init"))
+			g_idle_add (editor_preload_cb, NULL);
+		g_once_init_leave (&preloaded, 1);
+	}
+}
 #endif
 
 static NMVpnEditor *
@@ -134,8 +160,8 @@ get_editor (NMVpnEditorPlugin *iface, NMConnection *connection, GError **error)
 #if ((NETWORKMANAGER_COMPILATION) & NM_NETWORKMANAGER_COMPILATION_WITH_LIBNM_UTIL)
 		return openvpn_editor_new (connection, error);
 #else
-		return nm_vpn_plugin_utils_load_editor (NM_PLUGIN_DIR"/libnm-vpn-plugin-openvpn-editor.so",
-		                                        "nm_vpn_editor_factory_openvpn",
+		return nm_vpn_plugin_utils_load_editor (OPENVPN_EDITOR_MODULE,
+		                                        OPENVPN_EDITOR_FACTORY,
 		                                        _call_editor_factory,
 		                                        iface,
 		                                        connection,
@@ -207,11 +233,19 @@ openvpn_editor_plugin_class_init (OpenvpnEditorPluginClass *req_class)
 G_MODULE_EXPORT NMVpnEditorPlugin *
 nm_vpn_editor_plugin_factory (GError **error)
 {
+	NMVpnEditorPlugin *plugin;
+
 	g_return_val_if_fail (!error || !*error, NULL);
 
 	bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
 	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
 
-	return g_object_new (OPENVPN_TYPE_EDITOR_PLUGIN, NULL);
+	plugin = g_object_new (OPENVPN_TYPE_EDITOR_PLUGIN, NULL);
+
+#if !((NETWORKMANAGER_COMPILATION) & NM_NETWORKMANAGER_COMPILATION_WITH_LIBNM_UTIL)
+	editor_preload ();
+#endif
+
+	return plugin;
 }
 
@@ -38,6 +38,7 @@
 #include <unistd.h>
 
 #include "utils.h"
+#include "openvpn-caps.h"
 #include "nm-utils/nm-shared-utils.h"
 
 /*****************************************************************************/
@@ -48,7 +49,7 @@
 
 typedef void (*ChangedCallback) (GtkWidget *widget, gpointer user_data);
 
-static GtkFileFilter *sk_file_chooser_filter_new (void);
+static GtkFileFilter *sk_file_chooser_filter_new (GtkFileChooser *chooser);
 
 /*****************************************************************************/
 
@@ -264,7 +265,7 @@ sk_init_auth_widget (GtkBuilder *builder,
 	g_return_if_fail (changed_cb != NULL);
 
 	widget = GTK_WIDGET (gtk_builder_get_object (builder, "sk_key_chooser"));
-	filter = sk_file_chooser_filter_new ();
+	filter = sk_file_chooser_filter_new (GTK_FILE_CHOOSER (widget));
 	gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (widget), filter);
 	gtk_file_chooser_set_local_only (GTK_FILE_CHOOSER (widget), TRUE);
 	gtk_file_chooser_button_set_title (GTK_FILE_CHOOSER_BUTTON (widget),
@@ -449,6 +450,65 @@ auth_widget_check_validity (GtkBuilder *builder, const char *contype, GError **e
 	return TRUE;
 }
 
+static void
+_add_chooser_files (GPtrArray *files, GtkBuilder *builder, const char *name, gboolean with_key)
+{
+	NMACertChooser *chooser;
+	NMSetting8021xCKScheme scheme;
+	char *tmp;
+
+	chooser = NMA_CERT_CHOOSER (gtk_builder_get_object (builder, name));
+
+	tmp = nma_cert_chooser_get_cert (chooser, &scheme);
+	if (tmp && tmp[0] && scheme == NM_SETTING_802_1X_CK_SCHEME_PATH)
+		g_ptr_array_add (files, tmp);
+	else
+		g_free (tmp);
+
+	if (!with_key)
+		return;
+
+	tmp = nma_cert_chooser_get_key (chooser, &scheme);
+	if (tmp && tmp[0] && scheme == NM_SETTING_802_1X_CK_SCHEME_PATH)
+		g_ptr_array_add (files, tmp);
+	else
+		g_free (tmp);
+}
+
+/* The files that auth_widget_check_validity() looks at. */
+static char **
+auth_widget_get_files (GtkBuilder *builder, const char *contype)
+{
+	GPtrArray *files;
+	char namebuf[150];
+
+	files = g_ptr_array_new ();
+
+	if (NM_IN_STRSET (contype, NM_OPENVPN_CONTYPE_TLS, NM_OPENVPN_CONTYPE_PASSWORD_TLS)) {
+		const char *prefix = nm_streq (contype, NM_OPENVPN_CONTYPE_TLS) ? "tls" : "pw_tls";
+
+		nm_sprintf_buf (namebuf, "%s_ca_cert", prefix);
+		_add_chooser_files (files, builder, namebuf, FALSE);
+		nm_sprintf_buf (namebuf, "%s_user_cert", prefix);
+		_add_chooser_files (files, builder, namebuf, TRUE);
+	} else if (nm_streq0 (contype, NM_OPENVPN_CONTYPE_PASSWORD))
+		_add_chooser_files (files, builder, "pw_ca_cert", FALSE);
+	else if (nm_streq0 (contype, NM_OPENVPN_CONTYPE_STATIC_KEY)) {
+		GtkWidget *widget;
+		char *filename;
+
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "sk_key_chooser"));
+		filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
+		if (filename && filename[0])
+			g_ptr_array_add (files, filename);
+		else
+			g_free (filename);
+	}
+
+	g_ptr_array_add (files, NULL);
+	return (char **) g_ptr_array_free (files, FALSE);
+}
+
 static void
 update_from_cert_chooser (GtkBuilder *builder,
                           const char *cert_prop,
@@ -599,77 +659,296 @@ auth_widget_update_connection (GtkBuilder *builder,
 	return TRUE;
 }
 
-static const char *
-find_tag (const char *tag, const char *buf, gsize len)
+/* Browsing a directory with many *.key files, maybe on NFS, must not
+ * block the chooser. The filter itself never touches the disk: it only
+ * consults a cache per directory, which a thread fills in. The chooser
+ * is refiltered while that progresses, so the keys appear as they are
+ * found. */
+
+#define SK_KEY_BEGIN "-----BEGIN OpenVPN Static key V1-----"
+
+/* when to look at a directory again, for files that are not cached yet
+ * and for the others. */
+#define SK_FILTER_RESCAN_MISSING_USEC (1 * G_USEC_PER_SEC)
+#define SK_FILTER_RESCAN_USEC (10 * G_USEC_PER_SEC)
+#define SK_FILTER_REFILTER_USEC (200 * 1000)
+
+typedef struct {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime_sec;
+	long mtime_nsec;
+	gboolean is_key;
+} SkFileEntry;
+
+typedef struct {
+	GHashTable *files;  /* basename -> SkFileEntry */
+	gint64 scanned_at;
+	gboolean scanning;
+} SkDirEntry;
+
+G_LOCK_DEFINE_STATIC (sk_filter);
+static GHashTable *sk_filter_dirs;  /* dirname -> SkDirEntry */
+
+static void
+_sk_dir_entry_free (gpointer ptr)
+{
+	SkDirEntry *dir = ptr;
+
+	g_hash_table_unref (dir->files);
+	g_slice_free (SkDirEntry, dir);
+}
+
+static void
+_sk_file_entry_free (gpointer ptr)
+{
+	g_slice_free (SkFileEntry, ptr);
+}
+
+static gboolean
+sk_file_has_key_extension (const char *filename)
+{
+	const char *p;
+
+	p = strrchr (filename, '.');
+	return p && !g_ascii_strcasecmp (p, ".key");
+}
+
+static gboolean
+sk_file_is_static_key (const char *filename)
+{
+	char buffer[1024];
+	gssize bytes_read;
+	int fd;
+
+	fd = open (filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return FALSE;
+
+	do {
+		bytes_read = pread (fd, buffer, sizeof (buffer), 0);
+	} while (bytes_read < 0 && errno == EINTR);
+	close (fd);
+
+	if (bytes_read < 400)  /* needs to be lower? */
+		return FALSE;
+
+	return !!memmem (buffer, bytes_read, SK_KEY_BEGIN, NM_STRLEN (SK_KEY_BEGIN));
+}
+
+typedef struct {
+	char *dirname;
+	GWeakRef chooser;
+} SkScanData;
+
+static gboolean
+sk_scan_refilter (gpointer user_data)
+{
+	GtkFileChooser *chooser = user_data;
+	GtkFileFilter *filter;
+
+	/* GTK only refilters when a different filter is set */
+	filter = gtk_file_chooser_get_filter (chooser);
+	if (filter && !gtk_widget_in_destruction (GTK_WIDGET (chooser))) {
+		g_object_ref (filter);
+		g_object_set (chooser, "filter", NULL, NULL);
+		gtk_file_chooser_set_filter (chooser, filter);
+		g_object_unref (filter);
+	}
+
+	g_object_unref (chooser);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+sk_scan_schedule_refilter (SkScanData *data)
+{
+	GtkFileChooser *chooser;
+
+	chooser = g_weak_ref_get (&data->chooser);
+	if (chooser)
+		g_idle_add (sk_scan_refilter, chooser);
+}
+
+static gpointer
+sk_scan_thread (gpointer user_data)
 {
-	gsize i, taglen;
+	SkScanData *data = user_data;
+	GDir *dir;
+	const char *name;
+	gint64 refiltered_at;
+	gboolean changed = FALSE;
+
+	refiltered_at = g_get_monotonic_time ();
+
+	dir = g_dir_open (data->dirname, 0, NULL);
+	while (dir && (name = g_dir_read_name (dir))) {
+		gs_free char *path = NULL;
+		SkDirEntry *dir_entry;
+		SkFileEntry *entry;
+		struct stat st;
+		gboolean is_key = FALSE;
+		gboolean valid = FALSE;
+		gint64 now;
+
+		if (!sk_file_has_key_extension (name))
+			continue;
 
-	taglen = strlen (tag);
-	if (len < taglen)
-		return NULL;
+		path = g_build_filename (data->dirname, name, NULL);
+		if (stat (path, &st) != 0 || !S_ISREG (st.st_mode))
+			memset (&st, 0, sizeof (st));
+		else
+			valid = TRUE;
+
+		G_LOCK (sk_filter);
+		dir_entry = g_hash_table_lookup (sk_filter_dirs, data->dirname);
+		entry = g_hash_table_lookup (dir_entry->files, name);
+		if (   valid
+		    && entry
+		    && entry->dev == st.st_dev
+		    && entry->ino == st.st_ino
+		    && entry->size == st.st_size
+		    && entry->mtime_sec == st.st_mtim.tv_sec
+		    && entry->mtime_nsec == st.st_mtim.tv_nsec) {
+			G_UNLOCK (sk_filter);
+			continue;
+		}
+		G_UNLOCK (sk_filter);
+
+		if (valid)
+			is_key = sk_file_is_static_key (path);
+
+		entry = g_slice_new (SkFileEntry);
+		entry->dev = st.st_dev;
+		entry->ino = st.st_ino;
+		entry->size = st.st_size;
+		entry->mtime_sec = st.st_mtim.tv_sec;
+		entry->mtime_nsec = st.st_mtim.tv_nsec;
+		entry->is_key = is_key;
+
+		G_LOCK (sk_filter);
+		dir_entry = g_hash_table_lookup (sk_filter_dirs, data->dirname);
+		g_hash_table_insert (dir_entry->files, g_strdup (name), entry);
+		G_UNLOCK (sk_filter);
+
+		changed = TRUE;
+		now = g_get_monotonic_time ();
+		if (now - refiltered_at >= SK_FILTER_REFILTER_USEC) {
+			sk_scan_schedule_refilter (data);
+			refiltered_at = now;
+			changed = FALSE;
+		}
+	}
+	if (dir)
+		g_dir_close (dir);
+
+	G_LOCK (sk_filter);
+	{
+		SkDirEntry *dir_entry;
 
-	for (i = 0; i < len - taglen + 1; i++) {
-		if (memcmp (buf + i, tag, taglen) == 0)
-			return buf + i;
+		dir_entry = g_hash_table_lookup (sk_filter_dirs, data->dirname);
+		dir_entry->scanning = FALSE;
+		dir_entry->scanned_at = g_get_monotonic_time ();
 	}
+	G_UNLOCK (sk_filter);
+
+	if (changed)
+		sk_scan_schedule_refilter (data);
+
+	g_weak_ref_clear (&data->chooser);
+	g_free (data->dirname);
+	g_slice_free (SkScanData, data);
 	return NULL;
 }
 
-static const char *sk_key_begin = "-----BEGIN OpenVPN Static key V1-----";
-
 static gboolean
 sk_default_filter (const GtkFileFilterInfo *filter_info, gpointer data)
 {
-	int fd;
-	unsigned char buffer[1024];
-	ssize_t bytes_read;
-	gboolean show = FALSE;
-	char *p;
-	char *ext;
+	GWeakRef *chooser_ref = data;
+	gs_free char *dir_path = NULL;
+	const char *base_name;
+	SkDirEntry *dir;
+	SkFileEntry *entry;
+	gboolean show;
+	gboolean scan = FALSE;
+	gint64 now;
 
 	if (!filter_info->filename)
 		return FALSE;
 
-	p = strrchr (filter_info->filename, '.');
-	if (!p)
+	if (!sk_file_has_key_extension (filter_info->filename))
 		return FALSE;
 
-	ext = g_ascii_strdown (p, -1);
-	if (!ext)
-		return FALSE;
-	if (!g_str_has_suffix (ext, ".key")) {
-		g_free (ext);
+	base_name = strrchr (filter_info->filename, '/');
+	if (!base_name)
 		return FALSE;
+	dir_path = base_name == filter_info->filename
+	           ? g_strdup ("/")
+	           : g_strndup (filter_info->filename, base_name - filter_info->filename);
+	base_name++;
+
+	now = g_get_monotonic_time ();
+
+	G_LOCK (sk_filter);
+	if (!sk_filter_dirs)
+		sk_filter_dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, _sk_dir_entry_free);
+
+	dir = g_hash_table_lookup (sk_filter_dirs, dir_path);
+	if (!dir) {
+		dir = g_slice_new0 (SkDirEntry);
+		dir->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, _sk_file_entry_free);
+		g_hash_table_insert (sk_filter_dirs, g_strdup (dir_path), dir);
 	}
-	g_free (ext);
 
-	fd = open (filter_info->filename, O_RDONLY);
-	if (fd < 0)
-		return FALSE;
+	entry = g_hash_table_lookup (dir->files, base_name);
+	show = entry && entry->is_key;
 
-	bytes_read = read (fd, buffer, sizeof (buffer) - 1);
-	if (bytes_read < 400)  /* needs to be lower? */
-		goto out;
-	buffer[bytes_read] = '\0';
+	if (   !dir->scanning
+	    && (   !dir->scanned_at
+	        || now - dir->scanned_at >= (entry ? SK_FILTER_RESCAN_USEC : SK_FILTER_RESCAN_MISSING_USEC))) {
+		dir->scanning = TRUE;
+		scan = TRUE;
+	}
+	G_UNLOCK (sk_filter);
 
-	/* Check for PEM signatures */
-	if (find_tag (sk_key_begin, (const char *) buffer, bytes_read)) {
-		show = TRUE;
-		goto out;
+	if (scan) {
+		SkScanData *scan_data;
+		GtkFileChooser *chooser;
+
+		scan_data = g_slice_new (SkScanData);
+		scan_data->dirname = g_steal_pointer (&dir_path);
+		chooser = g_weak_ref_get (chooser_ref);
+		g_weak_ref_init (&scan_data->chooser, chooser);
+		if (chooser)
+			g_object_unref (chooser);
+		g_thread_unref (g_thread_new ("openvpn-sk-filter", sk_scan_thread, scan_data));
 	}
 
-out:
-	close (fd);
 	return show;
 }
 
+static void
+_sk_filter_data_free (gpointer data)
+{
+	GWeakRef *chooser_ref = data;
+
+	g_weak_ref_clear (chooser_ref);
+	g_slice_free (GWeakRef, chooser_ref);
+}
+
 static GtkFileFilter *
-sk_file_chooser_filter_new (void)
+sk_file_chooser_filter_new (GtkFileChooser *chooser)
 {
 	GtkFileFilter *filter;
+	GWeakRef *chooser_ref;
+
+	chooser_ref = g_slice_new (GWeakRef);
+	g_weak_ref_init (chooser_ref, chooser);
 
 	filter = gtk_file_filter_new ();
-	gtk_file_filter_add_custom (filter, GTK_FILE_FILTER_FILENAME, sk_default_filter, NULL, NULL);
+	gtk_file_filter_add_custom (filter, GTK_FILE_FILTER_FILENAME, sk_default_filter,
+	                            chooser_ref, _sk_filter_data_free);
 	gtk_file_filter_set_name (filter, _("OpenVPN Static Keys (*.key)"));
 	return filter;
 }
@@ -770,54 +1049,16 @@ checkbox_toggled_update_widget_cb (GtkWidget *check, gpointer user_data)
 	gtk_widget_set_sensitive (widget, gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (check)));
 }
 
-static const char *
-nm_find_openvpn (void)
-{
-	static const char *openvpn_binary_paths[] = {
-		"/usr/sbin/openvpn",
-		"/sbin/openvpn",
-		NULL
-	};
-	const char  **openvpn_binary = openvpn_binary_paths;
-
-	while (*openvpn_binary != NULL) {
-		if (g_file_test (*openvpn_binary, G_FILE_TEST_EXISTS))
-			break;
-		openvpn_binary++;
-	}
-
-	return *openvpn_binary;
-}
-
 #define TLS_CIPHER_COL_NAME 0
 #define TLS_CIPHER_COL_DEFAULT 1
 
 static void
-populate_cipher_combo (GtkComboBox *box, const char *user_cipher)
+populate_cipher_combo (GtkComboBox *box, const char *user_cipher, const NMOvpnCaps *caps)
 {
-	GtkListStore *store;
+	gs_unref_object GtkListStore *store = NULL;
 	GtkTreeIter iter;
-	const char *openvpn_binary = NULL;
-	gchar *tmp, **items, **item;
 	gboolean user_added = FALSE;
-	char *argv[3];
-	GError *error = NULL;
-	gboolean success, ignore_lines = TRUE;
-
-	openvpn_binary = nm_find_openvpn ();
-	if (!openvpn_binary)
-		return;
-
-	argv[0] = (char *) openvpn_binary;
-	argv[1] = "--show-ciphers";
-	argv[2] = NULL;
-
-	success = g_spawn_sync ("/", argv, NULL, 0, NULL, NULL, &tmp, NULL, NULL, &error);
-	if (!success) {
-		g_warning ("%s: couldn't determine ciphers: %s", __func__, error->message);
-		g_error_free (error);
-		return;
-	}
+	char **item;
 
 	store = gtk_list_store_new (2, G_TYPE_STRING, G_TYPE_INT);
 	gtk_combo_box_set_model (box, GTK_TREE_MODEL (store));
@@ -837,39 +1078,17 @@ populate_cipher_combo (GtkComboBox *box, const char *user_cipher)
 		user_added = TRUE;
 	}
 
-	items = g_strsplit (tmp, "\n", 0);
-	g_free (tmp);
-
-	for (item = items; *item; item++) {
-		char *space;
-
-		/* Don't add anything until after the first blank line. Also,
-		 * any blank line indicates the start of a comment, ended by
-		 * another blank line. */
-		if (!strlen (*item)) {
-			ignore_lines = !ignore_lines;
-			continue;
-		}
-
-		if (ignore_lines)
-			continue;
-
-		space = strchr (*item, ' ');
-		if (space)
-			*space = '\0';
-
+	for (item = caps ? caps->ciphers : NULL; item && *item; item++) {
 		if (strcmp (*item, "none") == 0)
 			continue;
 
-		if (strlen (*item)) {
-			gtk_list_store_append (store, &iter);
-			gtk_list_store_set (store, &iter,
-			                    TLS_CIPHER_COL_NAME, *item,
-			                    TLS_CIPHER_COL_DEFAULT, FALSE, -1);
-			if (!user_added && user_cipher && !g_ascii_strcasecmp (*item, user_cipher)) {
-				gtk_combo_box_set_active_iter (box, &iter);
-				user_added = TRUE;
-			}
+		gtk_list_store_append (store, &iter);
+		gtk_list_store_set (store, &iter,
+		                    TLS_CIPHER_COL_NAME, *item,
+		                    TLS_CIPHER_COL_DEFAULT, FALSE, -1);
+		if (!user_added && user_cipher && !g_ascii_strcasecmp (*item, user_cipher)) {
+			gtk_combo_box_set_active_iter (box, &iter);
+			user_added = TRUE;
 		}
 	}
 
@@ -883,21 +1102,20 @@ populate_cipher_combo (GtkComboBox *box, const char *user_cipher)
 	} else if (!user_added) {
 		gtk_combo_box_set_active (box, 0);
 	}
-
-	g_object_unref (G_OBJECT (store));
-	g_strfreev (items);
 }
 
 #define HMACAUTH_COL_NAME 0
 #define HMACAUTH_COL_VALUE 1
 
 static void
-populate_hmacauth_combo (GtkComboBox *box, const char *hmacauth)
+populate_hmacauth_combo (GtkComboBox *box, const char *hmacauth, const NMOvpnCaps *caps)
 {
 	gs_unref_object GtkListStore *store = NULL;
 	GtkTreeIter iter;
 	gboolean active_initialized = FALSE;
-	int i;
+	gs_free const char **names = NULL;
+	guint n_names;
+	int i, j;
 	static const struct {
 		const char *name;
 		const char *pretty_name;
@@ -913,6 +1131,22 @@ populate_hmacauth_combo (GtkComboBox *box, const char *hmacauth)
 		{ NM_OPENVPN_AUTH_RIPEMD160, N_("RIPEMD-160") },
 	};
 
+	/* offer the digests that openvpn supports. Until we know them,
+	 * fall back to the common ones. */
+	if (caps && caps->digests && caps->digests[0]) {
+		n_names = g_strv_length (caps->digests);
+		names = g_new (const char *, n_names + 1);
+		names[0] = NM_OPENVPN_AUTH_NONE;
+		for (i = 0; i < n_names; i++)
+			names[i + 1] = caps->digests[i];
+		n_names++;
+	} else {
+		n_names = G_N_ELEMENTS (items);
+		names = g_new (const char *, n_names);
+		for (i = 0; i < n_names; i++)
+			names[i] = items[i].name;
+	}
+
 	store = gtk_list_store_new (3, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_BOOLEAN);
 	gtk_combo_box_set_model (box, GTK_TREE_MODEL (store));
 
@@ -922,15 +1156,23 @@ populate_hmacauth_combo (GtkComboBox *box, const char *hmacauth)
 	                    HMACAUTH_COL_NAME, _("Default"),
 	                    -1);
 
-	for (i = 0; i < G_N_ELEMENTS (items); i++) {
-		const char *name = items[i].name;
+	for (i = 0; i < n_names; i++) {
+		const char *name = names[i];
+		const char *pretty_name = name;
+
+		for (j = 0; j < G_N_ELEMENTS (items); j++) {
+			if (!g_ascii_strcasecmp (name, items[j].name)) {
+				pretty_name = _(items[j].pretty_name);
+				break;
+			}
+		}
 
 		gtk_list_store_append (store, &iter);
 		gtk_list_store_set (store, &iter,
-		                    HMACAUTH_COL_NAME, _(items[i].pretty_name),
+		                    HMACAUTH_COL_NAME, pretty_name,
 		                    HMACAUTH_COL_VALUE, name,
 		                    -1);
-		if (hmacauth && !g_ascii_strcasecmp (name, hmacauth)) {
+		if (!active_initialized && hmacauth && !g_ascii_strcasecmp (name, hmacauth)) {
 			gtk_combo_box_set_active_iter (box, &iter);
 			active_initialized = TRUE;
 		}
@@ -1411,6 +1653,39 @@ _builder_init_toggle_button (GtkBuilder *builder,
 	return widget;
 }
 
+static void
+_builder_init_file_chooser (GtkBuilder *builder,
+                            const char *widget_name,
+                            const char *filename)
+{
+	GtkFileChooser *widget;
+
+	widget = (GtkFileChooser *) gtk_builder_get_object (builder, widget_name);
+	g_return_if_fail (GTK_IS_FILE_CHOOSER (widget));
+
+	if (filename && filename[0])
+		gtk_file_chooser_set_filename (widget, filename);
+	else
+		gtk_file_chooser_unselect_all (widget);
+}
+
+static void
+_builder_setup_optional_spinbutton (GtkBuilder *builder,
+                                    const char *checkbutton_name,
+                                    const char *spinbutton_name)
+{
+	GtkWidget *widget;
+	GtkWidget *spin;
+
+	widget = (GtkWidget *) gtk_builder_get_object (builder, checkbutton_name);
+	g_return_if_fail (GTK_IS_TOGGLE_BUTTON (widget));
+
+	spin = (GtkWidget *) gtk_builder_get_object (builder, spinbutton_name);
+	g_return_if_fail (GTK_IS_SPIN_BUTTON (spin));
+
+	g_signal_connect ((GObject *) widget, "toggled", G_CALLBACK (checkbox_toggled_update_widget_cb), spin);
+}
+
 static void
 _builder_init_optional_spinbutton (GtkBuilder *builder,
                                    const char *checkbutton_name,
@@ -1427,8 +1702,6 @@ _builder_init_optional_spinbutton (GtkBuilder *builder,
 	spin = (GtkWidget *) gtk_builder_get_object (builder, spinbutton_name);
 	g_return_if_fail (GTK_IS_SPIN_BUTTON (spin));
 
-	g_signal_connect ((GObject *) widget, "toggled", G_CALLBACK (checkbox_toggled_update_widget_cb), spin);
-
 	gtk_spin_button_set_value ((GtkSpinButton *) spin, (double) value);
 
 	gtk_widget_set_sensitive (spin, active_state);
@@ -1451,134 +1724,181 @@ ping_exit_restart_checkbox_toggled_cb (GtkWidget *check, gpointer user_data)
 #define TA_DIR_COL_NAME 0
 #define TA_DIR_COL_NUM 1
 
-static GtkWidget *
-advanced_dialog_new (GHashTable *hash, const char *contype)
+/* The advanced dialog is created once per editor and only hidden when
+ * closed. Its pages are set up and filled in when they are shown first,
+ * and only those pages are read back. The values of the other pages are
+ * passed through unchanged. */
+typedef enum {
+	ADVANCED_PAGE_GENERAL,
+	ADVANCED_PAGE_SECURITY,
+	ADVANCED_PAGE_TLS,
+	ADVANCED_PAGE_PROXY,
+	ADVANCED_PAGE_MISC,
+	_ADVANCED_PAGE_NUM,
+} AdvancedPage;
+
+#define ADVANCED_PAGE_BIT(page) (1u << (page))
+
+static guint
+advanced_dialog_get_pages (GtkWidget *dialog, const char *what)
+{
+	return GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (dialog), what));
+}
+
+static void
+advanced_dialog_set_pages (GtkWidget *dialog, const char *what, guint pages)
+{
+	g_object_set_data (G_OBJECT (dialog), what, GUINT_TO_POINTER (pages));
+}
+
+static gboolean
+advanced_dialog_has_tls_page (const char *contype)
+{
+	return NM_IN_STRSET (contype,
+	                     NM_OPENVPN_CONTYPE_TLS,
+	                     NM_OPENVPN_CONTYPE_PASSWORD_TLS,
+	                     NM_OPENVPN_CONTYPE_PASSWORD);
+}
+
+/* the capabilities of openvpn are known now. Refill the lists,
+ * keeping what is selected. */
+static void
+advanced_dialog_caps_cb (NMOvpnCaps *caps, gpointer user_data)
 {
+	GtkWidget *dialog = user_data;
 	GtkBuilder *builder;
-	GtkWidget *dialog = NULL;
-	GtkWidget *widget, *combo, *spin, *entry, *ok_button;
-	const char *value, *value2, *value3;
-	const char *dev, *dev_type, *tap_dev;
-	GtkListStore *store;
+	GtkComboBox *combo;
 	GtkTreeIter iter;
-	int vint;
-	guint32 active;
-	NMSettingSecretFlags pw_flags;
-	GError *error = NULL;
-	NMOvpnComp comp;
+	gs_free char *cipher = NULL;
+	gs_free char *hmacauth = NULL;
+	gboolean is_default = TRUE;
 
-	g_return_val_if_fail (hash != NULL, NULL);
+	if (!caps)
+		return;
 
-	builder = gtk_builder_new ();
+	/* not filled in yet. That will pick up the cached capabilities. */
+	if (!(advanced_dialog_get_pages (dialog, "pages-loaded") & ADVANCED_PAGE_BIT (ADVANCED_PAGE_SECURITY)))
+		return;
 
-	gtk_builder_set_translation_domain (builder, GETTEXT_PACKAGE);
+	builder = g_object_get_data (G_OBJECT (dialog), "builder");
 
-	if (!gtk_builder_add_from_resource (builder, "/org/freedesktop/network-manager-openvpn/nm-openvpn-dialog.ui", &error)) {
-		g_error_free (error);
-		g_object_unref (G_OBJECT (builder));
-		g_return_val_if_reached (NULL);
+	combo = GTK_COMBO_BOX (gtk_builder_get_object (builder, "cipher_combo"));
+	if (gtk_combo_box_get_active_iter (combo, &iter)) {
+		gtk_tree_model_get (gtk_combo_box_get_model (combo), &iter,
+		                    TLS_CIPHER_COL_NAME, &cipher,
+		                    TLS_CIPHER_COL_DEFAULT, &is_default, -1);
 	}
+	populate_cipher_combo (combo, is_default ? NULL : cipher, caps);
 
-	dialog = GTK_WIDGET (gtk_builder_get_object (builder, "openvpn-advanced-dialog"));
-	if (!dialog) {
-		g_object_unref (G_OBJECT (builder));
-		g_return_val_if_reached (NULL);
+	combo = GTK_COMBO_BOX (gtk_builder_get_object (builder, "hmacauth_combo"));
+	if (gtk_combo_box_get_active_iter (combo, &iter)) {
+		gtk_tree_model_get (gtk_combo_box_get_model (combo), &iter,
+		                    HMACAUTH_COL_VALUE, &hmacauth, -1);
 	}
-	gtk_window_set_modal (GTK_WINDOW (dialog), TRUE);
+	populate_hmacauth_combo (combo, hmacauth, caps);
+}
 
-	g_object_set_data_full (G_OBJECT (dialog), "builder",
-	                        builder, (GDestroyNotify) g_object_unref);
-	g_object_set_data_full (G_OBJECT (dialog), "connection-type", g_strdup (contype), g_free);
+/*****************************************************************************/
 
-	ok_button = GTK_WIDGET (gtk_builder_get_object (builder, "ok_button"));
+static const char *const advanced_page_general_keys[] = {
+	NM_OPENVPN_KEY_ALLOW_PULL_FQDN,
+	NM_OPENVPN_KEY_COMPRESS,
+	NM_OPENVPN_KEY_COMP_LZO,
+	NM_OPENVPN_KEY_DEV,
+	NM_OPENVPN_KEY_DEV_TYPE,
+	NM_OPENVPN_KEY_FLOAT,
+	NM_OPENVPN_KEY_FRAGMENT_SIZE,
+	NM_OPENVPN_KEY_MAX_ROUTES,
+	NM_OPENVPN_KEY_MSSFIX,
+	NM_OPENVPN_KEY_PING,
+	NM_OPENVPN_KEY_PING_EXIT,
+	NM_OPENVPN_KEY_PING_RESTART,
+	NM_OPENVPN_KEY_PORT,
+	NM_OPENVPN_KEY_PROTO_TCP,
+	NM_OPENVPN_KEY_REMOTE_RANDOM,
+	NM_OPENVPN_KEY_REMOTE_RANDOM_HOSTNAME,
+	NM_OPENVPN_KEY_RENEG_SECONDS,
+	NM_OPENVPN_KEY_TAP_DEV,
+	NM_OPENVPN_KEY_TUNNEL_MTU,
+	NM_OPENVPN_KEY_TUN_IPV6,
+	NULL,
+};
 
+static void
+advanced_page_general_setup (GtkBuilder *builder)
+{
+	GtkWidget *widget, *combo, *entry, *ok_button;
+	GtkListStore *store;
+	GtkTreeIter iter;
 
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_RENEG_SECONDS);
-	_builder_init_optional_spinbutton (builder, "reneg_checkbutton", "reneg_spinbutton", !!value,
-	                                   _nm_utils_ascii_str_to_int64 (value, 10, 0, G_MAXINT, 0));
+	ok_button = GTK_WIDGET (gtk_builder_get_object (builder, "ok_button"));
 
+	_builder_setup_optional_spinbutton (builder, "port_checkbutton", "port_spinbutton");
+	_builder_setup_optional_spinbutton (builder, "reneg_checkbutton", "reneg_spinbutton");
+	_builder_setup_optional_spinbutton (builder, "tunmtu_checkbutton", "tunmtu_spinbutton");
+	_builder_setup_optional_spinbutton (builder, "fragment_checkbutton", "fragment_spinbutton");
+	_builder_setup_optional_spinbutton (builder, "ping_checkbutton", "ping_spinbutton");
+	_builder_setup_optional_spinbutton (builder, "max_routes_checkbutton", "max_routes_spinbutton");
 
-	/* Proxy support */
-	combo = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_type_combo"));
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "compress_combo"));
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "compress_checkbutton"));
+	g_object_bind_property (widget, "active", combo, "sensitive", G_BINDING_SYNC_CREATE);
 
-	store = gtk_list_store_new (1, G_TYPE_STRING);
-	gtk_list_store_append (store, &iter);
-	gtk_list_store_set (store, &iter, 0, _("Not required"), -1);
+	/* Device-related widgets */
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "dev_checkbutton"));
+	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (dev_checkbox_toggled_cb), builder);
+
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "dev_type_combo"));
+	store = gtk_list_store_new (1, G_TYPE_STRING);
 	gtk_list_store_append (store, &iter);
-	gtk_list_store_set (store, &iter, 0, _("HTTP"), -1);
+	gtk_list_store_set (store, &iter, 0, _("TUN"), -1);
 	gtk_list_store_append (store, &iter);
-	gtk_list_store_set (store, &iter, 0, _("SOCKS"), -1);
-
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PROXY_SERVER);
-	value2 = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PROXY_PORT);
-	if (   value && *value
-	    && value2 && *value2) {
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_server_entry"));
-		gtk_entry_set_text (GTK_ENTRY (widget), value);
-
-		vint = _nm_utils_ascii_str_to_int64 (value2, 10, 0, 65535, 0);
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_port_spinbutton"));
-		gtk_spin_button_set_value (GTK_SPIN_BUTTON (widget), (gdouble) vint);
-
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_retry_checkbutton"));
-		value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PROXY_RETRY);
-		if (value && !strcmp (value, "yes"))
-			gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (widget), TRUE);
-
-		value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_HTTP_PROXY_USERNAME);
-		if (value && *value) {
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_username_entry"));
-			gtk_entry_set_text (GTK_ENTRY (widget), value);
-		}
-
-		value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD);
-		if (value && *value) {
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_password_entry"));
-			gtk_entry_set_text (GTK_ENTRY (widget), value);
-		}
-
-		value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD_FLAGS);
-		G_STATIC_ASSERT_EXPR (((guint) (NMSettingSecretFlags) 0xFFFFu) == 0xFFFFu);
-		pw_flags = _nm_utils_ascii_str_to_int64 (value, 10, 0, 0xFFFF, NM_SETTING_SECRET_FLAG_NONE);
-	} else
-		pw_flags = NM_SETTING_SECRET_FLAG_NONE;
+	gtk_list_store_set (store, &iter, 0, _("TAP"), -1);
+	gtk_combo_box_set_model (GTK_COMBO_BOX (combo), GTK_TREE_MODEL (store));
+	g_object_unref (store);
 
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_password_entry"));
-	nma_utils_setup_password_storage (widget, pw_flags, NULL, NULL,
-	                                  TRUE, FALSE);
+	entry = GTK_WIDGET (gtk_builder_get_object (builder, "dev_entry"));
+	gtk_entry_set_max_length (GTK_ENTRY (entry), 15);  /* interface name is max 15 chars */
+	gtk_entry_set_placeholder_text (GTK_ENTRY (entry), _("(automatic)"));
+	g_signal_connect (G_OBJECT (entry), "insert-text", G_CALLBACK (device_name_filter_cb), NULL);
+	g_signal_connect (G_OBJECT (entry), "changed", G_CALLBACK (device_name_changed_cb), ok_button);
 
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PROXY_TYPE);
-	active = PROXY_TYPE_NONE;
-	if (value) {
-		if (!strcmp (value, "http"))
-			active = PROXY_TYPE_HTTP;
-		else if (!strcmp (value, "socks"))
-			active = PROXY_TYPE_SOCKS;
-	}
+	/* ping-exit / ping-restart */
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_checkbutton"));
+	g_signal_connect ((GObject *) widget, "toggled", G_CALLBACK (ping_exit_restart_checkbox_toggled_cb), builder);
 
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_combo"));
+	store = gtk_list_store_new (1, G_TYPE_STRING);
+	gtk_list_store_append (store, &iter);
+	gtk_list_store_set (store, &iter, 0, _("ping-exit"), -1);
+	gtk_list_store_append (store, &iter);
+	gtk_list_store_set (store, &iter, 0, _("ping-restart"), -1);
 	gtk_combo_box_set_model (GTK_COMBO_BOX (combo), GTK_TREE_MODEL (store));
 	g_object_unref (store);
-	gtk_combo_box_set_active (GTK_COMBO_BOX (combo), active);
-	proxy_type_changed (GTK_COMBO_BOX (combo), builder);
-	g_signal_connect (G_OBJECT (combo), "changed", G_CALLBACK (proxy_type_changed), builder);
+}
 
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "show_proxy_password"));
-	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (show_proxy_password_toggled_cb), builder);
+static void
+advanced_page_general_load (GtkWidget *dialog, GtkBuilder *builder, GHashTable *hash)
+{
+	GtkWidget *widget, *combo, *spin, *entry;
+	const char *value;
+	const char *dev, *dev_type, *tap_dev;
+	guint32 active;
+	gboolean proxy;
+	NMOvpnComp comp;
 
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_RENEG_SECONDS);
+	_builder_init_optional_spinbutton (builder, "reneg_checkbutton", "reneg_spinbutton", !!value,
+	                                   _nm_utils_ascii_str_to_int64 (value, 10, 0, G_MAXINT, 0));
 
 	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PORT);
 	_builder_init_optional_spinbutton (builder, "port_checkbutton", "port_spinbutton", !!value,
 	                                   _nm_utils_ascii_str_to_int64 (value, 10, 1, 65535, 1194));
 
-
 	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TUNNEL_MTU);
 	_builder_init_optional_spinbutton (builder, "tunmtu_checkbutton", "tunmtu_spinbutton", !!value,
 	                                   _nm_utils_ascii_str_to_int64 (value, 10, 1, 65535, 1500));
 
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_CONNECT_TIMEOUT);
-	_builder_init_optional_spinbutton (builder, "connect_timeout_checkbutton", "connect_timeout_spinbutton", !!value,
-	                                   _nm_utils_ascii_str_to_int64 (value, 10, 0, G_MAXINT, 120));
-
 	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_FRAGMENT_SIZE);
 	_builder_init_optional_spinbutton (builder, "fragment_checkbutton", "fragment_spinbutton", !!value,
 	                                   _nm_utils_ascii_str_to_int64 (value, 10, 0, 65535, 1300));
@@ -1587,15 +1907,18 @@ advanced_dialog_new (GHashTable *hash, const char *contype)
 	                                        g_hash_table_lookup (hash, NM_OPENVPN_KEY_COMPRESS));
 
 	combo = GTK_WIDGET (gtk_builder_get_object (builder, "compress_combo"));
-	widget = GTK_WIDGET (_builder_init_toggle_button (builder, "compress_checkbutton", comp != NMOVPN_COMP_DISABLED));
-	g_object_bind_property (widget, "active", combo, "sensitive", G_BINDING_SYNC_CREATE);
-	if (comp != NMOVPN_COMP_DISABLED)
-		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), comp - 1);
+	_builder_init_toggle_button (builder, "compress_checkbutton", comp != NMOVPN_COMP_DISABLED);
+	gtk_combo_box_set_active (GTK_COMBO_BOX (combo),
+	                          comp != NMOVPN_COMP_DISABLED ? comp - 1 : 0);
 
 	_builder_init_toggle_button (builder, "mssfix_checkbutton", _hash_get_boolean (hash, NM_OPENVPN_KEY_MSSFIX));
 	_builder_init_toggle_button (builder, "float_checkbutton", _hash_get_boolean (hash, NM_OPENVPN_KEY_FLOAT));
-	_builder_init_toggle_button (builder, "tcp_checkbutton", _hash_get_boolean (hash, NM_OPENVPN_KEY_PROTO_TCP));
-	_builder_init_toggle_button (builder, "ncp_disable_checkbutton", _hash_get_boolean (hash, NM_OPENVPN_KEY_NCP_DISABLE));
+	/* A proxy requires TCP. That is enforced by proxy_type_changed(), but
+	 * the proxy page might not have been shown yet. */
+	proxy = NM_IN_STRSET (g_hash_table_lookup (hash, NM_OPENVPN_KEY_PROXY_TYPE), "http", "socks");
+	widget = GTK_WIDGET (_builder_init_toggle_button (builder, "tcp_checkbutton",
+	                                                  proxy || _hash_get_boolean (hash, NM_OPENVPN_KEY_PROTO_TCP)));
+	gtk_widget_set_sensitive (widget, !proxy);
 
 	/* Populate device-related widgets */
 	dev =      g_hash_table_lookup (hash, NM_OPENVPN_KEY_DEV);
@@ -1605,144 +1928,31 @@ advanced_dialog_new (GHashTable *hash, const char *contype)
 	widget = GTK_WIDGET (gtk_builder_get_object (builder, "dev_checkbutton"));
 	gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (widget), (dev && *dev) || dev_type || tap_dev);
 	dev_checkbox_toggled_cb (widget, builder);
-	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (dev_checkbox_toggled_cb), builder);
+
 	combo = GTK_WIDGET (gtk_builder_get_object (builder, "dev_type_combo"));
 	active = DEVICE_TYPE_IDX_TUN;
 	if (   !g_strcmp0 (dev_type, "tap")
 	    || (!dev_type && dev && g_str_has_prefix (dev, "tap"))
 	    || (!dev_type && !g_strcmp0 (tap_dev, "yes")))
 		active = DEVICE_TYPE_IDX_TAP;
-
-	store = gtk_list_store_new (1, G_TYPE_STRING);
-	gtk_list_store_append (store, &iter);
-	gtk_list_store_set (store, &iter, 0, _("TUN"), -1);
-	gtk_list_store_append (store, &iter);
-	gtk_list_store_set (store, &iter, 0, _("TAP"), -1);
-	gtk_combo_box_set_model (GTK_COMBO_BOX (combo), GTK_TREE_MODEL (store));
-	g_object_unref (store);
 	gtk_combo_box_set_active (GTK_COMBO_BOX (combo), active);
 
 	entry = GTK_WIDGET (gtk_builder_get_object (builder, "dev_entry"));
-	gtk_entry_set_max_length (GTK_ENTRY (entry), 15);  /* interface name is max 15 chars */
-	gtk_entry_set_placeholder_text (GTK_ENTRY (entry), _("(automatic)"));
-	g_signal_connect (G_OBJECT (entry), "insert-text", G_CALLBACK (device_name_filter_cb), NULL);
-	g_signal_connect (G_OBJECT (entry), "changed", G_CALLBACK (device_name_changed_cb), ok_button);
 	gtk_entry_set_text (GTK_ENTRY (entry), dev ?: "");
 
-
 	_builder_init_toggle_button (builder, "remote_random_checkbutton", _hash_get_boolean (hash, NM_OPENVPN_KEY_REMOTE_RANDOM));
 	_builder_init_toggle_button (builder, "remote_random_hostname_checkbutton", _hash_get_boolean (hash, NM_OPENVPN_KEY_REMOTE_RANDOM_HOSTNAME));
 	_builder_init_toggle_button (builder, "allow_pull_fqdn_checkbutton", _hash_get_boolean (hash, NM_OPENVPN_KEY_ALLOW_PULL_FQDN));
 	_builder_init_toggle_button (builder, "tun_ipv6_checkbutton", _hash_get_boolean (hash, NM_OPENVPN_KEY_TUN_IPV6));
 
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "cipher_combo"));
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_CIPHER);
-	populate_cipher_combo (GTK_COMBO_BOX (widget), value);
-
-
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_KEYSIZE);
-	_builder_init_optional_spinbutton (builder, "keysize_checkbutton", "keysize_spinbutton", !!value,
-	                                   _nm_utils_ascii_str_to_int64 (value, 10, 1, 65535, 128));
-
-
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "hmacauth_combo"));
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_AUTH);
-	populate_hmacauth_combo (GTK_COMBO_BOX (widget), value);
-
-	entry = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_entry"));
-	combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_mode_combo"));
-	populate_tls_remote_mode_entry_combo (GTK_ENTRY (entry), GTK_COMBO_BOX (combo),
-	                                      g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_REMOTE),
-	                                      g_hash_table_lookup (hash, NM_OPENVPN_KEY_VERIFY_X509_NAME));
-	g_signal_connect (G_OBJECT (entry), "changed", G_CALLBACK (tls_remote_changed), builder);
-	g_signal_connect (G_OBJECT (combo), "changed", G_CALLBACK (tls_remote_changed), builder);
-	tls_remote_changed (entry, builder);
-
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "remote_cert_tls_checkbutton"));
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_REMOTE_CERT_TLS);
-	if (value && *value)
-		gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (widget), TRUE);
-	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (remote_tls_cert_toggled_cb), builder);
-	remote_tls_cert_toggled_cb (widget, builder);
-
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "remote_cert_tls_combo"));
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_REMOTE_CERT_TLS);
-	populate_remote_cert_tls_combo (GTK_COMBO_BOX (widget), value);
-
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ns_cert_type_checkbutton"));
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_NS_CERT_TYPE);
-	if (value && *value)
-		gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (widget), TRUE);
-	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (ns_cert_type_toggled_cb), builder);
-	ns_cert_type_toggled_cb (widget, builder);
-
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ns_cert_type_combo"));
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_NS_CERT_TYPE);
-	populate_ns_cert_type_combo (GTK_COMBO_BOX (widget), value);
-
-	if (NM_IN_STRSET (contype,
-	                  NM_OPENVPN_CONTYPE_TLS,
-	                  NM_OPENVPN_CONTYPE_PASSWORD_TLS,
-	                  NM_OPENVPN_CONTYPE_PASSWORD)) {
-		/* Initialize direction combo */
-		combo = GTK_WIDGET (gtk_builder_get_object (builder, "direction_combo"));
-		store = gtk_list_store_new (2, G_TYPE_STRING, G_TYPE_INT);
-		gtk_list_store_append (store, &iter);
-		gtk_list_store_set (store, &iter, TA_DIR_COL_NAME, _("None"), TA_DIR_COL_NUM, -1, -1);
-		gtk_list_store_append (store, &iter);
-		gtk_list_store_set (store, &iter, TA_DIR_COL_NAME, "0", TA_DIR_COL_NUM, 0, -1);
-		gtk_list_store_append (store, &iter);
-		gtk_list_store_set (store, &iter, TA_DIR_COL_NAME, "1", TA_DIR_COL_NUM, 1, -1);
-		gtk_combo_box_set_model (GTK_COMBO_BOX (combo), GTK_TREE_MODEL (store));
-		g_object_unref (store);
-		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), 0);
-
-		combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_mode"));
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_chooser"));
-		value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TA);
-		value2 = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_CRYPT);
-		value3 = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_CRYPT_V2);
-		if (value3 && value3[0]) {
-			gtk_combo_box_set_active (GTK_COMBO_BOX (combo), TLS_AUTH_MODE_CRYPT_V2);
-			gtk_file_chooser_set_filename (GTK_FILE_CHOOSER (widget), value3);
-		} else if (value2 && value2[0]) {
-			gtk_combo_box_set_active (GTK_COMBO_BOX (combo), TLS_AUTH_MODE_CRYPT);
-			gtk_file_chooser_set_filename (GTK_FILE_CHOOSER (widget), value2);
-		} else if (value && value[0]) {
-			int direction;
-
-			gtk_combo_box_set_active (GTK_COMBO_BOX (combo), TLS_AUTH_MODE_AUTH);
-			gtk_file_chooser_set_filename (GTK_FILE_CHOOSER (widget), value);
-			value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TA_DIR);
-			direction = _nm_utils_ascii_str_to_int64 (value, 10, 0, 1, -1);
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "direction_combo"));
-			gtk_combo_box_set_active (GTK_COMBO_BOX (widget), direction + 1);
-		} else
-			gtk_combo_box_set_active (GTK_COMBO_BOX (combo), TLS_AUTH_MODE_NONE);
-
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "extra_certs_chooser"));
-		value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_EXTRA_CERTS);
-		if (value && value[0])
-			gtk_file_chooser_set_filename (GTK_FILE_CHOOSER (widget), value);
-
-		g_signal_connect (G_OBJECT (combo), "changed", G_CALLBACK (tls_auth_toggled_cb), builder);
-		tls_auth_toggled_cb (combo, builder);
-	} else {
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "options_notebook"));
-		gtk_notebook_remove_page (GTK_NOTEBOOK (widget), 2);
-	}
-
-
 	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PING);
 	_builder_init_optional_spinbutton (builder, "ping_checkbutton", "ping_spinbutton", !!value,
 	                                   _nm_utils_ascii_str_to_int64 (value, 10, 1, 65535, 30));
 
-
 	/* ping-exit / ping-restart */
 	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_checkbutton"));
 	spin = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_spinbutton"));
 	combo = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_combo"));
-	g_signal_connect ((GObject *) widget, "toggled", G_CALLBACK (ping_exit_restart_checkbox_toggled_cb), builder);
 
 	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PING_EXIT);
 	active = PING_EXIT;
@@ -1752,99 +1962,23 @@ advanced_dialog_new (GHashTable *hash, const char *contype)
 			active = PING_RESTART;
 	}
 
-	store = gtk_list_store_new (1, G_TYPE_STRING);
-	gtk_list_store_append (store, &iter);
-	gtk_list_store_set (store, &iter, 0, _("ping-exit"), -1);
-	gtk_list_store_append (store, &iter);
-	gtk_list_store_set (store, &iter, 0, _("ping-restart"), -1);
-	gtk_combo_box_set_model (GTK_COMBO_BOX (combo), GTK_TREE_MODEL (store));
-	g_object_unref (store);
 	gtk_combo_box_set_active ((GtkComboBox *) combo, active);
-
 	gtk_spin_button_set_value ((GtkSpinButton *) spin,
 	                           (double) _nm_utils_ascii_str_to_int64 (value, 10, 1, 65535, 30));
 	gtk_widget_set_sensitive (combo, !!value);
 	gtk_widget_set_sensitive (spin, !!value);
 	gtk_toggle_button_set_active ((GtkToggleButton *) widget, !!value);
 
-	/* MTU discovery */
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "mtu_disc_checkbutton"));
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_MTU_DISC);
-	if (value && value[0]) {
-		gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (widget), TRUE);
-		combo = GTK_WIDGET (gtk_builder_get_object (builder, "mtu_disc_combo"));
-		if (nm_streq (value, "maybe"))
-			gtk_combo_box_set_active (GTK_COMBO_BOX (combo), 1);
-		else if (nm_streq (value, "yes"))
-			gtk_combo_box_set_active (GTK_COMBO_BOX (combo), 2);
-		else
-			gtk_combo_box_set_active (GTK_COMBO_BOX (combo), 0);
-	}
-	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (mtu_disc_toggled_cb), builder);
-	mtu_disc_toggled_cb (widget, builder);
-
-	/* CRL */
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_CRL_VERIFY_FILE);
-	if (value) {
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_file_check"));
-		gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (widget), TRUE);
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_file_chooser"));
-		gtk_file_chooser_set_filename (GTK_FILE_CHOOSER (widget), value);
-	} else {
-		value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_CRL_VERIFY_DIR);
-		if (value) {
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_dir_check"));
-			gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (widget), TRUE);
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_dir_chooser"));
-			gtk_file_chooser_set_filename (GTK_FILE_CHOOSER (widget), value);
-		}
-	}
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_file_check"));
-	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (crl_file_checkbox_toggled_cb), builder);
-	crl_file_checkbox_toggled_cb (widget, builder);
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_dir_check"));
-	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (crl_dir_checkbox_toggled_cb), builder);
-	crl_dir_checkbox_toggled_cb (widget, builder);
-
 	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_MAX_ROUTES);
 	_builder_init_optional_spinbutton (builder, "max_routes_checkbutton", "max_routes_spinbutton", !!value,
 	                                   _nm_utils_ascii_str_to_int64 (value, 10, 0, 100000000, 100));
-
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_VERSION_MIN);
-	if (value && *value) {
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_version_min"));
-		gtk_entry_set_text (GTK_ENTRY (widget), value);
-	}
-	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_VERSION_MAX);
-	if (value && *value) {
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_version_max"));
-		gtk_entry_set_text (GTK_ENTRY (widget), value);
-	}
-
-	_builder_init_toggle_button (builder, "push_peer_info_checkbutton",
-	                             _hash_get_boolean (hash, NM_OPENVPN_KEY_PUSH_PEER_INFO));
-
-	return dialog;
 }
 
-static GHashTable *
-advanced_dialog_new_hash_from_dialog (GtkWidget *dialog)
+static void
+advanced_page_general_store (GtkBuilder *builder, GHashTable *hash)
 {
-	GHashTable *hash;
-	GtkWidget *widget, *entry, *combo;
-	GtkBuilder *builder;
-	const char *contype = NULL;
+	GtkWidget *widget, *combo;
 	const char *value;
-	int proxy_type = PROXY_TYPE_NONE;
-	GtkTreeModel *model;
-	GtkTreeIter iter;
-
-	g_return_val_if_fail (dialog, NULL);
-
-	builder = g_object_get_data (G_OBJECT (dialog), "builder");
-	g_return_val_if_fail (builder, NULL);
-
-	hash = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
 
 	widget = GTK_WIDGET (gtk_builder_get_object (builder, "reneg_checkbutton"));
 	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
@@ -1864,15 +1998,6 @@ advanced_dialog_new_hash_from_dialog (GtkWidget *dialog)
 		g_hash_table_insert (hash, NM_OPENVPN_KEY_TUNNEL_MTU, g_strdup_printf ("%d", tunmtu_size));
 	}
 
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "connect_timeout_checkbutton"));
-	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
-		int timeout;
-
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "connect_timeout_spinbutton"));
-		timeout = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
-		g_hash_table_insert (hash, NM_OPENVPN_KEY_CONNECT_TIMEOUT, g_strdup_printf ("%d", timeout));
-	}
-
 	widget = GTK_WIDGET (gtk_builder_get_object (builder, "fragment_checkbutton"));
 	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
 		int fragment_size;
@@ -1891,56 +2016,6 @@ advanced_dialog_new_hash_from_dialog (GtkWidget *dialog)
 		g_hash_table_insert (hash, NM_OPENVPN_KEY_PORT, g_strdup_printf ("%d", port));
 	}
 
-	/* Proxy support */
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_type_combo"));
-	proxy_type = gtk_combo_box_get_active (GTK_COMBO_BOX (widget));
-	if (proxy_type != PROXY_TYPE_NONE) {
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_server_entry"));
-		value = gtk_entry_get_text (GTK_ENTRY (widget));
-		if (value && *value) {
-			int proxy_port;
-
-			if (proxy_type == PROXY_TYPE_HTTP)
-				g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_TYPE, g_strdup ("http"));
-			else if (proxy_type == PROXY_TYPE_SOCKS)
-				g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_TYPE, g_strdup ("socks"));
-
-			g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_SERVER, g_strdup (value));
-
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_port_spinbutton"));
-			proxy_port = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
-			if (proxy_port > 0) {
-				g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_PORT,
-				                     g_strdup_printf ("%d", proxy_port));
-			}
-
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_retry_checkbutton"));
-			if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
-				g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_RETRY, g_strdup ("yes"));
-
-			if (proxy_type == PROXY_TYPE_HTTP) {
-				guint32 pw_flags;
-
-				widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_username_entry"));
-				value = gtk_entry_get_text (GTK_ENTRY (widget));
-				if (value && *value)
-					g_hash_table_insert (hash, NM_OPENVPN_KEY_HTTP_PROXY_USERNAME, g_strdup (value));
-
-				widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_password_entry"));
-				value = gtk_entry_get_text (GTK_ENTRY (widget));
-				if (value && *value)
-					g_hash_table_insert (hash, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD, g_strdup (value));
-
-				pw_flags = nma_utils_menu_to_secret_flags (widget);
-				if (pw_flags != NM_SETTING_SECRET_FLAG_NONE) {
-					g_hash_table_insert (hash,
-					                     NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD_FLAGS,
-					                     g_strdup_printf ("%d", pw_flags));
-				}
-			}
-		}
-	}
-
 	widget = GTK_WIDGET (gtk_builder_get_object (builder, "compress_checkbutton"));
 	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
 		const char *opt_compress;
@@ -1968,10 +2043,6 @@ advanced_dialog_new_hash_from_dialog (GtkWidget *dialog)
 	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
 		g_hash_table_insert (hash, NM_OPENVPN_KEY_PROTO_TCP, g_strdup ("yes"));
 
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ncp_disable_checkbutton"));
-	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
-		g_hash_table_insert (hash, NM_OPENVPN_KEY_NCP_DISABLE, g_strdup ("yes"));
-
 	widget = GTK_WIDGET (gtk_builder_get_object (builder, "dev_checkbutton"));
 	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
 		int device_type;
@@ -2004,15 +2075,135 @@ advanced_dialog_new_hash_from_dialog (GtkWidget *dialog)
 	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
 		g_hash_table_insert (hash, NM_OPENVPN_KEY_TUN_IPV6, g_strdup ("yes"));
 
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "cipher_combo"));
-	model = gtk_combo_box_get_model (GTK_COMBO_BOX (widget));
-	if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter)) {
-		gs_free char *cipher = NULL;
-		gboolean is_default;
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_checkbutton"));
+	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
+		int ping_val;
 
-		gtk_tree_model_get (model, &iter,
-		                    TLS_CIPHER_COL_NAME, &cipher,
-		                    TLS_CIPHER_COL_DEFAULT, &is_default, -1);
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_spinbutton"));
+		ping_val = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+
+		g_hash_table_insert (hash,
+		                     NM_OPENVPN_KEY_PING,
+		                     g_strdup_printf ("%d", ping_val));
+	}
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_checkbutton"));
+	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
+		int ping_exit_type, ping_val;
+
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_combo"));
+		ping_exit_type = gtk_combo_box_get_active (GTK_COMBO_BOX (widget));
+
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_spinbutton"));
+		ping_val = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+
+		g_hash_table_insert (hash,
+		                     ping_exit_type == PING_EXIT
+		                       ? NM_OPENVPN_KEY_PING_EXIT
+		                       : NM_OPENVPN_KEY_PING_RESTART,
+		                     g_strdup_printf ("%d", ping_val));
+	}
+
+	/* max routes */
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "max_routes_checkbutton"));
+	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
+		int max_routes;
+
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "max_routes_spinbutton"));
+		max_routes = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+		g_hash_table_insert (hash, NM_OPENVPN_KEY_MAX_ROUTES, g_strdup_printf ("%d", max_routes));
+	}
+}
+
+/*****************************************************************************/
+
+static const char *const advanced_page_security_keys[] = {
+	NM_OPENVPN_KEY_AUTH,
+	NM_OPENVPN_KEY_CIPHER,
+	NM_OPENVPN_KEY_CRL_VERIFY_DIR,
+	NM_OPENVPN_KEY_CRL_VERIFY_FILE,
+	NM_OPENVPN_KEY_KEYSIZE,
+	NM_OPENVPN_KEY_NCP_DISABLE,
+	NULL,
+};
+
+static void
+advanced_page_security_setup (GtkBuilder *builder)
+{
+	GtkWidget *widget;
+
+	_builder_setup_optional_spinbutton (builder, "keysize_checkbutton", "keysize_spinbutton");
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_file_check"));
+	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (crl_file_checkbox_toggled_cb), builder);
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_dir_check"));
+	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (crl_dir_checkbox_toggled_cb), builder);
+}
+
+static void
+advanced_page_security_load (GtkWidget *dialog, GtkBuilder *builder, GHashTable *hash)
+{
+	GtkWidget *widget;
+	const char *value, *value2;
+	NMOvpnCaps *caps;
+
+	/* don't wait for openvpn to tell us what it supports. If the
+	 * capabilities are not cached, the lists get updated later. */
+	caps = nmovpn_caps_get (NULL, NULL, NMOVPN_CAPS_PROBE_NONE);
+	if (!caps && !g_object_get_data (G_OBJECT (dialog), "caps-cancellable")) {
+		GCancellable *cancellable = g_cancellable_new ();
+
+		g_object_set_data_full (G_OBJECT (dialog), "caps-cancellable",
+		                        cancellable, (GDestroyNotify) g_object_unref);
+		g_signal_connect_swapped (dialog, "destroy", G_CALLBACK (g_cancellable_cancel), cancellable);
+		nmovpn_caps_refresh_async (NULL, NULL, cancellable, advanced_dialog_caps_cb, dialog);
+	}
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "cipher_combo"));
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_CIPHER);
+	populate_cipher_combo (GTK_COMBO_BOX (widget), value, caps);
+
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_KEYSIZE);
+	_builder_init_optional_spinbutton (builder, "keysize_checkbutton", "keysize_spinbutton", !!value,
+	                                   _nm_utils_ascii_str_to_int64 (value, 10, 1, 65535, 128));
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "hmacauth_combo"));
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_AUTH);
+	populate_hmacauth_combo (GTK_COMBO_BOX (widget), value, caps);
+	nm_clear_pointer (&caps, nmovpn_caps_free);
+
+	_builder_init_toggle_button (builder, "ncp_disable_checkbutton", _hash_get_boolean (hash, NM_OPENVPN_KEY_NCP_DISABLE));
+
+	/* CRL */
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_CRL_VERIFY_FILE);
+	value2 = value ? NULL : g_hash_table_lookup (hash, NM_OPENVPN_KEY_CRL_VERIFY_DIR);
+	_builder_init_toggle_button (builder, "crl_file_check", !!value);
+	_builder_init_toggle_button (builder, "crl_dir_check", !!value2);
+	_builder_init_file_chooser (builder, "crl_file_chooser", value);
+	_builder_init_file_chooser (builder, "crl_dir_chooser", value2);
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_file_check"));
+	crl_file_checkbox_toggled_cb (widget, builder);
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_dir_check"));
+	crl_dir_checkbox_toggled_cb (widget, builder);
+}
+
+static void
+advanced_page_security_store (GtkBuilder *builder, GHashTable *hash)
+{
+	GtkWidget *widget;
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "cipher_combo"));
+	model = gtk_combo_box_get_model (GTK_COMBO_BOX (widget));
+	if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter)) {
+		gs_free char *cipher = NULL;
+		gboolean is_default;
+
+		gtk_tree_model_get (model, &iter,
+		                    TLS_CIPHER_COL_NAME, &cipher,
+		                    TLS_CIPHER_COL_DEFAULT, &is_default, -1);
 		if (!is_default && cipher) {
 			g_hash_table_insert (hash, NM_OPENVPN_KEY_CIPHER,
 			                     g_steal_pointer (&cipher));
@@ -2039,6 +2230,154 @@ advanced_dialog_new_hash_from_dialog (GtkWidget *dialog)
 		if (hmacauth)
 			g_hash_table_insert (hash, NM_OPENVPN_KEY_AUTH, hmacauth);
 	}
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ncp_disable_checkbutton"));
+	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
+		g_hash_table_insert (hash, NM_OPENVPN_KEY_NCP_DISABLE, g_strdup ("yes"));
+
+	/* CRL */
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_file_check"));
+	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
+		gs_free char *filename = NULL;
+
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_file_chooser"));
+		filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
+		if (filename && filename[0])
+			g_hash_table_insert (hash, NM_OPENVPN_KEY_CRL_VERIFY_FILE, g_steal_pointer (&filename));
+	} else {
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_dir_check"));
+		if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
+			gs_free char *filename = NULL;
+
+			widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_dir_chooser"));
+			filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
+			if (filename && filename[0])
+				g_hash_table_insert (hash, NM_OPENVPN_KEY_CRL_VERIFY_DIR, g_steal_pointer (&filename));
+		}
+	}
+}
+
+/*****************************************************************************/
+
+static const char *const advanced_page_tls_keys[] = {
+	NM_OPENVPN_KEY_EXTRA_CERTS,
+	NM_OPENVPN_KEY_NS_CERT_TYPE,
+	NM_OPENVPN_KEY_REMOTE_CERT_TLS,
+	NM_OPENVPN_KEY_TA,
+	NM_OPENVPN_KEY_TA_DIR,
+	NM_OPENVPN_KEY_TLS_CRYPT,
+	NM_OPENVPN_KEY_TLS_CRYPT_V2,
+	NM_OPENVPN_KEY_TLS_REMOTE,
+	NM_OPENVPN_KEY_TLS_VERSION_MIN,
+	NM_OPENVPN_KEY_TLS_VERSION_MAX,
+	NM_OPENVPN_KEY_VERIFY_X509_NAME,
+	NULL,
+};
+
+static void
+advanced_page_tls_setup (GtkBuilder *builder)
+{
+	GtkWidget *widget, *entry, *combo;
+	GtkListStore *store;
+	GtkTreeIter iter;
+
+	entry = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_entry"));
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_mode_combo"));
+	g_signal_connect (G_OBJECT (entry), "changed", G_CALLBACK (tls_remote_changed), builder);
+	g_signal_connect (G_OBJECT (combo), "changed", G_CALLBACK (tls_remote_changed), builder);
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "remote_cert_tls_checkbutton"));
+	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (remote_tls_cert_toggled_cb), builder);
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ns_cert_type_checkbutton"));
+	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (ns_cert_type_toggled_cb), builder);
+
+	/* Initialize direction combo */
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "direction_combo"));
+	store = gtk_list_store_new (2, G_TYPE_STRING, G_TYPE_INT);
+	gtk_list_store_append (store, &iter);
+	gtk_list_store_set (store, &iter, TA_DIR_COL_NAME, _("None"), TA_DIR_COL_NUM, -1, -1);
+	gtk_list_store_append (store, &iter);
+	gtk_list_store_set (store, &iter, TA_DIR_COL_NAME, "0", TA_DIR_COL_NUM, 0, -1);
+	gtk_list_store_append (store, &iter);
+	gtk_list_store_set (store, &iter, TA_DIR_COL_NAME, "1", TA_DIR_COL_NUM, 1, -1);
+	gtk_combo_box_set_model (GTK_COMBO_BOX (combo), GTK_TREE_MODEL (store));
+	g_object_unref (store);
+
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_mode"));
+	g_signal_connect (G_OBJECT (combo), "changed", G_CALLBACK (tls_auth_toggled_cb), builder);
+}
+
+static void
+advanced_page_tls_load (GtkWidget *dialog, GtkBuilder *builder, GHashTable *hash)
+{
+	GtkWidget *widget, *entry, *combo;
+	const char *value, *value2, *value3;
+	int direction = -1;
+
+	entry = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_entry"));
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_mode_combo"));
+	populate_tls_remote_mode_entry_combo (GTK_ENTRY (entry), GTK_COMBO_BOX (combo),
+	                                      g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_REMOTE),
+	                                      g_hash_table_lookup (hash, NM_OPENVPN_KEY_VERIFY_X509_NAME));
+	tls_remote_changed (entry, builder);
+
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_REMOTE_CERT_TLS);
+	widget = GTK_WIDGET (_builder_init_toggle_button (builder, "remote_cert_tls_checkbutton", value && *value));
+	remote_tls_cert_toggled_cb (widget, builder);
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "remote_cert_tls_combo"));
+	populate_remote_cert_tls_combo (GTK_COMBO_BOX (widget), value);
+
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_NS_CERT_TYPE);
+	widget = GTK_WIDGET (_builder_init_toggle_button (builder, "ns_cert_type_checkbutton", value && *value));
+	ns_cert_type_toggled_cb (widget, builder);
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ns_cert_type_combo"));
+	populate_ns_cert_type_combo (GTK_COMBO_BOX (widget), value);
+
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_mode"));
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TA);
+	value2 = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_CRYPT);
+	value3 = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_CRYPT_V2);
+	if (value3 && value3[0]) {
+		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), TLS_AUTH_MODE_CRYPT_V2);
+		_builder_init_file_chooser (builder, "tls_auth_chooser", value3);
+	} else if (value2 && value2[0]) {
+		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), TLS_AUTH_MODE_CRYPT);
+		_builder_init_file_chooser (builder, "tls_auth_chooser", value2);
+	} else if (value && value[0]) {
+		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), TLS_AUTH_MODE_AUTH);
+		_builder_init_file_chooser (builder, "tls_auth_chooser", value);
+		value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TA_DIR);
+		direction = _nm_utils_ascii_str_to_int64 (value, 10, 0, 1, -1);
+	} else {
+		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), TLS_AUTH_MODE_NONE);
+		_builder_init_file_chooser (builder, "tls_auth_chooser", NULL);
+	}
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "direction_combo"));
+	gtk_combo_box_set_active (GTK_COMBO_BOX (widget), direction + 1);
+	tls_auth_toggled_cb (combo, builder);
+
+	_builder_init_file_chooser (builder, "extra_certs_chooser",
+	                            g_hash_table_lookup (hash, NM_OPENVPN_KEY_EXTRA_CERTS));
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_version_min"));
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_VERSION_MIN);
+	gtk_entry_set_text (GTK_ENTRY (widget), value ?: "");
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_version_max"));
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_TLS_VERSION_MAX);
+	gtk_entry_set_text (GTK_ENTRY (widget), value ?: "");
+}
+
+static void
+advanced_page_tls_store (GtkBuilder *builder, GHashTable *hash)
+{
+	GtkWidget *widget, *entry, *combo;
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+	const char *value;
+	char *filename;
+
 	entry = GTK_WIDGET (gtk_builder_get_object (builder, "tls_version_min"));
 	value = gtk_entry_get_text (GTK_ENTRY (entry));
 	if (value && *value)
@@ -2049,149 +2388,316 @@ advanced_dialog_new_hash_from_dialog (GtkWidget *dialog)
 	if (value && *value)
 		g_hash_table_insert (hash, NM_OPENVPN_KEY_TLS_VERSION_MAX, g_strdup (value));
 
-	contype = g_object_get_data (G_OBJECT (dialog), "connection-type");
-	if (   !strcmp (contype, NM_OPENVPN_CONTYPE_TLS)
-	    || !strcmp (contype, NM_OPENVPN_CONTYPE_PASSWORD_TLS)
-	    || !strcmp (contype, NM_OPENVPN_CONTYPE_PASSWORD)) {
-		char *filename;
+	entry = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_entry"));
+	value = gtk_entry_get_text (GTK_ENTRY (entry));
 
-		entry = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_entry"));
-		value = gtk_entry_get_text (GTK_ENTRY (entry));
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_mode_combo"));
+	model = gtk_combo_box_get_model (GTK_COMBO_BOX (combo));
 
-		combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_remote_mode_combo"));
-		model = gtk_combo_box_get_model (GTK_COMBO_BOX (combo));
+	if (   value && *value
+	    && gtk_combo_box_get_active_iter (GTK_COMBO_BOX (combo), &iter)) {
+		gs_free char *tls_remote_mode = NULL;
 
-		if (   value && *value
-		    && gtk_combo_box_get_active_iter (GTK_COMBO_BOX (combo), &iter)) {
-			gs_free char *tls_remote_mode = NULL;
+		gtk_tree_model_get (model, &iter, TLS_REMOTE_MODE_COL_VALUE, &tls_remote_mode, -1);
+		if (nm_streq (tls_remote_mode, TLS_REMOTE_MODE_NONE)) {
+			// pass
+		} else if (nm_streq (tls_remote_mode, TLS_REMOTE_MODE_LEGACY)) {
+			g_hash_table_insert (hash, NM_OPENVPN_KEY_TLS_REMOTE, g_strdup (value));
+		} else {
+			g_hash_table_insert (hash,
+			                     NM_OPENVPN_KEY_VERIFY_X509_NAME,
+			                     g_strdup_printf ("%s:%s", tls_remote_mode, value));
+		}
+	}
 
-			gtk_tree_model_get (model, &iter, TLS_REMOTE_MODE_COL_VALUE, &tls_remote_mode, -1);
-			if (nm_streq (tls_remote_mode, TLS_REMOTE_MODE_NONE)) {
-				// pass
-			} else if (nm_streq (tls_remote_mode, TLS_REMOTE_MODE_LEGACY)) {
-				g_hash_table_insert (hash, NM_OPENVPN_KEY_TLS_REMOTE, g_strdup (value));
-			} else {
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "remote_cert_tls_checkbutton"));
+	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "remote_cert_tls_combo"));
+		model = gtk_combo_box_get_model (GTK_COMBO_BOX (widget));
+		if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter)) {
+			char *remote_cert;
+
+			gtk_tree_model_get (model, &iter, REMOTE_CERT_COL_VALUE, &remote_cert, -1);
+			if (remote_cert) {
 				g_hash_table_insert (hash,
-				                     NM_OPENVPN_KEY_VERIFY_X509_NAME,
-				                     g_strdup_printf ("%s:%s", tls_remote_mode, value));
+				                     NM_OPENVPN_KEY_REMOTE_CERT_TLS,
+				                     remote_cert);
 			}
 		}
+	}
 
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "remote_cert_tls_checkbutton"));
-		if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "remote_cert_tls_combo"));
-			model = gtk_combo_box_get_model (GTK_COMBO_BOX (widget));
-			if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter)) {
-				char *remote_cert;
-
-				gtk_tree_model_get (model, &iter, REMOTE_CERT_COL_VALUE, &remote_cert, -1);
-				if (remote_cert) {
-					g_hash_table_insert (hash,
-					                     NM_OPENVPN_KEY_REMOTE_CERT_TLS,
-					                     remote_cert);
-				}
-			}
-		}
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ns_cert_type_checkbutton"));
+	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "ns_cert_type_combo"));
+		model = gtk_combo_box_get_model (GTK_COMBO_BOX (widget));
+		if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter)) {
+			char *type;
 
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "ns_cert_type_checkbutton"));
-		if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "ns_cert_type_combo"));
-			model = gtk_combo_box_get_model (GTK_COMBO_BOX (widget));
-			if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter)) {
-				char *type;
-
-				gtk_tree_model_get (model, &iter, NS_CERT_TYPE_COL_VALUE, &type, -1);
-				if (type) {
-					g_hash_table_insert (hash,
-					                     NM_OPENVPN_KEY_NS_CERT_TYPE,
-					                     type);
-				}
+			gtk_tree_model_get (model, &iter, NS_CERT_TYPE_COL_VALUE, &type, -1);
+			if (type) {
+				g_hash_table_insert (hash,
+				                     NM_OPENVPN_KEY_NS_CERT_TYPE,
+				                     type);
 			}
 		}
+	}
 
-		combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_mode"));
-		switch (gtk_combo_box_get_active (GTK_COMBO_BOX (combo))) {
-		case TLS_AUTH_MODE_AUTH:
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_chooser"));
-			filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
-			if (filename && filename[0])
-				g_hash_table_insert (hash, NM_OPENVPN_KEY_TA, g_strdup (filename));
-			g_free (filename);
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_mode"));
+	switch (gtk_combo_box_get_active (GTK_COMBO_BOX (combo))) {
+	case TLS_AUTH_MODE_AUTH:
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_chooser"));
+		filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
+		if (filename && filename[0])
+			g_hash_table_insert (hash, NM_OPENVPN_KEY_TA, g_strdup (filename));
+		g_free (filename);
 
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "direction_combo"));
-			model = gtk_combo_box_get_model (GTK_COMBO_BOX (widget));
-			if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter)) {
-				int direction;
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "direction_combo"));
+		model = gtk_combo_box_get_model (GTK_COMBO_BOX (widget));
+		if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter)) {
+			int direction;
 
-				gtk_tree_model_get (model, &iter, TA_DIR_COL_NUM, &direction, -1);
-				if (direction >= 0) {
-					g_hash_table_insert (hash, NM_OPENVPN_KEY_TA_DIR,
-					                     g_strdup_printf ("%d", direction));
-				}
+			gtk_tree_model_get (model, &iter, TA_DIR_COL_NUM, &direction, -1);
+			if (direction >= 0) {
+				g_hash_table_insert (hash, NM_OPENVPN_KEY_TA_DIR,
+				                     g_strdup_printf ("%d", direction));
 			}
-			break;
-		case TLS_AUTH_MODE_CRYPT:
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_chooser"));
-			filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
-			if (filename && filename[0])
-				g_hash_table_insert (hash, NM_OPENVPN_KEY_TLS_CRYPT, g_strdup (filename));
-			g_free (filename);
-			break;
-		case TLS_AUTH_MODE_CRYPT_V2:
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_chooser"));
-			filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
-			if (filename && filename[0])
-				g_hash_table_insert (hash, NM_OPENVPN_KEY_TLS_CRYPT_V2, g_strdup (filename));
-			g_free (filename);
-			break;
-		case TLS_AUTH_MODE_NONE:
-			break;
 		}
-
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "extra_certs_chooser"));
+		break;
+	case TLS_AUTH_MODE_CRYPT:
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_chooser"));
+		filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
+		if (filename && filename[0])
+			g_hash_table_insert (hash, NM_OPENVPN_KEY_TLS_CRYPT, g_strdup (filename));
+		g_free (filename);
+		break;
+	case TLS_AUTH_MODE_CRYPT_V2:
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "tls_auth_chooser"));
 		filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
 		if (filename && filename[0])
-			g_hash_table_insert (hash, NM_OPENVPN_KEY_EXTRA_CERTS, g_strdup (filename));
+			g_hash_table_insert (hash, NM_OPENVPN_KEY_TLS_CRYPT_V2, g_strdup (filename));
 		g_free (filename);
+		break;
+	case TLS_AUTH_MODE_NONE:
+		break;
+	}
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "extra_certs_chooser"));
+	filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
+	if (filename && filename[0])
+		g_hash_table_insert (hash, NM_OPENVPN_KEY_EXTRA_CERTS, g_strdup (filename));
+	g_free (filename);
+}
+
+/*****************************************************************************/
+
+static const char *const advanced_page_proxy_keys[] = {
+	NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD,
+	NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD_FLAGS,
+	NM_OPENVPN_KEY_HTTP_PROXY_USERNAME,
+	NM_OPENVPN_KEY_PROXY_PORT,
+	NM_OPENVPN_KEY_PROXY_RETRY,
+	NM_OPENVPN_KEY_PROXY_SERVER,
+	NM_OPENVPN_KEY_PROXY_TYPE,
+	NULL,
+};
+
+static void
+advanced_page_proxy_setup (GtkBuilder *builder)
+{
+	GtkWidget *widget, *combo;
+	GtkListStore *store;
+	GtkTreeIter iter;
+
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_type_combo"));
+	store = gtk_list_store_new (1, G_TYPE_STRING);
+	gtk_list_store_append (store, &iter);
+	gtk_list_store_set (store, &iter, 0, _("Not required"), -1);
+	gtk_list_store_append (store, &iter);
+	gtk_list_store_set (store, &iter, 0, _("HTTP"), -1);
+	gtk_list_store_append (store, &iter);
+	gtk_list_store_set (store, &iter, 0, _("SOCKS"), -1);
+	gtk_combo_box_set_model (GTK_COMBO_BOX (combo), GTK_TREE_MODEL (store));
+	g_object_unref (store);
+	g_signal_connect (G_OBJECT (combo), "changed", G_CALLBACK (proxy_type_changed), builder);
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "show_proxy_password"));
+	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (show_proxy_password_toggled_cb), builder);
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_password_entry"));
+	nma_utils_setup_password_storage (widget, NM_SETTING_SECRET_FLAG_NONE, NULL, NULL,
+	                                  TRUE, FALSE);
+}
+
+static void
+advanced_page_proxy_load (GtkWidget *dialog, GtkBuilder *builder, GHashTable *hash)
+{
+	GtkWidget *widget, *combo;
+	const char *value, *value2;
+	gboolean has_server;
+	guint32 active;
+	NMSettingSecretFlags pw_flags = NM_SETTING_SECRET_FLAG_NONE;
+
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PROXY_SERVER);
+	value2 = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PROXY_PORT);
+	has_server = value && *value && value2 && *value2;
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_server_entry"));
+	gtk_entry_set_text (GTK_ENTRY (widget), has_server ? value : "");
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_port_spinbutton"));
+	gtk_spin_button_set_value (GTK_SPIN_BUTTON (widget),
+	                           has_server ? (gdouble) _nm_utils_ascii_str_to_int64 (value2, 10, 0, 65535, 0) : 0.0);
+
+	_builder_init_toggle_button (builder, "proxy_retry_checkbutton",
+	                             has_server && _hash_get_boolean (hash, NM_OPENVPN_KEY_PROXY_RETRY));
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_username_entry"));
+	value = has_server ? g_hash_table_lookup (hash, NM_OPENVPN_KEY_HTTP_PROXY_USERNAME) : NULL;
+	gtk_entry_set_text (GTK_ENTRY (widget), value ?: "");
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_password_entry"));
+	value = has_server ? g_hash_table_lookup (hash, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD) : NULL;
+	gtk_entry_set_text (GTK_ENTRY (widget), value ?: "");
+
+	if (has_server) {
+		value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD_FLAGS);
+		G_STATIC_ASSERT_EXPR (((guint) (NMSettingSecretFlags) 0xFFFFu) == 0xFFFFu);
+		pw_flags = _nm_utils_ascii_str_to_int64 (value, 10, 0, 0xFFFF, NM_SETTING_SECRET_FLAG_NONE);
 	}
+	nma_utils_update_password_storage (widget, pw_flags, NULL, NULL);
+
+	_builder_init_toggle_button (builder, "show_proxy_password", FALSE);
+
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_PROXY_TYPE);
+	active = PROXY_TYPE_NONE;
+	if (value) {
+		if (!strcmp (value, "http"))
+			active = PROXY_TYPE_HTTP;
+		else if (!strcmp (value, "socks"))
+			active = PROXY_TYPE_SOCKS;
+	}
+
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_type_combo"));
+	gtk_combo_box_set_active (GTK_COMBO_BOX (combo), active);
+	proxy_type_changed (GTK_COMBO_BOX (combo), builder);
+}
+
+static void
+advanced_page_proxy_store (GtkBuilder *builder, GHashTable *hash)
+{
+	GtkWidget *widget;
+	const char *value;
+	int proxy_type = PROXY_TYPE_NONE;
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_type_combo"));
+	proxy_type = gtk_combo_box_get_active (GTK_COMBO_BOX (widget));
+	if (proxy_type == PROXY_TYPE_NONE)
+		return;
+
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_server_entry"));
+	value = gtk_entry_get_text (GTK_ENTRY (widget));
+	if (value && *value) {
+		int proxy_port;
+
+		if (proxy_type == PROXY_TYPE_HTTP)
+			g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_TYPE, g_strdup ("http"));
+		else if (proxy_type == PROXY_TYPE_SOCKS)
+			g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_TYPE, g_strdup ("socks"));
+
+		g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_SERVER, g_strdup (value));
+
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_port_spinbutton"));
+		proxy_port = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+		if (proxy_port > 0) {
+			g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_PORT,
+			                     g_strdup_printf ("%d", proxy_port));
+		}
+
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_retry_checkbutton"));
+		if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
+			g_hash_table_insert (hash, NM_OPENVPN_KEY_PROXY_RETRY, g_strdup ("yes"));
+
+		if (proxy_type == PROXY_TYPE_HTTP) {
+			guint32 pw_flags;
+
+			widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_username_entry"));
+			value = gtk_entry_get_text (GTK_ENTRY (widget));
+			if (value && *value)
+				g_hash_table_insert (hash, NM_OPENVPN_KEY_HTTP_PROXY_USERNAME, g_strdup (value));
+
+			widget = GTK_WIDGET (gtk_builder_get_object (builder, "proxy_password_entry"));
+			value = gtk_entry_get_text (GTK_ENTRY (widget));
+			if (value && *value)
+				g_hash_table_insert (hash, NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD, g_strdup (value));
+
+			pw_flags = nma_utils_menu_to_secret_flags (widget);
+			if (pw_flags != NM_SETTING_SECRET_FLAG_NONE) {
+				g_hash_table_insert (hash,
+				                     NM_OPENVPN_KEY_HTTP_PROXY_PASSWORD_FLAGS,
+				                     g_strdup_printf ("%d", pw_flags));
+			}
+		}
+	}
+}
+
+/*****************************************************************************/
+
+static const char *const advanced_page_misc_keys[] = {
+	NM_OPENVPN_KEY_CONNECT_TIMEOUT,
+	NM_OPENVPN_KEY_MTU_DISC,
+	NM_OPENVPN_KEY_PUSH_PEER_INFO,
+	NULL,
+};
+
+static void
+advanced_page_misc_setup (GtkBuilder *builder)
+{
+	GtkWidget *widget;
 
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_checkbutton"));
-	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
-		int ping_val;
+	_builder_setup_optional_spinbutton (builder, "connect_timeout_checkbutton", "connect_timeout_spinbutton");
 
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_spinbutton"));
-		ping_val = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "mtu_disc_checkbutton"));
+	g_signal_connect (G_OBJECT (widget), "toggled", G_CALLBACK (mtu_disc_toggled_cb), builder);
+}
 
-		g_hash_table_insert (hash,
-		                     NM_OPENVPN_KEY_PING,
-		                     g_strdup_printf ("%d", ping_val));
-	}
+static void
+advanced_page_misc_load (GtkWidget *dialog, GtkBuilder *builder, GHashTable *hash)
+{
+	GtkWidget *widget, *combo;
+	const char *value;
 
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_checkbutton"));
-	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
-		int ping_exit_type, ping_val;
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_CONNECT_TIMEOUT);
+	_builder_init_optional_spinbutton (builder, "connect_timeout_checkbutton", "connect_timeout_spinbutton", !!value,
+	                                   _nm_utils_ascii_str_to_int64 (value, 10, 0, G_MAXINT, 120));
 
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_combo"));
-		ping_exit_type = gtk_combo_box_get_active (GTK_COMBO_BOX (widget));
+	/* MTU discovery */
+	value = g_hash_table_lookup (hash, NM_OPENVPN_KEY_MTU_DISC);
+	combo = GTK_WIDGET (gtk_builder_get_object (builder, "mtu_disc_combo"));
+	if (nm_streq0 (value, "maybe"))
+		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), 1);
+	else if (nm_streq0 (value, "yes"))
+		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), 2);
+	else
+		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), 0);
+	widget = GTK_WIDGET (_builder_init_toggle_button (builder, "mtu_disc_checkbutton", value && value[0]));
+	mtu_disc_toggled_cb (widget, builder);
 
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "ping_exit_restart_spinbutton"));
-		ping_val = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+	_builder_init_toggle_button (builder, "push_peer_info_checkbutton",
+	                             _hash_get_boolean (hash, NM_OPENVPN_KEY_PUSH_PEER_INFO));
+}
 
-		g_hash_table_insert (hash,
-		                     ping_exit_type == PING_EXIT
-		                       ? NM_OPENVPN_KEY_PING_EXIT
-		                       : NM_OPENVPN_KEY_PING_RESTART,
-		                     g_strdup_printf ("%d", ping_val));
-	}
+static void
+advanced_page_misc_store (GtkBuilder *builder, GHashTable *hash)
+{
+	GtkWidget *widget, *combo;
 
-	/* max routes */
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "max_routes_checkbutton"));
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "connect_timeout_checkbutton"));
 	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
-		int max_routes;
+		int timeout;
 
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "max_routes_spinbutton"));
-		max_routes = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
-		g_hash_table_insert (hash, NM_OPENVPN_KEY_MAX_ROUTES, g_strdup_printf ("%d", max_routes));
+		widget = GTK_WIDGET (gtk_builder_get_object (builder, "connect_timeout_spinbutton"));
+		timeout = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+		g_hash_table_insert (hash, NM_OPENVPN_KEY_CONNECT_TIMEOUT, g_strdup_printf ("%d", timeout));
 	}
 
 	/* MTU discovery */
@@ -2218,30 +2724,213 @@ advanced_dialog_new_hash_from_dialog (GtkWidget *dialog)
 		}
 	}
 
-	/* CRL */
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_file_check"));
-	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
-		gs_free char *filename = NULL;
+	widget = GTK_WIDGET (gtk_builder_get_object (builder, "push_peer_info_checkbutton"));
+	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
+		g_hash_table_insert (hash, NM_OPENVPN_KEY_PUSH_PEER_INFO, g_strdup ("yes"));
+}
 
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_file_chooser"));
-		filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
-		if (filename && filename[0])
-			g_hash_table_insert (hash, NM_OPENVPN_KEY_CRL_VERIFY_FILE, g_steal_pointer (&filename));
-	} else {
-		widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_dir_check"));
-		if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
-			gs_free char *filename = NULL;
+/*****************************************************************************/
 
-			widget = GTK_WIDGET (gtk_builder_get_object (builder, "crl_dir_chooser"));
-			filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (widget));
-			if (filename && filename[0])
-				g_hash_table_insert (hash, NM_OPENVPN_KEY_CRL_VERIFY_DIR, g_steal_pointer (&filename));
-		}
+static const struct {
+	const char *const *keys;
+	void (*setup) (GtkBuilder *builder);
+	void (*load) (GtkWidget *dialog, GtkBuilder *builder, GHashTable *hash);
+	void (*store) (GtkBuilder *builder, GHashTable *hash);
+} advanced_pages[_ADVANCED_PAGE_NUM] = {
+#define _PAGE(page, name) \
+	[page] = { \
+		.keys  = advanced_page_##name##_keys, \
+		.setup = advanced_page_##name##_setup, \
+		.load  = advanced_page_##name##_load, \
+		.store = advanced_page_##name##_store, \
+	}
+	_PAGE (ADVANCED_PAGE_GENERAL,  general),
+	_PAGE (ADVANCED_PAGE_SECURITY, security),
+	_PAGE (ADVANCED_PAGE_TLS,      tls),
+	_PAGE (ADVANCED_PAGE_PROXY,    proxy),
+	_PAGE (ADVANCED_PAGE_MISC,     misc),
+#undef _PAGE
+};
+
+static void
+advanced_dialog_load_page (GtkWidget *dialog, AdvancedPage page)
+{
+	GtkBuilder *builder;
+	GHashTable *hash;
+
+	if (advanced_dialog_get_pages (dialog, "pages-loaded") & ADVANCED_PAGE_BIT (page))
+		return;
+
+	/* Selecting a proxy turns on TCP on the general page. Load that first, so
+	 * that it doesn't reset the protocol later. */
+	if (page == ADVANCED_PAGE_PROXY)
+		advanced_dialog_load_page (dialog, ADVANCED_PAGE_GENERAL);
+
+	builder = g_object_get_data (G_OBJECT (dialog), "builder");
+	hash = g_object_get_data (G_OBJECT (dialog), "hash");
+	g_return_if_fail (builder && hash);
+
+	if (!(advanced_dialog_get_pages (dialog, "pages-setup") & ADVANCED_PAGE_BIT (page))) {
+		advanced_pages[page].setup (builder);
+		advanced_dialog_set_pages (dialog, "pages-setup",
+		                           advanced_dialog_get_pages (dialog, "pages-setup") | ADVANCED_PAGE_BIT (page));
 	}
 
-	widget = GTK_WIDGET (gtk_builder_get_object (builder, "push_peer_info_checkbutton"));
-	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
-		g_hash_table_insert (hash, NM_OPENVPN_KEY_PUSH_PEER_INFO, g_strdup ("yes"));
+	advanced_pages[page].load (dialog, builder, hash);
+	advanced_dialog_set_pages (dialog, "pages-loaded",
+	                           advanced_dialog_get_pages (dialog, "pages-loaded") | ADVANCED_PAGE_BIT (page));
+}
+
+static void
+advanced_dialog_load_notebook_page (GtkWidget *dialog, GtkWidget *page)
+{
+	guint idx;
+
+	idx = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (page), "advanced-page"));
+	if (idx > 0)
+		advanced_dialog_load_page (dialog, idx - 1);
+}
+
+static void
+advanced_dialog_switch_page_cb (GtkNotebook *notebook,
+                                GtkWidget *page,
+                                guint page_num,
+                                gpointer user_data)
+{
+	advanced_dialog_load_notebook_page (GTK_WIDGET (user_data), page);
+}
+
+static GtkWidget *
+advanced_dialog_new (const char *contype)
+{
+	GtkBuilder *builder;
+	GtkWidget *dialog = NULL;
+	GtkNotebook *notebook;
+	GError *error = NULL;
+	guint i;
+
+	builder = gtk_builder_new ();
+
+	gtk_builder_set_translation_domain (builder, GETTEXT_PACKAGE);
+
+	if (!gtk_builder_add_from_resource (builder, "/org/freedesktop/network-manager-openvpn/nm-openvpn-dialog.ui", &error)) {
+		g_error_free (error);
+		g_object_unref (G_OBJECT (builder));
+		g_return_val_if_reached (NULL);
+	}
+
+	dialog = GTK_WIDGET (gtk_builder_get_object (builder, "openvpn-advanced-dialog"));
+	if (!dialog) {
+		g_object_unref (G_OBJECT (builder));
+		g_return_val_if_reached (NULL);
+	}
+	gtk_window_set_modal (GTK_WINDOW (dialog), TRUE);
+
+	g_object_set_data_full (G_OBJECT (dialog), "builder",
+	                        builder, (GDestroyNotify) g_object_unref);
+	g_object_set_data_full (G_OBJECT (dialog), "connection-type", g_strdup (contype), g_free);
+
+	notebook = GTK_NOTEBOOK (gtk_builder_get_object (builder, "options_notebook"));
+	nm_assert (gtk_notebook_get_n_pages (notebook) == _ADVANCED_PAGE_NUM);
+	for (i = 0; i < _ADVANCED_PAGE_NUM; i++) {
+		g_object_set_data (G_OBJECT (gtk_notebook_get_nth_page (notebook, i)),
+		                   "advanced-page", GUINT_TO_POINTER (i + 1));
+	}
+
+	if (!advanced_dialog_has_tls_page (contype))
+		gtk_notebook_remove_page (notebook, ADVANCED_PAGE_TLS);
+
+	g_signal_connect (notebook, "switch-page", G_CALLBACK (advanced_dialog_switch_page_cb), dialog);
+
+	return dialog;
+}
+
+static void
+advanced_dialog_set_hash (GtkWidget *dialog, GHashTable *hash)
+{
+	g_return_if_fail (hash);
+
+	if (g_object_get_data (G_OBJECT (dialog), "hash") != hash) {
+		g_object_set_data_full (G_OBJECT (dialog), "hash",
+		                        g_hash_table_ref (hash),
+		                        (GDestroyNotify) g_hash_table_unref);
+	}
+}
+
+/* Discard the changes in the dialog. The pages are filled in again
+ * when they are shown next. */
+static void
+advanced_dialog_reset (GtkWidget *dialog)
+{
+	GtkBuilder *builder;
+
+	advanced_dialog_set_pages (dialog, "pages-loaded", 0);
+
+	/* only the loaded pages validate their input */
+	builder = g_object_get_data (G_OBJECT (dialog), "builder");
+	gtk_widget_set_sensitive (GTK_WIDGET (gtk_builder_get_object (builder, "ok_button")), TRUE);
+}
+
+static void
+advanced_dialog_load_current_page (GtkWidget *dialog)
+{
+	GtkBuilder *builder;
+	GtkNotebook *notebook;
+
+	builder = g_object_get_data (G_OBJECT (dialog), "builder");
+	notebook = GTK_NOTEBOOK (gtk_builder_get_object (builder, "options_notebook"));
+	advanced_dialog_load_notebook_page (dialog,
+	                                    gtk_notebook_get_nth_page (notebook,
+	                                                               gtk_notebook_get_current_page (notebook)));
+}
+
+static GHashTable *
+advanced_dialog_new_hash_from_dialog (GtkWidget *dialog)
+{
+	GHashTable *hash, *old_hash;
+	GtkBuilder *builder;
+	const char *contype;
+	guint loaded;
+	guint page;
+	guint i;
+
+	g_return_val_if_fail (dialog, NULL);
+
+	builder = g_object_get_data (G_OBJECT (dialog), "builder");
+	g_return_val_if_fail (builder, NULL);
+
+	old_hash = g_object_get_data (G_OBJECT (dialog), "hash");
+	g_return_val_if_fail (old_hash, NULL);
+
+	contype = g_object_get_data (G_OBJECT (dialog), "connection-type");
+	loaded = advanced_dialog_get_pages (dialog, "pages-loaded");
+
+	hash = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+	for (page = 0; page < _ADVANCED_PAGE_NUM; page++) {
+		if (loaded & ADVANCED_PAGE_BIT (page)) {
+			advanced_pages[page].store (builder, hash);
+			continue;
+		}
+
+		/* The page was not shown, keep its values. Without the TLS
+		 * page, only the TLS versions apply. */
+		for (i = 0; advanced_pages[page].keys[i]; i++) {
+			const char *key = advanced_pages[page].keys[i];
+			const char *value;
+
+			if (   page == ADVANCED_PAGE_TLS
+			    && !advanced_dialog_has_tls_page (contype)
+			    && !NM_IN_STRSET (key,
+			                      NM_OPENVPN_KEY_TLS_VERSION_MIN,
+			                      NM_OPENVPN_KEY_TLS_VERSION_MAX))
+				continue;
+
+			value = g_hash_table_lookup (old_hash, key);
+			if (value)
+				g_hash_table_insert (hash, (gpointer) key, g_strdup (value));
+		}
+	}
 
 	return hash;
 }
@@ -2262,8 +2951,21 @@ typedef struct {
 	GtkWindowGroup *window_group;
 	gboolean window_added;
 	GHashTable *advanced;
+	GtkWidget *advanced_dialog;
 	gboolean new_connection;
 	GtkWidget *tls_user_cert_chooser;
+
+	/* validation results, reused by check_validity() until the
+	 * widgets change. */
+	GHashTable *gateway_tokens;
+	char *gateway_checked;
+	gboolean gateway_valid;
+	guint gateway_changed_id;
+	gboolean auth_checked;
+	gboolean auth_valid;
+	GError *auth_error;
+	char *auth_files;
+	GCancellable *auth_files_cancellable;
 } OpenvpnEditorPrivate;
 
 /*****************************************************************************/
@@ -2272,32 +2974,59 @@ typedef struct {
 #define COL_AUTH_PAGE 1
 #define COL_AUTH_TYPE 2
 
+/* Pasting hundreds of gateways and typing makes parsing the whole list on
+ * every keystroke noticeable. Remember the result for each token, so that
+ * only new ones are parsed, and for the text as a whole. */
 static gboolean
-check_gateway_entry (const char *str)
+check_gateway_entry (OpenvpnEditorPrivate *priv, const char *str)
 {
 	gs_free char *str_clone = NULL;
+	GHashTable *tokens;
 	char *str_iter;
 	const char *tok;
 	gboolean success = FALSE;
+	gboolean invalid = FALSE;
 
 	if (!str || !str[0])
 		return FALSE;
 
+	if (nm_streq0 (str, priv->gateway_checked))
+		return priv->gateway_valid;
+
+	tokens = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
 	str_clone = g_strdup (str);
 	str_iter = str_clone;
 	while ((tok = strsep (&str_iter, " \t,"))) {
+		gpointer valid;
+
 		if (!tok[0])
 			continue;
-		if (nmovpn_remote_parse (tok,
-		                         NULL,
-		                         NULL,
-		                         NULL,
-		                         NULL,
-		                         NULL) != -1)
-		   return FALSE;
+		if (!g_hash_table_lookup_extended (tokens, tok, NULL, &valid)) {
+			if (   !priv->gateway_tokens
+			    || !g_hash_table_lookup_extended (priv->gateway_tokens, tok, NULL, &valid)) {
+				valid = GUINT_TO_POINTER (nmovpn_remote_parse (tok,
+				                                               NULL,
+				                                               NULL,
+				                                               NULL,
+				                                               NULL,
+				                                               NULL) == -1);
+			}
+			g_hash_table_insert (tokens, g_strdup (tok), valid);
+		}
+		if (!GPOINTER_TO_UINT (valid))
+			invalid = TRUE;
 		success = TRUE;
 	}
-	return success;
+
+	/* only keep the tokens that are still there */
+	nm_clear_pointer (&priv->gateway_tokens, g_hash_table_unref);
+	priv->gateway_tokens = tokens;
+
+	g_free (priv->gateway_checked);
+	priv->gateway_checked = g_strdup (str);
+	priv->gateway_valid = success && !invalid;
+	return priv->gateway_valid;
 }
 
 static gboolean
@@ -2313,7 +3042,7 @@ check_validity (OpenvpnEditor *self, GError **error)
 
 	widget = GTK_WIDGET (gtk_builder_get_object (priv->builder, "gateway_entry"));
 	str = gtk_entry_get_text (GTK_ENTRY (widget));
-	if (str && check_gateway_entry (str))
+	if (str && check_gateway_entry (priv, str))
 		gtk_style_context_remove_class (gtk_widget_get_style_context (widget), "error");
 	else {
 		gtk_style_context_add_class (gtk_widget_get_style_context (widget), "error");
@@ -2330,8 +3059,17 @@ check_validity (OpenvpnEditor *self, GError **error)
 	success = gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter);
 	g_return_val_if_fail (success == TRUE, FALSE);
 	gtk_tree_model_get (model, &iter, COL_AUTH_TYPE, &contype, -1);
-	if (!auth_widget_check_validity (priv->builder, contype, error))
+
+	if (!priv->auth_checked) {
+		g_clear_error (&priv->auth_error);
+		priv->auth_valid = auth_widget_check_validity (priv->builder, contype, &priv->auth_error);
+		priv->auth_checked = TRUE;
+	}
+	if (!priv->auth_valid) {
+		if (priv->auth_error)
+			g_propagate_error (error, g_error_copy (priv->auth_error));
 		return FALSE;
+	}
 
 	return TRUE;
 }
@@ -2339,9 +3077,125 @@ check_validity (OpenvpnEditor *self, GError **error)
 static void
 stuff_changed_cb (GtkWidget *widget, gpointer user_data)
 {
+	OpenvpnEditorPrivate *priv = OPENVPN_EDITOR_GET_PRIVATE (user_data);
+
+	/* this covers a pending change of the gateways too */
+	nm_clear_g_source (&priv->gateway_changed_id);
+
 	g_signal_emit_by_name (OPENVPN_EDITOR (user_data), "changed");
 }
 
+#define GATEWAY_CHANGED_DELAY_MS 300
+
+static gboolean
+gateway_changed_timeout (gpointer user_data)
+{
+	OpenvpnEditorPrivate *priv = OPENVPN_EDITOR_GET_PRIVATE (user_data);
+
+	priv->gateway_changed_id = 0;
+	stuff_changed_cb (NULL, user_data);
+	return G_SOURCE_REMOVE;
+}
+
+/* Don't revalidate on every keystroke in the gateway entry. */
+static void
+gateway_changed_cb (GtkWidget *widget, gpointer user_data)
+{
+	OpenvpnEditorPrivate *priv = OPENVPN_EDITOR_GET_PRIVATE (user_data);
+
+	nm_clear_g_source (&priv->gateway_changed_id);
+	priv->gateway_changed_id = g_timeout_add (GATEWAY_CHANGED_DELAY_MS, gateway_changed_timeout, user_data);
+}
+
+typedef struct {
+	OpenvpnEditor *self;
+	GCancellable *cancellable;
+	char **files;
+} AuthFilesData;
+
+static gboolean
+auth_files_done (gpointer user_data)
+{
+	AuthFilesData *data = user_data;
+
+	if (!g_cancellable_is_cancelled (data->cancellable)) {
+		OPENVPN_EDITOR_GET_PRIVATE (data->self)->auth_checked = FALSE;
+		stuff_changed_cb (NULL, data->self);
+	}
+
+	g_object_unref (data->self);
+	g_object_unref (data->cancellable);
+	g_strfreev (data->files);
+	g_slice_free (AuthFilesData, data);
+	return G_SOURCE_REMOVE;
+}
+
+static gpointer
+auth_files_thread (gpointer user_data)
+{
+	AuthFilesData *data = user_data;
+	char **iter;
+
+	for (iter = data->files; *iter; iter++) {
+		if (g_cancellable_is_cancelled (data->cancellable))
+			break;
+		nmovpn_file_classify (*iter);
+	}
+
+	g_idle_add (auth_files_done, data);
+	return NULL;
+}
+
+/* An authentication widget changed. If it now refers to other files,
+ * they are read in a thread first, so that check_validity() finds them
+ * in the cache of nmovpn_file_classify() instead of blocking the UI.
+ * Until then, check_validity() keeps returning the previous result. */
+static void
+auth_changed_cb (GtkWidget *widget, gpointer user_data)
+{
+	OpenvpnEditor *self = OPENVPN_EDITOR (user_data);
+	OpenvpnEditorPrivate *priv = OPENVPN_EDITOR_GET_PRIVATE (self);
+	GtkComboBox *combo;
+	GtkTreeIter iter;
+	gs_free char *contype = NULL;
+	gs_free char *files_str = NULL;
+	AuthFilesData *data;
+	char **files;
+
+	/* still initializing */
+	combo = GTK_COMBO_BOX (gtk_builder_get_object (priv->builder, "auth_combo"));
+	if (!gtk_combo_box_get_active_iter (combo, &iter)) {
+		priv->auth_checked = FALSE;
+		stuff_changed_cb (widget, self);
+		return;
+	}
+	gtk_tree_model_get (gtk_combo_box_get_model (combo), &iter, COL_AUTH_TYPE, &contype, -1);
+
+	files = auth_widget_get_files (priv->builder, contype);
+	files_str = g_strjoinv ("\n", files);
+	if (nm_streq0 (files_str, priv->auth_files)) {
+		g_strfreev (files);
+		priv->auth_checked = FALSE;
+		stuff_changed_cb (widget, self);
+		return;
+	}
+
+	g_free (priv->auth_files);
+	priv->auth_files = g_steal_pointer (&files_str);
+
+	if (priv->auth_files_cancellable) {
+		g_cancellable_cancel (priv->auth_files_cancellable);
+		g_object_unref (priv->auth_files_cancellable);
+	}
+	priv->auth_files_cancellable = g_cancellable_new ();
+
+	data = g_slice_new (AuthFilesData);
+	data->self = g_object_ref (self);
+	data->cancellable = g_object_ref (priv->auth_files_cancellable);
+	data->files = files;
+	g_thread_unref (g_thread_new ("openvpn-editor", auth_files_thread, data));
+}
+
 static void
 auth_combo_changed_cb (GtkWidget *combo, gpointer user_data)
 {
@@ -2359,15 +3213,22 @@ auth_combo_changed_cb (GtkWidget *combo, gpointer user_data)
 	auth_notebook = GTK_WIDGET (gtk_builder_get_object (priv->builder, "auth_notebook"));
 	gtk_notebook_set_current_page (GTK_NOTEBOOK (auth_notebook), new_page);
 
-	stuff_changed_cb (combo, self);
+	auth_changed_cb (combo, self);
 }
 
 static void
 advanced_dialog_close_cb (GtkWidget *dialog, gpointer user_data)
 {
+	/* keep the dialog for the next time */
 	gtk_widget_hide (dialog);
-	/* gtk_widget_destroy() will remove the window from the window group */
-	gtk_widget_destroy (dialog);
+	advanced_dialog_reset (dialog);
+}
+
+static gboolean
+advanced_dialog_delete_cb (GtkWidget *dialog, GdkEvent *event, gpointer user_data)
+{
+	advanced_dialog_close_cb (dialog, user_data);
+	return TRUE;
 }
 
 static void
@@ -2375,15 +3236,19 @@ advanced_dialog_response_cb (GtkWidget *dialog, gint response, gpointer user_dat
 {
 	OpenvpnEditor *self = OPENVPN_EDITOR (user_data);
 	OpenvpnEditorPrivate *priv = OPENVPN_EDITOR_GET_PRIVATE (self);
+	GHashTable *hash;
 
 	if (response != GTK_RESPONSE_OK) {
 		advanced_dialog_close_cb (dialog, self);
 		return;
 	}
 
-	nm_clear_pointer (&priv->advanced, g_hash_table_destroy);
-	priv->advanced = advanced_dialog_new_hash_from_dialog (dialog);
-	advanced_dialog_close_cb (dialog, self);
+	hash = advanced_dialog_new_hash_from_dialog (dialog);
+	nm_clear_pointer (&priv->advanced, g_hash_table_unref);
+	priv->advanced = hash;
+	/* the pages that were loaded show @hash already */
+	advanced_dialog_set_hash (dialog, hash);
+	gtk_widget_hide (dialog);
 
 	stuff_changed_cb (NULL, self);
 }
@@ -2408,22 +3273,35 @@ advanced_button_clicked_cb (GtkWidget *button, gpointer user_data)
 	g_return_if_fail (success == TRUE);
 	gtk_tree_model_get (model, &iter, COL_AUTH_TYPE, &contype, -1);
 
-	dialog = advanced_dialog_new (priv->advanced, contype);
-	if (!dialog) {
-		g_warning ("%s: failed to create the Advanced dialog!", __func__);
-		return;
-	}
+	/* Whether there is a TLS page depends on the connection type. */
+	if (   priv->advanced_dialog
+	    && !nm_streq0 (g_object_get_data (G_OBJECT (priv->advanced_dialog), "connection-type"), contype))
+		nm_clear_pointer (&priv->advanced_dialog, gtk_widget_destroy);
+
+	if (!priv->advanced_dialog) {
+		dialog = advanced_dialog_new (contype);
+		if (!dialog) {
+			g_warning ("%s: failed to create the Advanced dialog!", __func__);
+			return;
+		}
+
+		gtk_window_group_add_window (priv->window_group, GTK_WINDOW (dialog));
+		g_signal_connect (G_OBJECT (dialog), "response", G_CALLBACK (advanced_dialog_response_cb), self);
+		g_signal_connect (G_OBJECT (dialog), "close", G_CALLBACK (advanced_dialog_close_cb), self);
+		g_signal_connect (G_OBJECT (dialog), "delete-event", G_CALLBACK (advanced_dialog_delete_cb), self);
+		priv->advanced_dialog = dialog;
+	} else
+		dialog = priv->advanced_dialog;
 
-	gtk_window_group_add_window (priv->window_group, GTK_WINDOW (dialog));
 	if (!priv->window_added) {
 		gtk_window_group_add_window (priv->window_group, GTK_WINDOW (toplevel));
 		priv->window_added = TRUE;
 	}
 
-	gtk_window_set_transient_for (GTK_WINDOW (dialog), GTK_WINDOW (toplevel));
-	g_signal_connect (G_OBJECT (dialog), "response", G_CALLBACK (advanced_dialog_response_cb), self);
-	g_signal_connect (G_OBJECT (dialog), "close", G_CALLBACK (advanced_dialog_close_cb), self);
+	advanced_dialog_set_hash (dialog, priv->advanced);
+	advanced_dialog_load_current_page (dialog);
 
+	gtk_window_set_transient_for (GTK_WINDOW (dialog), GTK_WINDOW (toplevel));
 	gtk_widget_show_all (dialog);
 }
 
@@ -2448,7 +3326,7 @@ init_editor_plugin (OpenvpnEditor *self, NMConnection *connection)
 		if (value)
 			gtk_entry_set_text (GTK_ENTRY (widget), value);
 	}
-	g_signal_connect (G_OBJECT (widget), "changed", G_CALLBACK (stuff_changed_cb), self);
+	g_signal_connect (G_OBJECT (widget), "changed", G_CALLBACK (gateway_changed_cb), self);
 
 	widget = GTK_WIDGET (gtk_builder_get_object (priv->builder, "auth_combo"));
 	g_return_val_if_fail (widget != NULL, FALSE);
@@ -2467,7 +3345,7 @@ init_editor_plugin (OpenvpnEditor *self, NMConnection *connection)
 	/* TLS auth widget */
 	tls_pw_init_auth_widget (priv->builder, s_vpn,
 	                         NM_OPENVPN_CONTYPE_TLS, "tls",
-	                         stuff_changed_cb, self);
+	                         auth_changed_cb, self);
 	gtk_list_store_append (store, &iter);
 	gtk_list_store_set (store, &iter,
 	                    COL_AUTH_NAME, _("Certificates (TLS)"),
@@ -2478,7 +3356,7 @@ init_editor_plugin (OpenvpnEditor *self, NMConnection *connection)
 	/* Password auth widget */
 	tls_pw_init_auth_widget (priv->builder, s_vpn,
 	                         NM_OPENVPN_CONTYPE_PASSWORD, "pw",
-	                         stuff_changed_cb, self);
+	                         auth_changed_cb, self);
 	gtk_list_store_append (store, &iter);
 	gtk_list_store_set (store, &iter,
 	                    COL_AUTH_NAME, _("Password"),
@@ -2492,7 +3370,7 @@ init_editor_plugin (OpenvpnEditor *self, NMConnection *connection)
 	/* Password+TLS auth widget */
 	tls_pw_init_auth_widget (priv->builder, s_vpn,
 	                         NM_OPENVPN_CONTYPE_PASSWORD_TLS, "pw_tls",
-	                         stuff_changed_cb, self);
+	                         auth_changed_cb, self);
 	gtk_list_store_append (store, &iter);
 	gtk_list_store_set (store, &iter,
 	                    COL_AUTH_NAME, _("Password with Certificates (TLS)"),
@@ -2504,7 +3382,7 @@ init_editor_plugin (OpenvpnEditor *self, NMConnection *connection)
 		active = 2;
 
 	/* Static key auth widget */
-	sk_init_auth_widget (priv->builder, s_vpn, stuff_changed_cb, self);
+	sk_init_auth_widget (priv->builder, s_vpn, auth_changed_cb, self);
 
 	gtk_list_store_append (store, &iter);
 	gtk_list_store_set (store, &iter,
@@ -2698,13 +3576,26 @@ dispose (GObject *object)
 	OpenvpnEditor *plugin = OPENVPN_EDITOR (object);
 	OpenvpnEditorPrivate *priv = OPENVPN_EDITOR_GET_PRIVATE (plugin);
 
+	/* gtk_widget_destroy() will remove the window from the window group */
+	nm_clear_pointer (&priv->advanced_dialog, gtk_widget_destroy);
+
+	nm_clear_g_source (&priv->gateway_changed_id);
+	if (priv->auth_files_cancellable) {
+		g_cancellable_cancel (priv->auth_files_cancellable);
+		g_clear_object (&priv->auth_files_cancellable);
+	}
+	nm_clear_pointer (&priv->gateway_tokens, g_hash_table_unref);
+	nm_clear_g_free (&priv->gateway_checked);
+	nm_clear_g_free (&priv->auth_files);
+	g_clear_error (&priv->auth_error);
+
 	g_clear_object (&priv->window_group);
 
 	g_clear_object (&priv->widget);
 
 	g_clear_object (&priv->builder);
 
-	g_clear_pointer (&priv->advanced, g_hash_table_destroy);
+	g_clear_pointer (&priv->advanced, g_hash_table_unref);
 
 	G_OBJECT_CLASS (openvpn_editor_plugin_widget_parent_class)->dispose (object);
 }
@@ -0,0 +1,448 @@
+/*
+ * network-manager-openvpn - OpenVPN integration with NetworkManager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ */
+
+/* Benchmarks the import and export of synthetic profiles, from a minimal
+ * one to ones with tens of thousands of routes, many remotes, huge inline
+ * blobs and long runs of comments.
+ *
+ * For each profile, one JSON object is printed per line, with the
+ * tokenizer throughput, the time, number of allocations and peak RSS of
+ * the import, and the time and number of allocations of the export.
+ *
+ * With --thresholds, the metrics are checked against the bounds in a key
+ * file, and the program fails if one is exceeded. The groups are named
+ * after the profiles, the keys are the metric names prefixed by "min-" or
+ * "max-". For example:
+ *
+ *   [routes-50000]
+ *   max-import-usec=500000
+ *   max-import-allocs=2000000
+ *   min-tokens-per-sec=5000000
+ */
+
+#include "nm-default.h"
+
+#include <errno.h>
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "import-export.h"
+
+/*****************************************************************************/
+
+/* Count the allocations of the import and export. */
+#include "openvpn-alloc-count.h"
+
+/*****************************************************************************/
+
+static void
+rss_peak_reset (void)
+{
+	int fd;
+
+	/* resets VmHWM, since Linux 4.0. Otherwise, the peak of the whole
+	 * run is reported. */
+	fd = open ("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		if (write (fd, "5", 1) != 1) {
+			/* ignore */
+		}
+		close (fd);
+	}
+}
+
+static gint64
+rss_peak_kib (void)
+{
+	gs_free char *contents = NULL;
+	struct rusage usage;
+	const char *p;
+
+	if (   g_file_get_contents ("/proc/self/status", &contents, NULL, NULL)
+	    && (p = strstr (contents, "\nVmHWM:")))
+		return g_ascii_strtoll (p + NM_STRLEN ("\nVmHWM:"), NULL, 10);
+
+	if (getrusage (RUSAGE_SELF, &usage) == 0)
+		return usage.ru_maxrss;
+	return -1;
+}
+
+/*****************************************************************************/
+
+#define PROFILE_HEADER \
+	"client\n" \
+	"dev tun\n" \
+	"proto udp\n" \
+	"ca ca.crt\n" \
+	"cert client.crt\n" \
+	"key client.key\n"
+
+static void
+profile_minimal (GString *str)
+{
+	g_string_append (str, PROFILE_HEADER
+	                      "remote vpn.example.com 1194\n");
+}
+
+static void
+profile_routes (GString *str)
+{
+	guint i;
+
+	g_string_append (str, PROFILE_HEADER
+	                      "remote vpn.example.com 1194\n");
+	for (i = 0; i < 50000; i++)
+		g_string_append_printf (str, "route 10.%u.%u.0 255.255.255.0 10.8.0.1 %u\n", (i >> 8) & 0xFF, i & 0xFF, i % 100);
+}
+
+static void
+profile_remotes (GString *str)
+{
+	guint i;
+
+	g_string_append (str, PROFILE_HEADER);
+	for (i = 0; i < 1000; i++) {
+		if (i % 2)
+			g_string_append_printf (str, "remote vpn%u.example.com %u udp\n", i, 1000 + i);
+		else
+			g_string_append_printf (str, "remote fd01::%x %u\n", i, 1000 + i);
+	}
+}
+
+static void
+profile_crl (GString *str)
+{
+	g_string_append (str, PROFILE_HEADER
+	                      "remote vpn.example.com 1194\n"
+	                      "<crl-verify>\n"
+	                      "-----BEGIN X509 CRL-----\n");
+	while (str->len < 10 * 1024 * 1024)
+		g_string_append (str, "MIIDdzCCAl+gAwIBAgIEAgAAuTANBgkqhkiG9w0BAQUFADBaMQswCQYDVQQGEwJJRTES\n");
+	g_string_append (str, "-----END X509 CRL-----\n"
+	                      "</crl-verify>\n");
+}
+
+static void
+profile_comments (GString *str)
+{
+	guint i;
+
+	g_string_append (str, PROFILE_HEADER);
+	for (i = 0; i < 100000; i++) {
+		g_string_append_printf (str, "%c %06u: the quick brown fox jumps over the lazy dog\n",
+		                        i % 2 ? ';' : '#', i);
+		if (i % 10000 == 0)
+			g_string_append (str, "remote vpn.example.com 1194\n");
+	}
+}
+
+static const struct {
+	const char *name;
+	void (*create) (GString *str);
+} profiles[] = {
+	{ "minimal",         profile_minimal },
+	{ "routes-50000",    profile_routes },
+	{ "remotes-1000",    profile_remotes },
+	{ "crl-10mib",       profile_crl },
+	{ "comments-100000", profile_comments },
+};
+
+/*****************************************************************************/
+
+typedef enum {
+	METRIC_SIZE,
+	METRIC_TOKENS,
+	METRIC_TOKENS_PER_SEC,
+	METRIC_IMPORT_USEC,
+	METRIC_IMPORT_MIB_PER_SEC,
+	METRIC_IMPORT_ALLOCS,
+	METRIC_IMPORT_PEAK_RSS_KIB,
+	METRIC_EXPORT_USEC,
+	METRIC_EXPORT_ALLOCS,
+	_METRIC_NUM,
+} Metric;
+
+static const char *const metric_names[_METRIC_NUM] = {
+	[METRIC_SIZE]                = "size",
+	[METRIC_TOKENS]              = "tokens",
+	[METRIC_TOKENS_PER_SEC]      = "tokens-per-sec",
+	[METRIC_IMPORT_USEC]         = "import-usec",
+	[METRIC_IMPORT_MIB_PER_SEC]  = "import-mib-per-sec",
+	[METRIC_IMPORT_ALLOCS]       = "import-allocs",
+	[METRIC_IMPORT_PEAK_RSS_KIB] = "import-peak-rss-kib",
+	[METRIC_EXPORT_USEC]         = "export-usec",
+	[METRIC_EXPORT_ALLOCS]       = "export-allocs",
+};
+
+static gboolean
+metric_is_known (Metric metric)
+{
+	if (   !NMOVPN_HAVE_ALLOC_COUNT
+	    && NM_IN_SET (metric, METRIC_IMPORT_ALLOCS, METRIC_EXPORT_ALLOCS))
+		return FALSE;
+	return TRUE;
+}
+
+static gboolean
+run_profile (const char *tmpdir,
+             const char *name,
+             const GString *contents,
+             guint iterations,
+             double *metrics,
+             GError **error)
+{
+	gs_free char *path = NULL;
+	guint n_args = 0;
+	gint64 t, allocs;
+	guint i;
+	int fd, errsv;
+
+	path = g_strdup_printf ("%s/%s.ovpn", tmpdir, name);
+
+	for (i = 0; i < _METRIC_NUM; i++)
+		metrics[i] = -1;
+	metrics[METRIC_SIZE] = contents->len;
+
+	fd = open ("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		errsv = errno;
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+		             "cannot open /dev/null: %s", g_strerror (errsv));
+		return FALSE;
+	}
+
+	/* of several iterations, the fastest one counts. */
+	for (i = 0; i < iterations; i++) {
+		gs_unref_object NMConnection *connection = NULL;
+
+		t = g_get_monotonic_time ();
+		if (!_nmovpn_test_args_parse_lines (contents->str, contents->len, &n_args, NULL)) {
+			g_set_error (error, NMV_EDITOR_PLUGIN_ERROR, NMV_EDITOR_PLUGIN_ERROR_FAILED,
+			             "tokenizing failed");
+			close (fd);
+			return FALSE;
+		}
+		t = MAX (g_get_monotonic_time () - t, 1);
+		metrics[METRIC_TOKENS] = n_args;
+		metrics[METRIC_TOKENS_PER_SEC] = MAX (metrics[METRIC_TOKENS_PER_SEC],
+		                                      (double) n_args * G_USEC_PER_SEC / t);
+
+		rss_peak_reset ();
+		allocs = nmovpn_alloc_count_get ();
+		t = g_get_monotonic_time ();
+		connection = do_import (path, contents->str, contents->len, error);
+		t = MAX (g_get_monotonic_time () - t, 1);
+		allocs = nmovpn_alloc_count_get () - allocs;
+		if (!connection) {
+			close (fd);
+			return FALSE;
+		}
+		if (metrics[METRIC_IMPORT_USEC] < 0 || t < metrics[METRIC_IMPORT_USEC])
+			metrics[METRIC_IMPORT_USEC] = t;
+		metrics[METRIC_IMPORT_ALLOCS] = allocs;
+		metrics[METRIC_IMPORT_PEAK_RSS_KIB] = MAX (metrics[METRIC_IMPORT_PEAK_RSS_KIB], rss_peak_kib ());
+
+		allocs = nmovpn_alloc_count_get ();
+		t = g_get_monotonic_time ();
+		if (!do_export_fd (fd, path, connection, error)) {
+			close (fd);
+			return FALSE;
+		}
+		t = MAX (g_get_monotonic_time () - t, 1);
+		allocs = nmovpn_alloc_count_get () - allocs;
+		if (metrics[METRIC_EXPORT_USEC] < 0 || t < metrics[METRIC_EXPORT_USEC])
+			metrics[METRIC_EXPORT_USEC] = t;
+		metrics[METRIC_EXPORT_ALLOCS] = allocs;
+	}
+	close (fd);
+
+	metrics[METRIC_IMPORT_MIB_PER_SEC] =   (double) contents->len / (1024 * 1024)
+	                                     / (metrics[METRIC_IMPORT_USEC] / G_USEC_PER_SEC);
+	return TRUE;
+}
+
+static void
+print_metrics (const char *name, const double *metrics)
+{
+	nm_auto_free_gstring GString *str = g_string_new (NULL);
+	char buf[G_ASCII_DTOSTR_BUF_SIZE];
+	guint i;
+
+	g_string_append_printf (str, "{\"profile\": \"%s\"", name);
+	for (i = 0; i < _METRIC_NUM; i++) {
+		g_string_append_printf (str, ", \"%s\": ", metric_names[i]);
+		if (!metric_is_known (i))
+			g_string_append (str, "null");
+		else if (i == METRIC_TOKENS_PER_SEC || i == METRIC_IMPORT_MIB_PER_SEC)
+			g_string_append (str, g_ascii_formatd (buf, sizeof (buf), "%.1f", metrics[i]));
+		else
+			g_string_append_printf (str, "%" G_GINT64_FORMAT, (gint64) metrics[i]);
+	}
+	g_string_append (str, "}\n");
+	fputs (str->str, stdout);
+	fflush (stdout);
+}
+
+static gboolean
+check_thresholds (GKeyFile *thresholds, const char *name, const double *metrics)
+{
+	gboolean success = TRUE;
+	guint i;
+
+	if (!thresholds || !g_key_file_has_group (thresholds, name))
+		return TRUE;
+
+	for (i = 0; i < _METRIC_NUM; i++) {
+		gs_free char *key_min = g_strdup_printf ("min-%s", metric_names[i]);
+		gs_free char *key_max = g_strdup_printf ("max-%s", metric_names[i]);
+		double bound;
+
+		if (!metric_is_known (i))
+			continue;
+
+		if (g_key_file_has_key (thresholds, name, key_min, NULL)) {
+			bound = g_key_file_get_double (thresholds, name, key_min, NULL);
+			if (metrics[i] < bound) {
+				g_printerr ("%s: %s is %.1f, below the minimum of %.1f\n",
+				            name, metric_names[i], metrics[i], bound);
+				success = FALSE;
+			}
+		}
+		if (g_key_file_has_key (thresholds, name, key_max, NULL)) {
+			bound = g_key_file_get_double (thresholds, name, key_max, NULL);
+			if (metrics[i] > bound) {
+				g_printerr ("%s: %s is %.1f, above the maximum of %.1f\n",
+				            name, metric_names[i], metrics[i], bound);
+				success = FALSE;
+			}
+		}
+	}
+	return success;
+}
+
+static void
+rm_tmpdir (const char *tmpdir)
+{
+	GDir *dir;
+	const char *name;
+
+	/* the inline blobs of the profiles were written there, and the
+	 * shared ones to the "blobs" subdirectory. */
+	dir = g_dir_open (tmpdir, 0, NULL);
+	if (dir) {
+		while ((name = g_dir_read_name (dir))) {
+			gs_free char *path = g_build_filename (tmpdir, name, NULL);
+
+			if (g_file_test (path, G_FILE_TEST_IS_DIR))
+				rm_tmpdir (path);
+			else
+				unlink (path);
+		}
+		g_dir_close (dir);
+	}
+	rmdir (tmpdir);
+}
+
+int
+main (int argc, char *argv[])
+{
+	gs_strfreev char **only = NULL;
+	gs_free char *thresholds_file = NULL;
+	GKeyFile *thresholds = NULL;
+	gs_free char *tmpdir = NULL;
+	GOptionContext *context;
+	GError *error = NULL;
+	int iterations = 3;
+	int exit_status = EXIT_SUCCESS;
+	guint i;
+	GOptionEntry entries[] = {
+		{ "profile", 'p', 0, G_OPTION_ARG_STRING_ARRAY, &only, "Only run the given profile (can be repeated)", "NAME" },
+		{ "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations, "Run each profile N times and report the fastest run (default: 3)", "N" },
+		{ "thresholds", 't', 0, G_OPTION_ARG_FILENAME, &thresholds_file, "Fail if a metric is out of the bounds given in FILE", "FILE" },
+		{ NULL }
+	};
+
+	setlocale (LC_ALL, "");
+
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, entries, NULL);
+	g_option_context_set_summary (context, "Benchmark the import and export of OpenVPN profiles.");
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("Error parsing options: %s\n", error->message);
+		g_option_context_free (context);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+
+	if (iterations < 1) {
+		g_printerr ("Usage: %s [-i N] [-p NAME...] [-t FILE]\n", g_get_prgname ());
+		return EXIT_FAILURE;
+	}
+
+	if (thresholds_file) {
+		thresholds = g_key_file_new ();
+		if (!g_key_file_load_from_file (thresholds, thresholds_file, G_KEY_FILE_NONE, &error)) {
+			g_printerr ("Error reading thresholds: %s\n", error->message);
+			g_error_free (error);
+			g_key_file_unref (thresholds);
+			return EXIT_FAILURE;
+		}
+	}
+
+	tmpdir = g_dir_make_tmp ("nm-openvpn-bench-XXXXXX", &error);
+	if (!tmpdir) {
+		g_printerr ("Error creating temporary directory: %s\n", error->message);
+		g_error_free (error);
+		nm_clear_pointer (&thresholds, g_key_file_unref);
+		return EXIT_FAILURE;
+	}
+	_nmovpn_test_temp_path = tmpdir;
+
+	for (i = 0; i < G_N_ELEMENTS (profiles); i++) {
+		nm_auto_free_gstring GString *contents = NULL;
+		double metrics[_METRIC_NUM];
+
+		if (only && !g_strv_contains ((const char *const *) only, profiles[i].name))
+			continue;
+
+		contents = g_string_new (NULL);
+		profiles[i].create (contents);
+
+		if (!run_profile (tmpdir, profiles[i].name, contents, iterations, metrics, &error)) {
+			g_printerr ("%s: %s\n", profiles[i].name, error->message);
+			g_clear_error (&error);
+			exit_status = EXIT_FAILURE;
+			continue;
+		}
+
+		print_metrics (profiles[i].name, metrics);
+		if (!check_thresholds (thresholds, profiles[i].name, metrics))
+			exit_status = EXIT_FAILURE;
+	}
+
+	rm_tmpdir (tmpdir);
+	nm_clear_pointer (&thresholds, g_key_file_unref);
+	return exit_status;
+}
@@ -0,0 +1,79 @@
+/*
+ * network-manager-openvpn - OpenVPN integration with NetworkManager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ */
+
+#ifndef OPENVPN_ALLOC_COUNT_H
+#define OPENVPN_ALLOC_COUNT_H
+
+#include <stdlib.h>
+
+/* Counts the heap allocations of a test or benchmark program. Include it
+ * in exactly one file of the program, as it defines malloc() and friends.
+ *
+ * Calls from glib (and libnm) go through the PLT, so defining them in the
+ * executable is enough to see those too. That only works with glibc, which
+ * exports its implementation under another name as well. Elsewhere,
+ * NMOVPN_HAVE_ALLOC_COUNT is 0 and the count stays 0. */
+
+#if defined (__GLIBC__)
+#define NMOVPN_HAVE_ALLOC_COUNT 1
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static gsize _nmovpn_alloc_count;
+
+void *
+malloc (size_t size)
+{
+	__atomic_fetch_add (&_nmovpn_alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+	__atomic_fetch_add (&_nmovpn_alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+	__atomic_fetch_add (&_nmovpn_alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_realloc (ptr, size);
+}
+
+static inline gsize
+nmovpn_alloc_count_get (void)
+{
+	return __atomic_load_n (&_nmovpn_alloc_count, __ATOMIC_RELAXED);
+}
+#else
+#define NMOVPN_HAVE_ALLOC_COUNT 0
+
+static inline gsize
+nmovpn_alloc_count_get (void)
+{
+	return 0;
+}
+#endif
+
+#endif /* OPENVPN_ALLOC_COUNT_H */
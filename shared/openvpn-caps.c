@@ -0,0 +1,537 @@
+/*
+ * network-manager-openvpn - OpenVPN integration with NetworkManager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ */
+
+#include "nm-default.h"
+
+#include "openvpn-caps.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* Asking openvpn for its version and the supported ciphers means spawning
+ * it four times. The result only changes when the binary gets replaced,
+ * so it is cached in memory and in a file, keyed by the inode and the
+ * modification time of the binary. */
+
+#define CAPS_GROUP          "openvpn"
+#define CAPS_CACHE_VERSION  2
+
+typedef struct {
+	guint64 dev;
+	guint64 ino;
+	guint64 size;
+	gint64 mtime_sec;
+	gint64 mtime_nsec;
+} CapsKey;
+
+G_LOCK_DEFINE_STATIC (openvpn_caps);
+static NMOvpnCaps *caps_cache;
+static CapsKey caps_cache_key;
+
+/*****************************************************************************/
+
+const char *
+nmovpn_openvpn_find_exepath (void)
+{
+	static const char *paths[] = {
+		"/usr/sbin/openvpn",
+		"/sbin/openvpn",
+		"/usr/local/sbin/openvpn",
+	};
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (paths); i++) {
+		if (g_file_test (paths[i], G_FILE_TEST_EXISTS))
+			return paths[i];
+	}
+	return NULL;
+}
+
+NMOvpnCaps *
+nmovpn_caps_dup (const NMOvpnCaps *caps)
+{
+	NMOvpnCaps *copy;
+
+	if (!caps)
+		return NULL;
+
+	copy = g_slice_new (NMOvpnCaps);
+	copy->exepath = g_strdup (caps->exepath);
+	copy->version = g_strdup (caps->version);
+	copy->version_major = caps->version_major;
+	copy->version_minor = caps->version_minor;
+	copy->has_lists = caps->has_lists;
+	copy->ciphers = g_strdupv (caps->ciphers);
+	copy->digests = g_strdupv (caps->digests);
+	copy->tls_ciphers = g_strdupv (caps->tls_ciphers);
+	copy->has_dco = caps->has_dco;
+	return copy;
+}
+
+void
+nmovpn_caps_free (NMOvpnCaps *caps)
+{
+	if (!caps)
+		return;
+	g_free (caps->exepath);
+	g_free (caps->version);
+	g_strfreev (caps->ciphers);
+	g_strfreev (caps->digests);
+	g_strfreev (caps->tls_ciphers);
+	g_slice_free (NMOvpnCaps, caps);
+}
+
+/*****************************************************************************/
+
+/**
+ * nmovpn_caps_parse_version:
+ * @output: the output of "openvpn --version"
+ * @out_version: (allow-none): the version string, like "2.4.6"
+ * @out_major: (allow-none): the major version
+ * @out_minor: (allow-none): the minor version
+ * @out_has_dco: (allow-none): whether openvpn supports data channel offload
+ *
+ * Returns: %TRUE if @output could be parsed.
+ */
+gboolean
+nmovpn_caps_parse_version (const char *output,
+                           char **out_version,
+                           guint *out_major,
+                           guint *out_minor,
+                           gboolean *out_has_dco)
+{
+	gs_strfreev char **lines = NULL;
+	const char *s;
+	guint minor = 0;
+	gboolean has_dco;
+	guint i;
+
+	/* the output for --version starts with title_string, which starts with PACKAGE_STRING,
+	 * which looks like "OpenVPN 2.#...". Do a strict parsing here... */
+	if (   !output
+	    || !g_str_has_prefix (output, "OpenVPN 2."))
+		return FALSE;
+	s = &output[NM_STRLEN ("OpenVPN 2.")];
+
+	if (!g_ascii_isdigit (s[0]))
+		return FALSE;
+
+	do {
+		if (minor > G_MAXUINT / 100)
+			return FALSE;
+		minor = (minor * 10) + (s[0] - '0');
+	} while (g_ascii_isdigit ((++s)[0]));
+
+	/* the list of features in the title contains "[DCO]" since 2.6.
+	 * There is also a line "DCO version: N/A" if the kernel module is
+	 * not available. */
+	lines = g_strsplit (output, "\n", 0);
+	has_dco = !!strstr (lines[0], "[DCO]");
+	for (i = 1; lines[i]; i++) {
+		if (g_str_has_prefix (lines[i], "DCO version: N/A"))
+			has_dco = FALSE;
+	}
+
+	if (out_version) {
+		const char *v = &output[NM_STRLEN ("OpenVPN ")];
+
+		*out_version = g_strndup (v, strcspn (v, " \t\n"));
+	}
+	NM_SET_OUT (out_major, 2);
+	NM_SET_OUT (out_minor, minor);
+	NM_SET_OUT (out_has_dco, has_dco);
+	return TRUE;
+}
+
+static gboolean
+_is_tls_cipher_name (const char *line)
+{
+	const char *s;
+
+	if (   !g_str_has_prefix (line, "TLS-")
+	    && !g_str_has_prefix (line, "TLS_"))
+		return FALSE;
+	for (s = line; s[0]; s++) {
+		if (   !g_ascii_isupper (s[0])
+		    && !g_ascii_isdigit (s[0])
+		    && !NM_IN_SET (s[0], '-', '_'))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * nmovpn_caps_parse_list:
+ * @output: the output of "openvpn --show-ciphers", "--show-digests"
+ *   or "--show-tls"
+ * @tls: %TRUE for the output of "--show-tls"
+ *
+ * Returns: (transfer full): the names listed in @output.
+ */
+char **
+nmovpn_caps_parse_list (const char *output, gboolean tls)
+{
+	GPtrArray *names;
+	gs_strfreev char **lines = NULL;
+	gboolean ignore_lines = TRUE;
+	char **line;
+
+	names = g_ptr_array_new ();
+	lines = g_strsplit (output ?: "", "\n", 0);
+
+	for (line = lines; *line; line++) {
+		char *space;
+
+		if (tls) {
+			/* the TLS ciphers are interleaved with headings and notes.
+			 * Each cipher is on a line of its own. */
+			g_strstrip (*line);
+			if (_is_tls_cipher_name (*line))
+				g_ptr_array_add (names, g_strdup (*line));
+			continue;
+		}
+
+		/* Don't add anything until after the first blank line. Also,
+		 * any blank line indicates the start of a comment, ended by
+		 * another blank line. */
+		if (!(*line)[0]) {
+			ignore_lines = !ignore_lines;
+			continue;
+		}
+
+		if (ignore_lines)
+			continue;
+
+		space = strchr (*line, ' ');
+		if (space)
+			*space = '\0';
+
+		if ((*line)[0])
+			g_ptr_array_add (names, g_strdup (*line));
+	}
+
+	g_ptr_array_add (names, NULL);
+	return (char **) g_ptr_array_free (names, FALSE);
+}
+
+/*****************************************************************************/
+
+static gboolean
+_caps_key_get (const char *exepath, CapsKey *key)
+{
+	struct stat st;
+
+	if (stat (exepath, &st) != 0 || !S_ISREG (st.st_mode))
+		return FALSE;
+
+	memset (key, 0, sizeof (*key));
+	key->dev = st.st_dev;
+	key->ino = st.st_ino;
+	key->size = st.st_size;
+	key->mtime_sec = st.st_mtim.tv_sec;
+	key->mtime_nsec = st.st_mtim.tv_nsec;
+	return TRUE;
+}
+
+static char *
+_caps_cache_file_default (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "NetworkManager-openvpn", "openvpn-caps", NULL);
+}
+
+static NMOvpnCaps *
+_caps_load (const char *exepath, const CapsKey *key, const char *cache_file)
+{
+	gs_unref_keyfile GKeyFile *kf = NULL;
+	gs_free char *path = NULL;
+	NMOvpnCaps *caps;
+
+	kf = g_key_file_new ();
+	if (!g_key_file_load_from_file (kf, cache_file, G_KEY_FILE_NONE, NULL))
+		return NULL;
+
+	path = g_key_file_get_string (kf, CAPS_GROUP, "path", NULL);
+	if (   g_key_file_get_integer (kf, CAPS_GROUP, "cache-version", NULL) != CAPS_CACHE_VERSION
+	    || !nm_streq0 (path, exepath)
+	    || g_key_file_get_uint64 (kf, CAPS_GROUP, "dev", NULL) != key->dev
+	    || g_key_file_get_uint64 (kf, CAPS_GROUP, "ino", NULL) != key->ino
+	    || g_key_file_get_uint64 (kf, CAPS_GROUP, "size", NULL) != key->size
+	    || g_key_file_get_int64 (kf, CAPS_GROUP, "mtime", NULL) != key->mtime_sec
+	    || g_key_file_get_int64 (kf, CAPS_GROUP, "mtime-nsec", NULL) != key->mtime_nsec)
+		return NULL;
+
+	caps = g_slice_new0 (NMOvpnCaps);
+	caps->exepath = g_steal_pointer (&path);
+	caps->version = g_key_file_get_string (kf, CAPS_GROUP, "version", NULL);
+	caps->version_major = g_key_file_get_integer (kf, CAPS_GROUP, "version-major", NULL);
+	caps->version_minor = g_key_file_get_integer (kf, CAPS_GROUP, "version-minor", NULL);
+	caps->has_dco = g_key_file_get_boolean (kf, CAPS_GROUP, "dco", NULL);
+	caps->has_lists = g_key_file_get_boolean (kf, CAPS_GROUP, "lists", NULL);
+	caps->ciphers = g_key_file_get_string_list (kf, CAPS_GROUP, "ciphers", NULL, NULL) ?: g_new0 (char *, 1);
+	caps->digests = g_key_file_get_string_list (kf, CAPS_GROUP, "digests", NULL, NULL) ?: g_new0 (char *, 1);
+	caps->tls_ciphers = g_key_file_get_string_list (kf, CAPS_GROUP, "tls-ciphers", NULL, NULL) ?: g_new0 (char *, 1);
+	return caps;
+}
+
+static void
+_caps_save (const NMOvpnCaps *caps, const CapsKey *key, const char *cache_file)
+{
+	gs_unref_keyfile GKeyFile *kf = NULL;
+	gs_free char *dirname = NULL;
+	gs_free char *contents = NULL;
+	gsize len;
+
+	kf = g_key_file_new ();
+	g_key_file_set_integer (kf, CAPS_GROUP, "cache-version", CAPS_CACHE_VERSION);
+	g_key_file_set_string (kf, CAPS_GROUP, "path", caps->exepath);
+	g_key_file_set_uint64 (kf, CAPS_GROUP, "dev", key->dev);
+	g_key_file_set_uint64 (kf, CAPS_GROUP, "ino", key->ino);
+	g_key_file_set_uint64 (kf, CAPS_GROUP, "size", key->size);
+	g_key_file_set_int64 (kf, CAPS_GROUP, "mtime", key->mtime_sec);
+	g_key_file_set_int64 (kf, CAPS_GROUP, "mtime-nsec", key->mtime_nsec);
+	if (caps->version)
+		g_key_file_set_string (kf, CAPS_GROUP, "version", caps->version);
+	g_key_file_set_integer (kf, CAPS_GROUP, "version-major", caps->version_major);
+	g_key_file_set_integer (kf, CAPS_GROUP, "version-minor", caps->version_minor);
+	g_key_file_set_boolean (kf, CAPS_GROUP, "dco", caps->has_dco);
+	g_key_file_set_boolean (kf, CAPS_GROUP, "lists", caps->has_lists);
+	g_key_file_set_string_list (kf, CAPS_GROUP, "ciphers",
+	                            (const char *const *) caps->ciphers, g_strv_length (caps->ciphers));
+	g_key_file_set_string_list (kf, CAPS_GROUP, "digests",
+	                            (const char *const *) caps->digests, g_strv_length (caps->digests));
+	g_key_file_set_string_list (kf, CAPS_GROUP, "tls-ciphers",
+	                            (const char *const *) caps->tls_ciphers, g_strv_length (caps->tls_ciphers));
+
+	contents = g_key_file_to_data (kf, &len, NULL);
+
+	/* the cache is only an optimization. Ignore errors. */
+	dirname = g_path_get_dirname (cache_file);
+	if (g_mkdir_with_parents (dirname, 0755) != 0)
+		return;
+	(void) g_file_set_contents (cache_file, contents, len, NULL);
+}
+
+static char *
+_caps_spawn (const char *exepath, const char *arg, gboolean allow_usage_exit)
+{
+	gs_free char *s_stdout = NULL;
+	int exit_code;
+
+	if (!g_spawn_sync ("/",
+	                   (char *[]) { (char *) exepath, (char *) arg, NULL },
+	                   NULL,
+	                   G_SPAWN_STDERR_TO_DEV_NULL,
+	                   NULL,
+	                   NULL,
+	                   &s_stdout,
+	                   NULL,
+	                   &exit_code,
+	                   NULL))
+		return NULL;
+
+	/* for --version, expect return code 1 (OPENVPN_EXIT_STATUS_USAGE).
+	 * Since 2.5.0, it returns 0. */
+	if (   !WIFEXITED (exit_code)
+	    || !(   WEXITSTATUS (exit_code) == 0
+	         || (allow_usage_exit && WEXITSTATUS (exit_code) == 1)))
+		return NULL;
+
+	return g_steal_pointer (&s_stdout);
+}
+
+static NMOvpnCaps *
+_caps_probe (const char *exepath, gboolean lists)
+{
+	NMOvpnCaps *caps;
+	gs_free char *s_version = NULL;
+	gs_free char *s_ciphers = NULL;
+	gs_free char *s_digests = NULL;
+	gs_free char *s_tls = NULL;
+
+	caps = g_slice_new0 (NMOvpnCaps);
+	caps->exepath = g_strdup (exepath);
+
+	s_version = _caps_spawn (exepath, "--version", TRUE);
+	nmovpn_caps_parse_version (s_version,
+	                           &caps->version,
+	                           &caps->version_major,
+	                           &caps->version_minor,
+	                           &caps->has_dco);
+
+	/* each list costs another run of openvpn. */
+	if (!lists) {
+		caps->ciphers = g_new0 (char *, 1);
+		caps->digests = g_new0 (char *, 1);
+		caps->tls_ciphers = g_new0 (char *, 1);
+		return caps;
+	}
+	caps->has_lists = TRUE;
+
+	s_ciphers = _caps_spawn (exepath, "--show-ciphers", FALSE);
+	caps->ciphers = nmovpn_caps_parse_list (s_ciphers, FALSE);
+
+	s_digests = _caps_spawn (exepath, "--show-digests", FALSE);
+	caps->digests = nmovpn_caps_parse_list (s_digests, FALSE);
+
+	s_tls = _caps_spawn (exepath, "--show-tls", FALSE);
+	caps->tls_ciphers = nmovpn_caps_parse_list (s_tls, TRUE);
+
+	return caps;
+}
+
+/**
+ * nmovpn_caps_get:
+ * @exepath: (allow-none): the openvpn binary, or %NULL to search for it
+ * @cache_file: (allow-none): the file to cache the capabilities in, or
+ *   %NULL for a file in the user's cache directory
+ * @probe: whether to run openvpn if the capabilities are not cached yet
+ *
+ * Returns the capabilities of the openvpn binary. Unless the binary
+ * changed, they come from memory or from @cache_file. Otherwise openvpn
+ * is run to find out, as far as @probe allows. With
+ * %NMOVPN_CAPS_PROBE_VERSION, the returned capabilities may lack the lists.
+ *
+ * Returns: (transfer full): the capabilities, or %NULL if openvpn cannot
+ *   be found or the capabilities are not cached and @probe is
+ *   %NMOVPN_CAPS_PROBE_NONE.
+ */
+NMOvpnCaps *
+nmovpn_caps_get (const char *exepath, const char *cache_file, NMOvpnCapsProbe probe)
+{
+	gs_free char *cache_file_free = NULL;
+	NMOvpnCaps *caps;
+	CapsKey key;
+
+	if (!exepath) {
+		exepath = nmovpn_openvpn_find_exepath ();
+		if (!exepath)
+			return NULL;
+	}
+
+	if (!_caps_key_get (exepath, &key))
+		return NULL;
+
+	G_LOCK (openvpn_caps);
+	if (   caps_cache
+	    && nm_streq (caps_cache->exepath, exepath)
+	    && memcmp (&caps_cache_key, &key, sizeof (key)) == 0
+	    && (caps_cache->has_lists || probe == NMOVPN_CAPS_PROBE_VERSION)) {
+		caps = nmovpn_caps_dup (caps_cache);
+		G_UNLOCK (openvpn_caps);
+		return caps;
+	}
+	G_UNLOCK (openvpn_caps);
+
+	if (!cache_file)
+		cache_file = cache_file_free = _caps_cache_file_default ();
+
+	caps = _caps_load (exepath, &key, cache_file);
+	if (   caps
+	    && !caps->has_lists
+	    && probe != NMOVPN_CAPS_PROBE_VERSION)
+		g_clear_pointer (&caps, nmovpn_caps_free);
+	if (!caps) {
+		if (probe == NMOVPN_CAPS_PROBE_NONE)
+			return NULL;
+		caps = _caps_probe (exepath, probe == NMOVPN_CAPS_PROBE_ALL);
+		_caps_save (caps, &key, cache_file);
+	}
+
+	G_LOCK (openvpn_caps);
+	nmovpn_caps_free (caps_cache);
+	caps_cache = caps;
+	caps_cache_key = key;
+	caps = nmovpn_caps_dup (caps_cache);
+	G_UNLOCK (openvpn_caps);
+
+	return caps;
+}
+
+/*****************************************************************************/
+
+typedef struct {
+	char *exepath;
+	char *cache_file;
+	GCancellable *cancellable;
+	NMOvpnCapsCallback callback;
+	gpointer user_data;
+	NMOvpnCaps *caps;
+} RefreshData;
+
+static gboolean
+_refresh_done (gpointer user_data)
+{
+	RefreshData *data = user_data;
+
+	if (!g_cancellable_is_cancelled (data->cancellable))
+		data->callback (data->caps, data->user_data);
+
+	nmovpn_caps_free (data->caps);
+	g_free (data->exepath);
+	g_free (data->cache_file);
+	g_clear_object (&data->cancellable);
+	g_slice_free (RefreshData, data);
+	return G_SOURCE_REMOVE;
+}
+
+static gpointer
+_refresh_thread (gpointer user_data)
+{
+	RefreshData *data = user_data;
+
+	data->caps = nmovpn_caps_get (data->exepath, data->cache_file, NMOVPN_CAPS_PROBE_ALL);
+	g_idle_add (_refresh_done, data);
+	return NULL;
+}
+
+/**
+ * nmovpn_caps_refresh_async:
+ * @exepath: (allow-none): the openvpn binary, or %NULL to search for it
+ * @cache_file: (allow-none): the cache file, see nmovpn_caps_get()
+ * @cancellable: (allow-none): to prevent the callback from being invoked
+ * @callback: invoked with the capabilities, or %NULL if openvpn
+ *   cannot be found. The callback does not own them.
+ * @user_data: the argument for @callback
+ *
+ * Like nmovpn_caps_get() with probing, but without blocking. openvpn is
+ * run in a separate thread and @callback is invoked from the default main
+ * context.
+ */
+void
+nmovpn_caps_refresh_async (const char *exepath,
+                           const char *cache_file,
+                           GCancellable *cancellable,
+                           NMOvpnCapsCallback callback,
+                           gpointer user_data)
+{
+	RefreshData *data;
+
+	g_return_if_fail (callback);
+
+	data = g_slice_new0 (RefreshData);
+	data->exepath = g_strdup (exepath);
+	data->cache_file = g_strdup (cache_file);
+	data->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+	data->callback = callback;
+	data->user_data = user_data;
+
+	g_thread_unref (g_thread_new ("openvpn-caps", _refresh_thread, data));
+}
@@ -0,0 +1,74 @@
+/*
+ * network-manager-openvpn - OpenVPN integration with NetworkManager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ */
+
+#ifndef OPENVPN_CAPS_H
+#define OPENVPN_CAPS_H
+
+/* What the installed openvpn binary supports. */
+typedef struct {
+	char *exepath;
+
+	/* the version, like "2.4.6", or %NULL if unknown. */
+	char *version;
+	guint version_major;
+	guint version_minor;
+
+	/* the data channel ciphers (--show-ciphers), message digests
+	 * (--show-digests) and TLS ciphers (--show-tls). Empty unless
+	 * @has_lists. */
+	gboolean has_lists;
+	char **ciphers;
+	char **digests;
+	char **tls_ciphers;
+
+	/* whether openvpn was built with data channel offload. */
+	gboolean has_dco;
+} NMOvpnCaps;
+
+const char *nmovpn_openvpn_find_exepath (void);
+
+NMOvpnCaps *nmovpn_caps_dup (const NMOvpnCaps *caps);
+void nmovpn_caps_free (NMOvpnCaps *caps);
+
+gboolean nmovpn_caps_parse_version (const char *output,
+                                    char **out_version,
+                                    guint *out_major,
+                                    guint *out_minor,
+                                    gboolean *out_has_dco);
+
+char **nmovpn_caps_parse_list (const char *output, gboolean tls);
+
+typedef enum {
+	NMOVPN_CAPS_PROBE_NONE,      /* never run openvpn */
+	NMOVPN_CAPS_PROBE_VERSION,   /* only the version is needed, run "openvpn --version" */
+	NMOVPN_CAPS_PROBE_ALL,       /* run openvpn for everything */
+} NMOvpnCapsProbe;
+
+NMOvpnCaps *nmovpn_caps_get (const char *exepath, const char *cache_file, NMOvpnCapsProbe probe);
+
+typedef void (*NMOvpnCapsCallback) (NMOvpnCaps *caps, gpointer user_data);
+
+void nmovpn_caps_refresh_async (const char *exepath,
+                                const char *cache_file,
+                                GCancellable *cancellable,
+                                NMOvpnCapsCallback callback,
+                                gpointer user_data);
+
+#endif  /* OPENVPN_CAPS_H */
@@ -0,0 +1,73 @@
+/*
+ * network-manager-openvpn - OpenVPN integration with NetworkManager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ */
+
+#ifndef OPENVPN_PROBES_H
+#define OPENVPN_PROBES_H
+
+/* Static tracepoints (USDT) in nm-openvpn-service and its helper, built
+ * with --enable-sdt. A disabled probe is a single nop, so unlike --debug
+ * they can stay in production builds, and they never carry secrets.
+ *
+ * All probes use the provider "nm_openvpn". In the service:
+ *
+ *   spawn_start                  starting to build the openvpn command line
+ *   spawn_end (pid)              openvpn was spawned
+ *   mgmt_line (type)             a line from the management interface. Only
+ *                                its type, the part up to the first ':' like
+ *                                ">PASSWORD" or ">STATE", or "" for lines
+ *                                without one, like the log history.
+ *   auth_reply (type)            replied to a ">PASSWORD:Need" request, with
+ *                                the type like "Auth" or "Private Key"
+ *   secrets_request (message)    asking NetworkManager for secrets
+ *   secrets_received             NetworkManager sent new secrets
+ *   child_exit (pid, status)     openvpn exited, with the wait() status
+ *
+ * In the helper:
+ *
+ *   env_parsed                   the configuration was built from the
+ *                                environment openvpn passed
+ *   config_send                  about to call SetConfig()
+ *   config_ack (success)         SetConfig() returned
+ *
+ * For example, the time from spawning openvpn to the configuration:
+ *
+ *   bpftrace -e '
+ *     usdt:/usr/libexec/nm-openvpn-service:nm_openvpn:spawn_end { @start = nsecs; }
+ *     usdt:/usr/libexec/nm-openvpn-service-openvpn-helper:nm_openvpn:config_ack /@start/ {
+ *       @usec = hist ((nsecs - @start) / 1000); }'
+ */
+
+#if WITH_SDT
+
+#include <sys/sdt.h>
+
+#define NMOVPN_PROBE(name)                 DTRACE_PROBE (nm_openvpn, name)
+#define NMOVPN_PROBE1(name, arg1)          DTRACE_PROBE1 (nm_openvpn, name, arg1)
+#define NMOVPN_PROBE2(name, arg1, arg2)    DTRACE_PROBE2 (nm_openvpn, name, arg1, arg2)
+
+#else
+
+#define NMOVPN_PROBE(name)                 G_STMT_START { } G_STMT_END
+#define NMOVPN_PROBE1(name, arg1)          G_STMT_START { (void) (arg1); } G_STMT_END
+#define NMOVPN_PROBE2(name, arg1, arg2)    G_STMT_START { (void) (arg1); (void) (arg2); } G_STMT_END
+
+#endif
+
+#endif /* OPENVPN_PROBES_H */
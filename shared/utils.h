@@ -99,6 +99,16 @@ typedef enum {
 	NMOVPN_COMP_LEGACY_LZO_ADAPTIVE,  /* "--comp-lzo [adaptive]" */
 } NMOvpnComp;
 
+typedef enum {
+	NMOVPN_FILE_TYPE_UNKNOWN,
+	NMOVPN_FILE_TYPE_PEM,              /* PEM, not encrypted */
+	NMOVPN_FILE_TYPE_PEM_ENCRYPTED,    /* PEM with "Proc-Type: 4,ENCRYPTED" */
+	NMOVPN_FILE_TYPE_PKCS8_ENCRYPTED,  /* "BEGIN ENCRYPTED PRIVATE KEY" */
+	NMOVPN_FILE_TYPE_PKCS12,
+} NMOvpnFileType;
+
+NMOvpnFileType nmovpn_file_classify (const char *filepath);
+
 gboolean is_pkcs12 (const char *filepath);
 
 gboolean is_encrypted (const char *filename);
@@ -33,12 +33,11 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <ctype.h>
-#include <netdb.h>
 #include <syslog.h>
 
 #include "nm-utils/nm-shared-utils.h"
 #include "nm-utils/nm-vpn-plugin-macros.h"
+#include "openvpn-probes.h"
 
 extern char **environ;
 
@@ -72,6 +71,10 @@ _LOGD_enabled (void)
 
 /*****************************************************************************/
 
+/* The test program includes this file with NMOVPN_HELPER_NO_MAIN defined to
+ * run build_config() and send_config() against a mock D-Bus peer. */
+
+#ifndef NMOVPN_HELPER_NO_MAIN
 static void
 helper_failed (GDBusProxy *proxy, const char *reason)
 {
@@ -90,18 +93,23 @@ helper_failed (GDBusProxy *proxy, const char *reason)
 
 	exit (1);
 }
+#endif
 
 static void
 send_config (GDBusProxy *proxy, GVariant *config,
              GVariant *ip4config, GVariant *ip6config)
 {
 	GError *err = NULL;
-
-	if (!g_dbus_proxy_call_sync (proxy, "SetConfig",
-	                             g_variant_new ("(*)", config),
-	                             G_DBUS_CALL_FLAGS_NONE, -1,
-	                             NULL,
-	                             &err)) {
+	gs_unref_variant GVariant *ret = NULL;
+
+	NMOVPN_PROBE (config_send);
+	ret = g_dbus_proxy_call_sync (proxy, "SetConfig",
+	                              g_variant_new ("(*)", config),
+	                              G_DBUS_CALL_FLAGS_NONE, -1,
+	                              NULL,
+	                              &err);
+	NMOVPN_PROBE1 (config_ack, ret != NULL);
+	if (!ret) {
 		_LOGW ("Could not send configuration information: %s", err->message);
 		g_error_free (err);
 		err = NULL;
@@ -344,193 +352,79 @@ get_ip6_routes (const char *fallback_gateway)
 static GVariant *
 trusted_remote_to_gvariant (void)
 {
-	char *tmp;
-	GVariant *val = NULL;
-	const char *p;
-	gboolean is_name = FALSE;
+	const char *tmp;
+	GVariant *val;
+
+	/* The external gateway must be the address openvpn actually connected
+	 * to. openvpn exports it as trusted_ip/trusted_ip6 once the tunnel is
+	 * established. Only if that is missing (for example, with a static key)
+	 * fall back to remote_1. The service resolves hostname remotes before
+	 * starting openvpn in that case, so remote_1 is the literal address
+	 * openvpn uses.
+	 *
+	 * Never resolve a hostname here: the lookup blocks the up-script (and
+	 * thus openvpn) on DNS, and might not return the address openvpn
+	 * connected to. */
 
 	tmp = getenv ("trusted_ip6");
-	if (tmp) {
+	if (tmp && tmp[0]) {
 		val = addr6_to_gvariant (tmp);
-		if (val == NULL) {
-			_LOGW ("failed to convert VPN gateway address '%s' (%d)",
-			       tmp, errno);
-			return NULL;
-		}
+		if (!val)
+			_LOGW ("failed to convert VPN gateway address trusted_ip6 = \"%s\"", tmp);
 		return val;
 	}
 
 	tmp = getenv ("trusted_ip");
-	if (!tmp)
-		tmp = getenv ("remote_1");
-	if (!tmp) {
-		_LOGW ("did not receive remote gateway address");
-		return NULL;
-	}
-
-	/* Check if it seems to be a hostname */
-	p = tmp;
-	while (*p) {
-		if (*p != '.' && !isdigit (*p)) {
-			is_name = TRUE;
-			break;
-		}
-		p++;
+	if (tmp && tmp[0]) {
+		val = addr4_to_gvariant (tmp);
+		if (!val)
+			_LOGW ("failed to convert VPN gateway address trusted_ip = \"%s\"", tmp);
+		return val;
 	}
 
-	/* Resolve a hostname if required. Only look for IPv4 addresses */
-	if (is_name) {
-		struct in_addr addr;
-		struct addrinfo hints;
-		struct addrinfo *result = NULL, *rp;
-		int err;
-
-		addr.s_addr = 0;
-		memset (&hints, 0, sizeof (hints));
-
-		hints.ai_family = AF_INET;
-		hints.ai_flags = AI_ADDRCONFIG;
-		err = getaddrinfo (tmp, NULL, &hints, &result);
-		if (err != 0) {
-			_LOGW ("failed to look up VPN gateway address '%s' (%d)",
-			       tmp, err);
-			return NULL;
-		}
-
-		/* FIXME: so what if the name resolves to multiple IP addresses?  We
-		 * don't know which one pptp decided to use so we could end up using a
-		 * different one here, and the VPN just won't work.
-		 */
-		for (rp = result; rp; rp = rp->ai_next) {
-			if (   (rp->ai_family == AF_INET)
-			    && (rp->ai_addrlen == sizeof (struct sockaddr_in))) {
-				struct sockaddr_in *inptr = (struct sockaddr_in *) rp->ai_addr;
-
-				memcpy (&addr, &(inptr->sin_addr), sizeof (struct in_addr));
-				break;
-			}
-		}
-
-		freeaddrinfo (result);
-		if (addr.s_addr != 0)
-			return g_variant_new_uint32 (addr.s_addr);
-		else {
-			_LOGW ("failed to convert or look up VPN gateway address '%s'",
-			       tmp);
-			return NULL;
-		}
-	} else {
-		val = addr4_to_gvariant (tmp);
-		if (val == NULL) {
-			_LOGW ("failed to convert VPN gateway address '%s' (%d)",
-			       tmp, errno);
-			return NULL;
-		}
+	tmp = getenv ("remote_1");
+	if (!tmp || !tmp[0]) {
+		_LOGW ("did not receive remote gateway address");
+		return NULL;
 	}
 
+	val = addr4_to_gvariant (tmp);
+	if (!val)
+		val = addr6_to_gvariant (tmp);
+	if (!val)
+		_LOGW ("VPN gateway remote_1 = \"%s\" is not an IP address", tmp);
 	return val;
 }
 
-int
-main (int argc, char *argv[])
+/* Collect the configuration from the environment (and, on restart, the
+ * arguments) that openvpn passes to the up-script. @argv must already be
+ * shifted so that it only contains the arguments provided by openvpn.
+ *
+ * On failure, @out_failure is set to a description of what is missing. */
+static gboolean
+build_config (int argc, char **argv, int tapdev,
+              GVariant **out_config,
+              GVariant **out_ip4config,
+              GVariant **out_ip6config,
+              const char **out_failure)
 {
-	GDBusProxy *proxy;
 	GVariantBuilder builder, ip4builder, ip6builder;
 	GVariant *ip4config, *ip6config;
 	char *tmp;
 	GVariant *val;
 	int i;
-	GError *err = NULL;
 	GPtrArray *dns4_list, *dns6_list;
 	GPtrArray *nbns_list;
 	GPtrArray *dns_domains;
 	struct in_addr temp_addr;
-	int tapdev = -1;
-	char **iter;
-	int shift = 0;
 	gboolean is_restart;
 	gboolean has_ip4_prefix = FALSE;
 	gboolean has_ip4_address = FALSE;
 	gboolean has_ip6_address = FALSE;
-	gchar *bus_name = NM_DBUS_SERVICE_OPENVPN;
 	gsize size;
 
-#if !GLIB_CHECK_VERSION (2, 35, 0)
-	g_type_init ();
-#endif
-
-	for (i = 1; i < argc; i++) {
-		if (!strcmp (argv[i], "--")) {
-			i++;
-			break;
-		}
-		if (nm_streq (argv[i], "--debug")) {
-			if (i + 2 >= argc) {
-				g_printerr ("Missing debug arguments (requires <LEVEL> <PREFIX_TOKEN>)\n");
-				exit (1);
-			}
-			gl.log_level = _nm_utils_ascii_str_to_int64 (argv[++i], 10, 0, LOG_DEBUG, 0);
-			gl.log_prefix_token = argv[++i];
-		} else if (!strcmp (argv[i], "--tun"))
-			tapdev = 0;
-		else if (!strcmp (argv[i], "--tap"))
-			tapdev = 1;
-		else if (!strcmp (argv[i], "--bus-name")) {
-			if (++i == argc) {
-				g_printerr ("Missing bus name argument\n");
-				exit (1);
-			}
-			if (!g_dbus_is_name (argv[i])) {
-				g_printerr ("Invalid bus name\n");
-				exit (1);
-			}
-			bus_name = argv[i];
-		} else
-			break;
-	}
-	shift = i - 1;
-
-	if (_LOGD_enabled ()) {
-		GString *args;
-
-		args = g_string_new (NULL);
-		for (i = 0; i < argc; i++) {
-			if (i > 0)
-				g_string_append_c (args, ' ');
-			if (shift && 1 + shift == i)
-				g_string_append (args, "  ");
-			tmp = g_strescape (argv[i], NULL);
-			g_string_append_printf (args, "\"%s\"", tmp);
-			g_free (tmp);
-		}
-
-		_LOGD ("command line: %s", args->str);
-		g_string_free (args, TRUE);
-
-		for (iter = environ; iter && *iter; iter++)
-			_LOGD ("environment: %s", *iter);
-	}
-
-	/* shift the arguments to the right leaving only those provided by openvpn */
-	argv[shift] = argv[0];
-	argv += shift;
-	argc -= shift;
-
 	is_restart = argc >= 7 && !g_strcmp0 (argv[6], "restart");
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                       G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
-	                                       NULL,
-	                                       bus_name,
-	                                       NM_VPN_DBUS_PLUGIN_PATH,
-	                                       NM_VPN_DBUS_PLUGIN_INTERFACE,
-	                                       NULL, &err);
-	if (!proxy) {
-		_LOGW ("Could not create a D-Bus proxy: %s", err->message);
-		g_error_free (err);
-		exit (1);
-	}
-
 	g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
 	g_variant_builder_init (&ip4builder, G_VARIANT_TYPE_VARDICT);
 	g_variant_builder_init (&ip6builder, G_VARIANT_TYPE_VARDICT);
@@ -539,8 +433,10 @@ main (int argc, char *argv[])
 	val = trusted_remote_to_gvariant ();
 	if (val)
 		g_variant_builder_add (&builder, "{sv}", NM_VPN_PLUGIN_CONFIG_EXT_GATEWAY, val);
-	else
-		helper_failed (proxy, "VPN Gateway");
+	else {
+		*out_failure = "VPN Gateway";
+		goto fail;
+	}
 
 	/* Internal VPN subnet gateway */
 	tmp = getenv ("route_vpn_gateway");
@@ -558,8 +454,10 @@ main (int argc, char *argv[])
 	val = str_to_gvariant (tmp, FALSE);
 	if (val)
 		g_variant_builder_add (&builder, "{sv}", NM_VPN_PLUGIN_CONFIG_TUNDEV, val);
-	else
-		helper_failed (proxy, "Tunnel Device");
+	else {
+		*out_failure = "Tunnel Device";
+		goto fail;
+	}
 
 	if (tapdev == -1)
 		tapdev = strncmp (tmp, "tap", 3) == 0;
@@ -573,8 +471,10 @@ main (int argc, char *argv[])
 		if (val) {
 			has_ip4_address = TRUE;
 			g_variant_builder_add (&ip4builder, "{sv}", NM_VPN_PLUGIN_IP4_CONFIG_ADDRESS, val);
-		} else
-			helper_failed (proxy, "IP4 Address");
+		} else {
+			*out_failure = "IP4 Address";
+			goto fail;
+		}
 	}
 
 	/* PTP address; for vpnc PTP address == internal IP4 address */
@@ -635,8 +535,10 @@ main (int argc, char *argv[])
 		if (val) {
 			g_variant_builder_add (&ip6builder, "{sv}", NM_VPN_PLUGIN_IP6_CONFIG_ADDRESS, val);
 			has_ip6_address = TRUE;
-		} else
-			helper_failed (proxy, "IP6 Address");
+		} else {
+			*out_failure = "IP6 Address";
+			goto fail;
+		}
 	}
 
 	/* IPv6 netbits */
@@ -769,13 +671,123 @@ main (int argc, char *argv[])
 		g_variant_builder_add (&builder, "{sv}", NM_VPN_PLUGIN_CONFIG_HAS_IP6, val);
 	}
 
-	if (!ip4config && !ip6config)
-		helper_failed (proxy, "IPv4 or IPv6 configuration");
+	if (!ip4config && !ip6config) {
+		*out_failure = "IPv4 or IPv6 configuration";
+		g_variant_builder_clear (&builder);
+		return FALSE;
+	}
+
+	*out_config = g_variant_builder_end (&builder);
+	*out_ip4config = ip4config;
+	*out_ip6config = ip6config;
+	return TRUE;
+
+fail:
+	g_variant_builder_clear (&builder);
+	g_variant_builder_clear (&ip4builder);
+	g_variant_builder_clear (&ip6builder);
+	return FALSE;
+}
+
+#ifndef NMOVPN_HELPER_NO_MAIN
+int
+main (int argc, char *argv[])
+{
+	GDBusProxy *proxy;
+	GVariant *config, *ip4config, *ip6config;
+	const char *failure = NULL;
+	char *tmp;
+	int i;
+	GError *err = NULL;
+	int tapdev = -1;
+	char **iter;
+	int shift = 0;
+	gchar *bus_name = NM_DBUS_SERVICE_OPENVPN;
+
+#if !GLIB_CHECK_VERSION (2, 35, 0)
+	g_type_init ();
+#endif
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp (argv[i], "--")) {
+			i++;
+			break;
+		}
+		if (nm_streq (argv[i], "--debug")) {
+			if (i + 2 >= argc) {
+				g_printerr ("Missing debug arguments (requires <LEVEL> <PREFIX_TOKEN>)\n");
+				exit (1);
+			}
+			gl.log_level = _nm_utils_ascii_str_to_int64 (argv[++i], 10, 0, LOG_DEBUG, 0);
+			gl.log_prefix_token = argv[++i];
+		} else if (!strcmp (argv[i], "--tun"))
+			tapdev = 0;
+		else if (!strcmp (argv[i], "--tap"))
+			tapdev = 1;
+		else if (!strcmp (argv[i], "--bus-name")) {
+			if (++i == argc) {
+				g_printerr ("Missing bus name argument\n");
+				exit (1);
+			}
+			if (!g_dbus_is_name (argv[i])) {
+				g_printerr ("Invalid bus name\n");
+				exit (1);
+			}
+			bus_name = argv[i];
+		} else
+			break;
+	}
+	shift = i - 1;
+
+	if (_LOGD_enabled ()) {
+		GString *args;
+
+		args = g_string_new (NULL);
+		for (i = 0; i < argc; i++) {
+			if (i > 0)
+				g_string_append_c (args, ' ');
+			if (shift && 1 + shift == i)
+				g_string_append (args, "  ");
+			tmp = g_strescape (argv[i], NULL);
+			g_string_append_printf (args, "\"%s\"", tmp);
+			g_free (tmp);
+		}
+
+		_LOGD ("command line: %s", args->str);
+		g_string_free (args, TRUE);
+
+		for (iter = environ; iter && *iter; iter++)
+			_LOGD ("environment: %s", *iter);
+	}
+
+	/* shift the arguments to the right leaving only those provided by openvpn */
+	argv[shift] = argv[0];
+	argv += shift;
+	argc -= shift;
+
+	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+	                                       G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+	                                       NULL,
+	                                       bus_name,
+	                                       NM_VPN_DBUS_PLUGIN_PATH,
+	                                       NM_VPN_DBUS_PLUGIN_INTERFACE,
+	                                       NULL, &err);
+	if (!proxy) {
+		_LOGW ("Could not create a D-Bus proxy: %s", err->message);
+		g_error_free (err);
+		exit (1);
+	}
+
+	if (!build_config (argc, argv, tapdev, &config, &ip4config, &ip6config, &failure))
+		helper_failed (proxy, failure);
+
+	NMOVPN_PROBE (env_parsed);
 
 	/* Send the config info to nm-openvpn-service */
-	send_config (proxy, g_variant_builder_end (&builder), ip4config, ip6config);
+	send_config (proxy, config, ip4config, ip6config);
 
 	g_object_unref (proxy);
 
 	return 0;
 }
+#endif /* NMOVPN_HELPER_NO_MAIN */
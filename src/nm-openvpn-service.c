@@ -43,6 +43,8 @@
 #include <glib-unix.h>
 
 #include "utils.h"
+#include "openvpn-caps.h"
+#include "openvpn-probes.h"
 #include "nm-utils/nm-shared-utils.h"
 #include "nm-utils/nm-vpn-plugin-macros.h"
 
@@ -58,6 +60,11 @@ static struct {
 	int log_level_ovpn;
 	bool log_syslog;
 	GSList *pids_pending_list;
+
+	/* the paths can be overridden by the environment, for tests. */
+	const char *rundir;
+	const char *openvpn_binary;
+	const char *helper_path;
 } gl/*obal*/;
 
 #define NM_OPENVPN_HELPER_PATH LIBEXECDIR"/nm-openvpn-service-openvpn-helper"
@@ -121,6 +128,11 @@ typedef struct {
 	NMOpenvpnPluginIOData *io_data;
 	gboolean interactive;
 	char *mgt_path;
+	NMConnection *gateway_connection;
+	GPtrArray *gateway_hosts;
+	GHashTable *gateway_addresses;
+	GCancellable *gateway_cancellable;
+	guint flight_recorder_id;
 } NMOpenvpnPluginPrivate;
 
 G_DEFINE_TYPE (NMOpenvpnPlugin, nm_openvpn_plugin, NM_TYPE_VPN_SERVICE_PLUGIN)
@@ -211,15 +223,193 @@ static const ValidProperty valid_secrets[] = {
 
 /*****************************************************************************/
 
-#define _NMLOG(level, ...) \
-	G_STMT_START { \
-		if (gl.log_level >= (level)) { \
-			g_print ("nm-openvpn[%ld] %-7s " _NM_UTILS_MACRO_FIRST (__VA_ARGS__) "\n", \
-			         (long) getpid (), \
-			         nm_utils_syslog_to_str (level) \
-			         _NM_UTILS_MACRO_REST (__VA_ARGS__)); \
-		} \
-	} G_STMT_END
+/* The flight recorder keeps the last messages of the service and of openvpn
+ * in memory, whatever the log level is, and dumps them when the connection
+ * fails or when asked via D-Bus. That way, failures come with context without
+ * running at a high log level all the time.
+ *
+ * Recording a message only reserves a slot with an atomic increment and
+ * formats into it, there is no lock and no allocation. All logging happens
+ * on the main thread, as does the dump, so the slots are never read while
+ * being written. */
+
+#define FLIGHT_RECORDER_SIZE     512 /* a power of two, so the index can wrap */
+#define FLIGHT_RECORDER_MSG_LEN  240
+
+#define NM_DBUS_INTERFACE_OPENVPN_FLIGHT_RECORDER "org.freedesktop.NetworkManager.openvpn.FlightRecorder"
+
+typedef enum {
+	FLIGHT_SOURCE_SERVICE,
+	FLIGHT_SOURCE_OPENVPN,
+} FlightSource;
+
+typedef struct {
+	gint64 timestamp;
+	guint8 level;
+	guint8 source;
+	char msg[FLIGHT_RECORDER_MSG_LEN];
+} FlightRecord;
+
+static struct {
+	FlightRecord records[FLIGHT_RECORDER_SIZE];
+	volatile gint head;
+	guint dumped;
+} flight;
+
+/* hides what follows a secret, for the messages of openvpn, which may quote
+ * management commands or pushed options. It errs on the side of hiding too
+ * much: everything up to the end of the message goes. */
+static void
+flight_redact (char *msg, gsize size)
+{
+	static const struct {
+		const char *keyword;
+		gboolean any_value;
+	} keywords[] = {
+		{ "password",   FALSE },
+		{ "passphrase", FALSE },
+		{ "auth-token", TRUE  },
+		{ "CRV1::",     TRUE  },
+	};
+	char *p;
+	guint i;
+
+	for (p = msg; *p; p++) {
+		for (i = 0; i < G_N_ELEMENTS (keywords); i++) {
+			gsize len = strlen (keywords[i].keyword);
+			char *value;
+
+			if (g_ascii_strncasecmp (p, keywords[i].keyword, len) != 0)
+				continue;
+			value = &p[len];
+
+			/* notifications like ">PASSWORD:Need 'Auth'" carry no secret. */
+			if (p > msg && p[-1] == '>')
+				continue;
+
+			if (keywords[i].any_value ? !*value
+			                          : !(   NM_IN_SET (*value, '=', ':')
+			                              || (*value == ' ' && NM_IN_SET (value[1], '"', '\'')))) {
+				continue;
+			}
+
+			g_strlcpy (value, " <hidden>", size - (value - msg));
+			return;
+		}
+	}
+}
+
+_nm_printf (3, 0)
+static void
+flight_record_v (FlightSource source, int level, const char *fmt, va_list ap)
+{
+	FlightRecord *record;
+
+	record = &flight.records[((guint) g_atomic_int_add (&flight.head, 1)) % FLIGHT_RECORDER_SIZE];
+	record->timestamp = g_get_monotonic_time ();
+	record->level = level;
+	record->source = source;
+
+	g_vsnprintf (record->msg, sizeof (record->msg), fmt, ap);
+
+	g_strchomp (record->msg);
+	if (source == FLIGHT_SOURCE_OPENVPN)
+		flight_redact (record->msg, sizeof (record->msg));
+}
+
+_nm_printf (3, 4)
+static void
+flight_record (FlightSource source, int level, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start (ap, fmt);
+	flight_record_v (source, level, fmt, ap);
+	va_end (ap);
+}
+
+/* records a line of the log of openvpn, "{time},{flags},{message}", as sent
+ * by the management interface. */
+static void
+flight_record_openvpn (const char *line)
+{
+	const char *flags;
+	const char *msg;
+	int level = LOG_INFO;
+
+	flags = strchr (line, ',');
+	msg = flags ? strchr (++flags, ',') : NULL;
+	if (!msg) {
+		flight_record (FLIGHT_SOURCE_OPENVPN, level, "%s", line);
+		return;
+	}
+
+	if (memchr (flags, 'F', msg - flags))
+		level = LOG_ERR;
+	else if (memchr (flags, 'N', msg - flags) || memchr (flags, 'W', msg - flags))
+		level = LOG_WARNING;
+	else if (memchr (flags, 'D', msg - flags))
+		level = LOG_DEBUG;
+
+	flight_record (FLIGHT_SOURCE_OPENVPN, level, "%s", msg + 1);
+}
+
+/* prints the messages recorded since the last dump, in the same format as
+ * the rest of our log. */
+static void
+flight_recorder_dump (const char *reason)
+{
+	guint head = g_atomic_int_get (&flight.head);
+	guint n = MIN (head - flight.dumped, FLIGHT_RECORDER_SIZE);
+	gint64 now = g_get_monotonic_time ();
+	guint i;
+
+	g_print ("nm-openvpn[%ld] %-7s flight recorder: %u messages before %s%s\n",
+	         (long) getpid (), nm_utils_syslog_to_str (LOG_NOTICE),
+	         n, reason, n ? ":" : "");
+
+	for (i = head - n; i != head; i++) {
+		const FlightRecord *record = &flight.records[i % FLIGHT_RECORDER_SIZE];
+
+		g_print ("nm-openvpn[%ld] %-7s flight recorder: [%s %+.3fs] %s\n",
+		         (long) getpid (),
+		         nm_utils_syslog_to_str (record->level),
+		         record->source == FLIGHT_SOURCE_OPENVPN ? "openvpn" : "service",
+		         (record->timestamp - now) / (double) G_USEC_PER_SEC,
+		         record->msg);
+	}
+
+	flight.dumped = head;
+}
+
+/*****************************************************************************/
+
+/* every message goes to the flight recorder, and is printed if the log
+ * level asks for it. The arguments are evaluated only once. */
+_nm_printf (2, 3)
+static void
+_nmlog (int level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (gl.log_level >= level) {
+		gs_free char *msg = NULL;
+
+		va_start (ap, fmt);
+		msg = g_strdup_vprintf (fmt, ap);
+		va_end (ap);
+		g_print ("nm-openvpn[%ld] %-7s %s\n",
+		         (long) getpid (),
+		         nm_utils_syslog_to_str (level),
+		         msg);
+	}
+
+	va_start (ap, fmt);
+	flight_record_v (FLIGHT_SOURCE_SERVICE, level, fmt, ap);
+	va_end (ap);
+}
+
+#define _NMLOG(level, ...) _nmlog ((level), __VA_ARGS__)
 
 static gboolean
 _LOGD_enabled (void)
@@ -508,72 +698,28 @@ nm_openvpn_secrets_validate (NMSettingVpn *s_vpn, GError **error)
 
 /*****************************************************************************/
 
-static const char *
-openvpn_binary_find_exepath (void)
-{
-	static const char *paths[] = {
-		"/usr/sbin/openvpn",
-		"/sbin/openvpn",
-		"/usr/local/sbin/openvpn",
-	};
-	int i;
-
-	for (i = 0; i < G_N_ELEMENTS (paths); i++) {
-		if (g_file_test (paths[i], G_FILE_TEST_EXISTS))
-			return paths[i];
-	}
-	return NULL;
-}
-
 static OpenvpnBinaryVersion
 openvpn_binary_detect_version (const char *exepath)
 {
-	gs_free char *s_stdout = NULL;
-	const char *s;
-	int exit_code;
-	int n;
+	NMOvpnCaps *caps;
+	OpenvpnBinaryVersion version;
+	gs_free char *cache_file = NULL;
 
 	g_return_val_if_fail (exepath && exepath[0] == '/', OPENVPN_BINARY_VERSION_UNKNOWN);
 
-	if (!g_spawn_sync (NULL,
-	                   (char *[]) { (char *) exepath, "--version", NULL },
-	                   NULL,
-	                   G_SPAWN_STDERR_TO_DEV_NULL,
-	                   NULL,
-	                   NULL,
-	                   &s_stdout,
-	                   NULL,
-	                   &exit_code,
-	                   NULL))
-		return OPENVPN_BINARY_VERSION_UNKNOWN;
-
-	if (   !WIFEXITED (exit_code)
-	    || !NM_IN_SET(WEXITSTATUS (exit_code), 0, 1)) {
-		/* expect return code 1 (OPENVPN_EXIT_STATUS_USAGE).
-		 * Since 2.5.0, it returns 0. */
-		return OPENVPN_BINARY_VERSION_UNKNOWN;
-	}
-
-	/* the output for --version starts with title_string, which starts with PACKAGE_STRING,
-	 * which looks like "OpenVPN 2.#...". Do a strict parsing here... */
-	if (   !s_stdout
-	    || !g_str_has_prefix (s_stdout, "OpenVPN 2."))
-		return OPENVPN_BINARY_VERSION_UNKNOWN;
-	s = &s_stdout[NM_STRLEN ("OpenVPN 2.")];
-
-	if (!g_ascii_isdigit (s[0]))
-		return OPENVPN_BINARY_VERSION_UNKNOWN;
-
-	n = 0;
-	do {
-		if (n > G_MAXINT / 100)
-			return OPENVPN_BINARY_VERSION_UNKNOWN;
-		n = (n * 10) + (s[0] - '0');
-	} while (g_ascii_isdigit ((++s)[0]));
-
-	if (n <= 3)
-		return OPENVPN_BINARY_VERSION_2_3_OR_OLDER;
-	return OPENVPN_BINARY_VERSION_2_4_OR_NEWER;
+	/* the capabilities are cached in RUNDIR, so openvpn is only
+	 * run once per boot, and again after an update. Connecting only
+	 * needs the version, so don't run openvpn for the lists. */
+	cache_file = g_build_filename (gl.rundir, "nm-openvpn-caps", NULL);
+	caps = nmovpn_caps_get (exepath, cache_file, NMOVPN_CAPS_PROBE_VERSION);
+	if (!caps || !caps->version)
+		version = OPENVPN_BINARY_VERSION_UNKNOWN;
+	else if (caps->version_minor <= 3)
+		version = OPENVPN_BINARY_VERSION_2_3_OR_OLDER;
+	else
+		version = OPENVPN_BINARY_VERSION_2_4_OR_NEWER;
+	nmovpn_caps_free (caps);
+	return version;
 }
 
 static OpenvpnBinaryVersion
@@ -631,6 +777,8 @@ pids_pending_child_watch_cb (GPid pid, gint status, gpointer user_data)
 	PidsPendingData *pid_data = user_data;
 	NMOpenvpnPlugin *plugin;
 
+	NMOVPN_PROBE2 (child_exit, (int) pid, status);
+
 	if (WIFEXITED (status)) {
 		int exit_status;
 
@@ -924,6 +1072,7 @@ handle_auth (NMOpenvpnPluginIOData *io_data,
 			                 requested_auth,
 			                 username,
 			                 response);
+			NMOVPN_PROBE1 (auth_reply, requested_auth);
 			nm_clear_g_free (&io_data->challenge_state_id);
 			nm_clear_g_free (&io_data->challenge_text);
 		} else if (username != NULL && io_data->password != NULL) {
@@ -931,6 +1080,7 @@ handle_auth (NMOpenvpnPluginIOData *io_data,
 			                 requested_auth,
 			                 username,
 			                 io_data->password);
+			NMOVPN_PROBE1 (auth_reply, requested_auth);
 		} else {
 			hints = g_new0 (const char *, 3);
 			if (!username) {
@@ -961,6 +1111,7 @@ handle_auth (NMOpenvpnPluginIOData *io_data,
 			g_io_channel_write_chars (io_data->socket_channel, buf, strlen (buf), NULL, NULL);
 			g_io_channel_flush (io_data->socket_channel, NULL);
 			g_free (buf);
+			NMOVPN_PROBE1 (auth_reply, requested_auth);
 		} else {
 			hints = g_new0 (const char *, 2);
 			hints[i++] = NM_OPENVPN_KEY_CERTPASS;
@@ -973,6 +1124,7 @@ handle_auth (NMOpenvpnPluginIOData *io_data,
 			                 requested_auth,
 			                 io_data->proxy_username,
 			                 io_data->proxy_password);
+			NMOVPN_PROBE1 (auth_reply, requested_auth);
 		} else {
 			hints = g_new0 (const char *, 3);
 			if (!io_data->proxy_username) {
@@ -1000,11 +1152,34 @@ _request_secrets (NMOpenvpnPlugin *plugin,
 {
 	gs_free char *joined = NULL;
 
+	NMOVPN_PROBE1 (secrets_request, message);
+
 	_LOGD ("Requesting new secrets: '%s', %s%s%s", message,
 	        NM_PRINT_FMT_QUOTED (hints, "(", (joined = g_strjoinv (",", (char **) hints)), ")", "no hints"));
 	nm_vpn_service_plugin_secrets_required ((NMVpnServicePlugin *) plugin, message, (const char **) hints);
 }
 
+#if WITH_SDT
+/* the type of a management line for the mgmt_line probe, like ">PASSWORD"
+ * or "SUCCESS". Never more of the line, it may carry secrets. */
+static const char *
+mgmt_line_type (const char *str, char *buf, gsize buf_len)
+{
+	gsize i;
+
+	for (i = 0; i + 1 < buf_len; i++) {
+		if (str[i] == ':') {
+			buf[i] = '\0';
+			return buf;
+		}
+		if (!(g_ascii_isupper (str[i]) || NM_IN_SET (str[i], '>', '-', '_')))
+			break;
+		buf[i] = str[i];
+	}
+	return "";
+}
+#endif
+
 static gboolean
 handle_management_socket (NMOpenvpnPlugin *plugin,
                           GIOChannel *source,
@@ -1030,6 +1205,26 @@ handle_management_socket (NMOpenvpnPlugin *plugin,
 		return TRUE;
 	}
 
+#if WITH_SDT
+	{
+		char type_buf[32];
+
+		NMOVPN_PROBE1 (mgmt_line, mgmt_line_type (str, type_buf, sizeof (type_buf)));
+	}
+#endif
+
+	/* the log of openvpn, for the flight recorder. After "log on all", the
+	 * history comes as plain lines starting with the timestamp, the
+	 * real-time messages as ">LOG:" notifications. */
+	if (g_str_has_prefix (str, ">LOG:")) {
+		flight_record_openvpn (&str[NM_STRLEN (">LOG:")]);
+		goto out;
+	}
+	if (g_ascii_isdigit (str[0])) {
+		flight_record_openvpn (str);
+		goto out;
+	}
+
 	_LOGD ("VPN request '%s'", str);
 
 	auth = get_detail (str, ">PASSWORD:Need '");
@@ -1153,6 +1348,11 @@ nm_openvpn_connect_timer_cb (gpointer data)
 		                                                  G_IO_IN,
 		                                                  nm_openvpn_socket_data_cb,
 		                                                  plugin);
+
+		/* have openvpn send us its log (so far, and from now on) for the
+		 * flight recorder. This doesn't change the verbosity of openvpn. */
+		g_io_channel_write_chars (io_data->socket_channel, "log on all\n", -1, NULL, NULL);
+		g_io_channel_flush (io_data->socket_channel, NULL);
 	}
 
 out:
@@ -1254,20 +1454,206 @@ mgt_path_create (NMConnection *connection, GError **error)
 	int errsv;
 
 	/* Setup runtime directory */
-	if (g_mkdir_with_parents (RUNDIR, 0755) != 0) {
+	if (g_mkdir_with_parents (gl.rundir, 0755) != 0) {
 		errsv = errno;
 		g_set_error (error,
 		             NM_VPN_PLUGIN_ERROR,
 		             NM_VPN_PLUGIN_ERROR_BAD_ARGUMENTS,
 		             "Cannot create run-dir %s (%s)",
-		             RUNDIR, g_strerror (errsv));
+		             gl.rundir, g_strerror (errsv));
 		return NULL;
 	}
 
-	return g_strdup_printf (RUNDIR"/nm-openvpn-%s",
+	return g_strdup_printf ("%s/nm-openvpn-%s",
+	                        gl.rundir,
 	                        nm_connection_get_uuid (connection));
 }
 
+/* The helper needs the address of the VPN gateway, which openvpn doesn't
+ * export as trusted_ip when it calls the up-script before it received
+ * anything from the peer, as it does with a static key. The helper then
+ * takes remote_1, which only is authoritative if it is a literal address.
+ * So for static key connections, resolve the hostname remotes before
+ * starting openvpn and pass it the addresses instead. That way openvpn and
+ * the helper agree on the gateway, and the helper never waits on DNS. */
+
+static gboolean nm_openvpn_start_openvpn_binary (NMOpenvpnPlugin *plugin,
+                                                 NMConnection *connection,
+                                                 GError **error);
+
+static void
+gateway_lookup_clear (NMOpenvpnPlugin *plugin)
+{
+	NMOpenvpnPluginPrivate *priv = NM_OPENVPN_PLUGIN_GET_PRIVATE (plugin);
+
+	if (priv->gateway_cancellable) {
+		g_cancellable_cancel (priv->gateway_cancellable);
+		g_clear_object (&priv->gateway_cancellable);
+	}
+	g_clear_object (&priv->gateway_connection);
+	g_clear_pointer (&priv->gateway_hosts, g_ptr_array_unref);
+	g_clear_pointer (&priv->gateway_addresses, g_hash_table_unref);
+}
+
+/* Returns the address @host resolved to that suits @proto ("udp4",
+ * "tcp6", ...), or %NULL to pass @host on to openvpn unchanged. */
+static const char *
+gateway_lookup_get (NMOpenvpnPlugin *plugin, const char *host, const char *proto)
+{
+	NMOpenvpnPluginPrivate *priv = NM_OPENVPN_PLUGIN_GET_PRIVATE (plugin);
+	const char *const*addresses;
+	char family = '\0';
+	gboolean is_ip6;
+
+	if (!priv->gateway_addresses)
+		return NULL;
+
+	addresses = g_hash_table_lookup (priv->gateway_addresses, host);
+	if (!addresses)
+		return NULL;
+
+	if (proto && proto[0])
+		family = proto[strlen (proto) - 1];
+
+	for (; *addresses; addresses++) {
+		is_ip6 = !!strchr (*addresses, ':');
+		if (   (family == '4' && is_ip6)
+		    || (family == '6' && !is_ip6))
+			continue;
+		return *addresses;
+	}
+	return NULL;
+}
+
+static void gateway_lookup_next (NMOpenvpnPlugin *plugin);
+
+static void
+gateway_lookup_cb (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	NMOpenvpnPlugin *plugin;
+	NMOpenvpnPluginPrivate *priv;
+	gs_free_error GError *error = NULL;
+	GList *addresses, *iter;
+	const char *host;
+	char **strv;
+	guint i;
+
+	addresses = g_resolver_lookup_by_name_finish (G_RESOLVER (source), result, &error);
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		return;
+
+	plugin = user_data;
+	priv = NM_OPENVPN_PLUGIN_GET_PRIVATE (plugin);
+	host = priv->gateway_hosts->pdata[priv->gateway_hosts->len - 1];
+
+	if (addresses) {
+		strv = g_new (char *, g_list_length (addresses) + 1);
+		for (iter = addresses, i = 0; iter; iter = iter->next)
+			strv[i++] = g_inet_address_to_string (iter->data);
+		strv[i] = NULL;
+		g_resolver_free_addresses (addresses);
+
+		_LOGD ("VPN gateway %s resolved to %s", host, strv[0]);
+		g_hash_table_insert (priv->gateway_addresses, g_strdup (host), strv);
+	} else {
+		/* leave it to openvpn, which reports the error if it needs
+		 * this remote. */
+		_LOGW ("Could not resolve the VPN gateway %s: %s", host, error->message);
+	}
+
+	g_ptr_array_remove_index (priv->gateway_hosts, priv->gateway_hosts->len - 1);
+	gateway_lookup_next (plugin);
+}
+
+static void
+gateway_lookup_next (NMOpenvpnPlugin *plugin)
+{
+	NMOpenvpnPluginPrivate *priv = NM_OPENVPN_PLUGIN_GET_PRIVATE (plugin);
+	gs_unref_object GResolver *resolver = NULL;
+	gs_unref_object NMConnection *connection = NULL;
+	gs_free_error GError *error = NULL;
+
+	if (priv->gateway_hosts->len > 0) {
+		resolver = g_resolver_get_default ();
+		g_resolver_lookup_by_name_async (resolver,
+		                                 priv->gateway_hosts->pdata[priv->gateway_hosts->len - 1],
+		                                 priv->gateway_cancellable,
+		                                 gateway_lookup_cb, plugin);
+		return;
+	}
+
+	connection = g_steal_pointer (&priv->gateway_connection);
+	g_clear_object (&priv->gateway_cancellable);
+	g_clear_pointer (&priv->gateway_hosts, g_ptr_array_unref);
+
+	if (!nm_openvpn_start_openvpn_binary (plugin, connection, &error)) {
+		_LOGW ("Could not start openvpn: %s", error->message);
+		nm_vpn_service_plugin_failure (NM_VPN_SERVICE_PLUGIN (plugin), NM_VPN_PLUGIN_FAILURE_CONNECT_FAILED);
+	}
+}
+
+/* Returns %TRUE if lookups were started. openvpn is then started once
+ * they completed. */
+static gboolean
+gateway_lookup_start (NMOpenvpnPlugin *plugin, NMConnection *connection)
+{
+	NMOpenvpnPluginPrivate *priv = NM_OPENVPN_PLUGIN_GET_PRIVATE (plugin);
+	gs_unref_ptrarray GPtrArray *hosts = NULL;
+	gs_free char *tmp_clone = NULL;
+	NMSettingVpn *s_vpn;
+	char *tmp_remaining;
+	const char *tmp, *tok;
+	guint i;
+
+	gateway_lookup_clear (plugin);
+
+	s_vpn = nm_connection_get_setting_vpn (connection);
+	if (!s_vpn)
+		return FALSE;
+
+	tmp = nm_setting_vpn_get_data_item (s_vpn, NM_OPENVPN_KEY_CONNECTION_TYPE);
+	if (!nm_streq0 (tmp, NM_OPENVPN_CONTYPE_STATIC_KEY))
+		return FALSE;
+
+	/* openvpn needs the hostname to prepend the random label to it. */
+	tmp = nm_setting_vpn_get_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE_RANDOM_HOSTNAME);
+	if (nm_streq0 (tmp, "yes"))
+		return FALSE;
+
+	tmp = nm_setting_vpn_get_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE);
+	if (!tmp || !*tmp)
+		return FALSE;
+
+	hosts = g_ptr_array_new_with_free_func (g_free);
+	tmp_remaining = tmp_clone = g_strdup (tmp);
+	while ((tok = strsep (&tmp_remaining, " \t,")) != NULL) {
+		gs_free char *str_free = NULL;
+		const char *host;
+
+		if (nmovpn_remote_parse (tok, &str_free, &host, NULL, NULL, NULL) >= 0)
+			continue;
+		if (g_hostname_is_ip_address (host))
+			continue;
+		for (i = 0; i < hosts->len; i++) {
+			if (nm_streq (hosts->pdata[i], host))
+				break;
+		}
+		if (i == hosts->len)
+			g_ptr_array_add (hosts, g_strdup (host));
+	}
+
+	if (!hosts->len)
+		return FALSE;
+
+	priv->gateway_connection = g_object_ref (connection);
+	priv->gateway_hosts = g_steal_pointer (&hosts);
+	priv->gateway_addresses = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                                 g_free, (GDestroyNotify) g_strfreev);
+	priv->gateway_cancellable = g_cancellable_new ();
+	gateway_lookup_next (plugin);
+	return TRUE;
+}
+
 #define MAX_GROUPS 128
 static gboolean
 is_dir_writable (const char *dir, const char *user)
@@ -1348,6 +1734,8 @@ nm_openvpn_start_openvpn_binary (NMOpenvpnPlugin *plugin,
 	gs_free char *cmd_log = NULL;
 	NMOvpnComp comp;
 
+	NMOVPN_PROBE (spawn_start);
+
 	s_vpn = nm_connection_get_setting_vpn (connection);
 	if (!s_vpn) {
 		g_set_error_literal (error,
@@ -1375,7 +1763,7 @@ nm_openvpn_start_openvpn_binary (NMOpenvpnPlugin *plugin,
 		return FALSE;
 
 	/* Find openvpn */
-	openvpn_binary = openvpn_binary_find_exepath ();
+	openvpn_binary = gl.openvpn_binary ?: nmovpn_openvpn_find_exepath ();
 	if (!openvpn_binary) {
 		g_set_error_literal (error,
 		                     NM_VPN_PLUGIN_ERROR,
@@ -1418,7 +1806,7 @@ nm_openvpn_start_openvpn_binary (NMOpenvpnPlugin *plugin,
 				continue;
 
 			num_remotes++;
-			args_add_strv (args, "--remote", host);
+			args_add_strv (args, "--remote", gateway_lookup_get (plugin, host, proto) ?: host);
 
 			if (port) {
 				if (!args_add_numstr (args, port))
@@ -1878,11 +2266,17 @@ nm_openvpn_start_openvpn_binary (NMOpenvpnPlugin *plugin,
 	 */
 	args_add_strv (args, "--script-security", "2");
 
+	/* Management socket for localhost access to supply username and password */
+	g_clear_pointer (&priv->mgt_path, g_free);
+	priv->mgt_path = mgt_path_create (connection, error);
+	if (!priv->mgt_path)
+		return FALSE;
+
 	/* Up script, called when connection has been established or has been restarted */
 	g_object_get (plugin, NM_VPN_SERVICE_PLUGIN_DBUS_SERVICE_NAME, &bus_name, NULL);
 	args_add_strv (args, "--up");
 	args_add_str_take (args, g_strdup_printf ("%s --debug %d %ld --bus-name %s %s --",
-	                                          NM_OPENVPN_HELPER_PATH,
+	                                          gl.helper_path,
 	                                          gl.log_level,
 	                                          (long) getpid(),
 	                                          bus_name,
@@ -1894,11 +2288,6 @@ nm_openvpn_start_openvpn_binary (NMOpenvpnPlugin *plugin,
 	args_add_strv (args, "--persist-key");
 	args_add_strv (args, "--persist-tun");
 
-	/* Management socket for localhost access to supply username and password */
-	g_clear_pointer (&priv->mgt_path, g_free);
-	priv->mgt_path = mgt_path_create (connection, error);
-	if (!priv->mgt_path)
-		return FALSE;
 	args_add_strv (args, "--management", priv->mgt_path, "unix");
 	args_add_strv (args, "--management-client-user", "root");
 	args_add_strv (args, "--management-client-group", "root");
@@ -2004,6 +2393,8 @@ nm_openvpn_start_openvpn_binary (NMOpenvpnPlugin *plugin,
 	                    G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, error))
 		return FALSE;
 
+	NMOVPN_PROBE1 (spawn_end, (int) pid);
+
 	pids_pending_add (pid, plugin);
 
 	g_warn_if_fail (!priv->pid);
@@ -2098,6 +2489,8 @@ real_disconnect (NMVpnServicePlugin *plugin,
 		g_clear_pointer (&priv->mgt_path, g_free);
 	}
 
+	gateway_lookup_clear (NM_OPENVPN_PLUGIN (plugin));
+
 	if (priv->pid) {
 		pids_pending_send_sigterm (pids_pending_get (priv->pid));
 		priv->pid = 0;
@@ -2124,6 +2517,9 @@ _connect_common (NMVpnServicePlugin *plugin,
 		g_error_free (local);
 	}
 
+	if (gateway_lookup_start (NM_OPENVPN_PLUGIN (plugin), connection))
+		return TRUE;
+
 	return nm_openvpn_start_openvpn_binary (NM_OPENVPN_PLUGIN (plugin),
 	                                        connection,
 	                                        error);
@@ -2208,6 +2604,8 @@ real_new_secrets (NMVpnServicePlugin *base_plugin,
 		return FALSE;
 	}
 
+	NMOVPN_PROBE (secrets_received);
+
 	_LOGD ("VPN received new secrets; sending to management interface");
 
 	update_io_data_from_vpn_setting (priv->io_data, s_vpn, NULL);
@@ -2238,6 +2636,16 @@ dispose (GObject *object)
 	NMOpenvpnPluginPrivate *priv = NM_OPENVPN_PLUGIN_GET_PRIVATE (object);
 
 	nm_clear_g_source (&priv->connect_timer);
+	gateway_lookup_clear (NM_OPENVPN_PLUGIN (object));
+
+	if (priv->flight_recorder_id) {
+		gs_unref_object GDBusConnection *connection = NULL;
+
+		connection = nm_vpn_service_plugin_get_connection ((NMVpnServicePlugin *) object);
+		if (connection)
+			g_dbus_connection_unregister_object (connection, priv->flight_recorder_id);
+		priv->flight_recorder_id = 0;
+	}
 
 	if (priv->pid) {
 		pids_pending_send_sigterm (pids_pending_get (priv->pid));
@@ -2287,6 +2695,66 @@ plugin_state_changed (NMOpenvpnPlugin *plugin,
 	}
 }
 
+static void
+plugin_failure (NMOpenvpnPlugin *plugin,
+                NMVpnPluginFailure reason,
+                gpointer user_data)
+{
+	flight_recorder_dump ("the failure");
+}
+
+static void
+flight_recorder_method_call (GDBusConnection *connection,
+                             const char *sender,
+                             const char *object_path,
+                             const char *interface_name,
+                             const char *method_name,
+                             GVariant *parameters,
+                             GDBusMethodInvocation *invocation,
+                             gpointer user_data)
+{
+	flight_recorder_dump ("the D-Bus request");
+	g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static const GDBusInterfaceVTable flight_recorder_vtable = {
+	.method_call = flight_recorder_method_call,
+};
+
+/* lets root dump the flight recorder at any time, with
+ * "busctl call org.freedesktop.NetworkManager.openvpn /org/freedesktop/NetworkManager/VPN/Plugin
+ * org.freedesktop.NetworkManager.openvpn.FlightRecorder Dump". */
+static void
+flight_recorder_export (NMOpenvpnPlugin *plugin)
+{
+	static const char introspection[] =
+		"<node>"
+		"  <interface name='" NM_DBUS_INTERFACE_OPENVPN_FLIGHT_RECORDER "'>"
+		"    <method name='Dump'/>"
+		"  </interface>"
+		"</node>";
+	NMOpenvpnPluginPrivate *priv = NM_OPENVPN_PLUGIN_GET_PRIVATE (plugin);
+	gs_unref_object GDBusConnection *connection = NULL;
+	GDBusNodeInfo *info;
+	GError *error = NULL;
+
+	connection = nm_vpn_service_plugin_get_connection ((NMVpnServicePlugin *) plugin);
+	if (!connection)
+		return;
+
+	info = g_dbus_node_info_new_for_xml (introspection, NULL);
+	priv->flight_recorder_id = g_dbus_connection_register_object (connection,
+	                                                              NM_VPN_DBUS_PLUGIN_PATH,
+	                                                              info->interfaces[0],
+	                                                              &flight_recorder_vtable,
+	                                                              NULL, NULL, &error);
+	g_dbus_node_info_unref (info);
+	if (!priv->flight_recorder_id) {
+		_LOGW ("Could not export the flight recorder: %s", error->message);
+		g_error_free (error);
+	}
+}
+
 NMOpenvpnPlugin *
 nm_openvpn_plugin_new (const char *bus_name)
 {
@@ -2300,6 +2768,8 @@ nm_openvpn_plugin_new (const char *bus_name)
 
 	if (plugin) {
 		g_signal_connect (G_OBJECT (plugin), "state-changed", G_CALLBACK (plugin_state_changed), NULL);
+		g_signal_connect (G_OBJECT (plugin), "failure", G_CALLBACK (plugin_failure), NULL);
+		flight_recorder_export (plugin);
 	} else {
 		_LOGW ("Failed to initialize a plugin instance: %s", error->message);
 		g_error_free (error);
@@ -2399,6 +2869,12 @@ main (int argc, char *argv[])
 	                                              10, 0, 1,
 	                                              gl.debug ? 0 : 1);
 
+	/* for running against a fake openvpn, without root. Like with
+	 * NM_OPENVPN_USER, whoever starts us controls these anyway. */
+	gl.rundir = getenv ("NM_OPENVPN_RUNDIR") ?: RUNDIR;
+	gl.openvpn_binary = getenv ("NM_OPENVPN_BINARY");
+	gl.helper_path = getenv ("NM_OPENVPN_HELPER_PATH") ?: NM_OPENVPN_HELPER_PATH;
+
 	_LOGD ("nm-openvpn-service (version " DIST_VERSION ") starting...");
 
 	if (   !g_file_test ("/sys/class/misc/tun", G_FILE_TEST_EXISTS)
@@ -0,0 +1,525 @@
+/*
+ * network-manager-openvpn - OpenVPN integration with NetworkManager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ */
+
+/* Benchmarks the activation of a connection by nm-openvpn-service, end to
+ * end, without root and without a server.
+ *
+ * A private D-Bus daemon takes the place of the system bus, on which this
+ * program plays NetworkManager. The service is run against openvpn-stub,
+ * which speaks the management protocol and runs the real helper as --up
+ * script. For each iteration, the connection is activated with Connect()
+ * and torn down again, and one JSON object is printed per line:
+ *
+ *  - "connect-call-usec": until Connect() returned.
+ *  - "spawn-usec": until openvpn was started (after the version probe).
+ *  - "management-usec": from the start of openvpn until the service
+ *    connected to the management socket.
+ *  - "auth-usec": from there until the user name and password arrived.
+ *  - "up-usec": the time the --up helper took, until it returned.
+ *  - "ip4config-usec": from Connect() until the service announced the IPv4
+ *    configuration it got from the helper with SetIp4Config().
+ *
+ * The last line summarizes the iterations. With --probe, the capability
+ * cache of the service is removed before each iteration, so that openvpn
+ * gets probed every time. */
+
+#include "nm-default.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_BUS_NAME "org.freedesktop.NetworkManager.openvpn.bench"
+#define BENCH_UUID     "3b8f8e3a-6f5e-4c5b-9a3e-2f0a8c1d7e42"
+#define BENCH_TIMEOUT  10000
+
+typedef enum {
+	TIME_CONNECT_CALL,
+	TIME_SPAWN,
+	TIME_MANAGEMENT,
+	TIME_AUTH,
+	TIME_UP,
+	TIME_IP4CONFIG,
+	_TIME_NUM,
+} TimeId;
+
+static const char *const time_names[_TIME_NUM] = {
+	[TIME_CONNECT_CALL] = "connect-call-usec",
+	[TIME_SPAWN]        = "spawn-usec",
+	[TIME_MANAGEMENT]   = "management-usec",
+	[TIME_AUTH]         = "auth-usec",
+	[TIME_UP]           = "up-usec",
+	[TIME_IP4CONFIG]    = "ip4config-usec",
+};
+
+typedef struct {
+	GDBusConnection *bus;
+	guint state;
+	gint64 ip4config_at;
+	gboolean failed;
+	gboolean name_owned;
+} Bench;
+
+/*****************************************************************************/
+
+static void
+signal_cb (GDBusConnection *connection,
+           const char *sender_name,
+           const char *object_path,
+           const char *interface_name,
+           const char *signal_name,
+           GVariant *parameters,
+           gpointer user_data)
+{
+	Bench *bench = user_data;
+
+	if (nm_streq (signal_name, "Ip4Config")) {
+		if (!bench->ip4config_at)
+			bench->ip4config_at = g_get_monotonic_time ();
+	} else if (nm_streq (signal_name, "StateChanged")) {
+		if (g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(u)")))
+			g_variant_get (parameters, "(u)", &bench->state);
+	} else if (nm_streq (signal_name, "Failure"))
+		bench->failed = TRUE;
+}
+
+static void
+name_appeared_cb (GDBusConnection *connection,
+                  const char *name,
+                  const char *name_owner,
+                  gpointer user_data)
+{
+	((Bench *) user_data)->name_owned = TRUE;
+}
+
+static void
+name_vanished_cb (GDBusConnection *connection,
+                  const char *name,
+                  gpointer user_data)
+{
+	((Bench *) user_data)->name_owned = FALSE;
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+	*((gboolean *) user_data) = TRUE;
+	return G_SOURCE_REMOVE;
+}
+
+typedef gboolean (*BenchCondition) (const Bench *bench);
+
+static gboolean
+bench_wait (Bench *bench, BenchCondition condition)
+{
+	gboolean timed_out = FALSE;
+	guint id;
+
+	id = g_timeout_add (BENCH_TIMEOUT, timeout_cb, &timed_out);
+	while (!condition (bench) && !bench->failed && !timed_out)
+		g_main_context_iteration (NULL, TRUE);
+	if (!timed_out)
+		g_source_remove (id);
+	return condition (bench);
+}
+
+static gboolean
+cond_name_owned (const Bench *bench)
+{
+	return bench->name_owned;
+}
+
+static gboolean
+cond_ip4config (const Bench *bench)
+{
+	return bench->ip4config_at != 0;
+}
+
+static gboolean
+cond_stopped (const Bench *bench)
+{
+	return bench->state == NM_VPN_SERVICE_STATE_STOPPED;
+}
+
+/*****************************************************************************/
+
+static GVariant *
+connection_to_dbus (void)
+{
+	gs_unref_object NMConnection *connection = NULL;
+	NMSettingConnection *s_con;
+	NMSettingVpn *s_vpn;
+	NMSetting *s_ip;
+
+	connection = nm_simple_connection_new ();
+
+	s_con = NM_SETTING_CONNECTION (nm_setting_connection_new ());
+	g_object_set (s_con,
+	              NM_SETTING_CONNECTION_ID, "bench",
+	              NM_SETTING_CONNECTION_UUID, BENCH_UUID,
+	              NM_SETTING_CONNECTION_TYPE, NM_SETTING_VPN_SETTING_NAME,
+	              NULL);
+	nm_connection_add_setting (connection, NM_SETTING (s_con));
+
+	s_vpn = NM_SETTING_VPN (nm_setting_vpn_new ());
+	g_object_set (s_vpn,
+	              NM_SETTING_VPN_SERVICE_TYPE, NM_VPN_SERVICE_TYPE_OPENVPN,
+	              NULL);
+	nm_setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_CONNECTION_TYPE, NM_OPENVPN_CONTYPE_PASSWORD);
+	nm_setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_REMOTE, "192.0.2.1");
+	nm_setting_vpn_add_data_item (s_vpn, NM_OPENVPN_KEY_USERNAME, "user");
+	nm_setting_vpn_add_secret (s_vpn, NM_OPENVPN_KEY_PASSWORD, "secret");
+	nm_connection_add_setting (connection, NM_SETTING (s_vpn));
+
+	s_ip = nm_setting_ip4_config_new ();
+	g_object_set (s_ip, NM_SETTING_IP_CONFIG_METHOD, NM_SETTING_IP4_CONFIG_METHOD_AUTO, NULL);
+	nm_connection_add_setting (connection, s_ip);
+
+	s_ip = nm_setting_ip6_config_new ();
+	g_object_set (s_ip, NM_SETTING_IP_CONFIG_METHOD, NM_SETTING_IP6_CONFIG_METHOD_AUTO, NULL);
+	nm_connection_add_setting (connection, s_ip);
+
+	return nm_connection_to_dbus (connection, NM_CONNECTION_SERIALIZE_ALL);
+}
+
+static gboolean
+call (Bench *bench, const char *method, GVariant *parameters, GError **error)
+{
+	gs_unref_variant GVariant *ret = NULL;
+
+	ret = g_dbus_connection_call_sync (bench->bus,
+	                                   BENCH_BUS_NAME,
+	                                   NM_VPN_DBUS_PLUGIN_PATH,
+	                                   NM_VPN_DBUS_PLUGIN_INTERFACE,
+	                                   method,
+	                                   parameters,
+	                                   NULL,
+	                                   G_DBUS_CALL_FLAGS_NONE,
+	                                   BENCH_TIMEOUT,
+	                                   NULL,
+	                                   error);
+	return !!ret;
+}
+
+/* reads the times of the steps of openvpn-stub. */
+static gint64
+stub_log_get (const char *contents, const char *event)
+{
+	gs_free char *needle = g_strdup_printf ("%s ", event);
+	const char *p = contents;
+
+	while (p) {
+		if (g_str_has_prefix (p, needle))
+			return g_ascii_strtoll (p + strlen (needle), NULL, 10);
+		p = strchr (p, '\n');
+		if (p)
+			p++;
+	}
+	return 0;
+}
+
+static gboolean
+run_iteration (Bench *bench,
+               const char *stub_log,
+               const char *caps_file,
+               gboolean probe,
+               gint64 *times,
+               GError **error)
+{
+	gs_free char *contents = NULL;
+	gint64 t0, t_spawn, t_management, t_auth, t_up;
+	guint i;
+
+	for (i = 0; i < _TIME_NUM; i++)
+		times[i] = -1;
+
+	unlink (stub_log);
+	if (probe)
+		unlink (caps_file);
+	bench->ip4config_at = 0;
+	bench->failed = FALSE;
+
+	t0 = g_get_monotonic_time ();
+	if (!call (bench, "Connect", g_variant_new ("(@a{sa{sv}})", connection_to_dbus ()), error))
+		return FALSE;
+	times[TIME_CONNECT_CALL] = g_get_monotonic_time () - t0;
+
+	if (!bench_wait (bench, cond_ip4config)) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+		             bench->failed ? "the service reported a failure" : "timed out waiting for the IPv4 configuration");
+		return FALSE;
+	}
+	times[TIME_IP4CONFIG] = bench->ip4config_at - t0;
+
+	if (g_file_get_contents (stub_log, &contents, NULL, NULL)) {
+		t_spawn = stub_log_get (contents, "spawned");
+		t_management = stub_log_get (contents, "management-connected");
+		t_auth = stub_log_get (contents, "authenticated");
+		t_up = stub_log_get (contents, "up");
+		if (t_spawn)
+			times[TIME_SPAWN] = t_spawn - t0;
+		if (t_spawn && t_management)
+			times[TIME_MANAGEMENT] = t_management - t_spawn;
+		if (t_management && t_auth)
+			times[TIME_AUTH] = t_auth - t_management;
+		if (t_auth && t_up)
+			times[TIME_UP] = t_up - t_auth;
+	}
+
+	if (!call (bench, "Disconnect", NULL, error))
+		return FALSE;
+	if (!bench_wait (bench, cond_stopped)) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+		             "timed out waiting for the disconnect");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void
+print_times (guint iteration, const gint64 *times)
+{
+	nm_auto_free_gstring GString *str = g_string_new (NULL);
+	guint i;
+
+	g_string_append_printf (str, "{\"iteration\": %u", iteration);
+	for (i = 0; i < _TIME_NUM; i++) {
+		if (times[i] < 0)
+			g_string_append_printf (str, ", \"%s\": null", time_names[i]);
+		else
+			g_string_append_printf (str, ", \"%s\": %" G_GINT64_FORMAT, time_names[i], times[i]);
+	}
+	g_string_append (str, "}\n");
+	fputs (str->str, stdout);
+	fflush (stdout);
+}
+
+static int
+cmp_gint64 (gconstpointer a, gconstpointer b)
+{
+	gint64 x = *((const gint64 *) a);
+	gint64 y = *((const gint64 *) b);
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void
+print_summary (GArray **samples)
+{
+	nm_auto_free_gstring GString *str = g_string_new ("{\"summary\": {");
+	guint i;
+
+	for (i = 0; i < _TIME_NUM; i++) {
+		GArray *a = samples[i];
+
+		if (i > 0)
+			g_string_append (str, ", ");
+		if (!a->len) {
+			g_string_append_printf (str, "\"%s\": null", time_names[i]);
+			continue;
+		}
+		g_array_sort (a, cmp_gint64);
+		g_string_append_printf (str,
+		                        "\"%s\": {\"min\": %" G_GINT64_FORMAT ", \"median\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT "}",
+		                        time_names[i],
+		                        g_array_index (a, gint64, 0),
+		                        g_array_index (a, gint64, a->len / 2),
+		                        g_array_index (a, gint64, a->len - 1));
+	}
+	g_string_append (str, "}}\n");
+	fputs (str->str, stdout);
+}
+
+/*****************************************************************************/
+
+int
+main (int argc, char *argv[])
+{
+	gs_free char *service = g_strdup (TEST_BUILDDIR"/../nm-openvpn-service");
+	gs_free char *helper = g_strdup (TEST_BUILDDIR"/../nm-openvpn-service-openvpn-helper");
+	gs_free char *stub = g_strdup (TEST_BUILDDIR"/openvpn-stub");
+	gs_free char *tmpdir = NULL;
+	gs_free char *stub_log = NULL;
+	gs_free char *caps_file = NULL;
+	gs_free char *dbus_daemon = NULL;
+	gs_strfreev char **envp = NULL;
+	GArray *samples[_TIME_NUM];
+	GTestDBus *dbus = NULL;
+	GOptionContext *context;
+	GError *error = NULL;
+	Bench bench = { 0 };
+	GPid pid = 0;
+	guint watch_id = 0;
+	guint signal_id = 0;
+	int iterations = 20;
+	gboolean probe = FALSE;
+	gboolean debug = FALSE;
+	int exit_status = EXIT_FAILURE;
+	int i;
+	guint j;
+	GOptionEntry entries[] = {
+		{ "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations, "Number of activations (default: 20)", "N" },
+		{ "probe", 0, 0, G_OPTION_ARG_NONE, &probe, "Drop the capability cache before each activation", NULL },
+		{ "service", 0, 0, G_OPTION_ARG_FILENAME, &service, "The nm-openvpn-service to run", "PATH" },
+		{ "helper", 0, 0, G_OPTION_ARG_FILENAME, &helper, "The helper run as --up script", "PATH" },
+		{ "stub", 0, 0, G_OPTION_ARG_FILENAME, &stub, "The fake openvpn", "PATH" },
+		{ "debug", 'd', 0, G_OPTION_ARG_NONE, &debug, "Let the service log verbosely", NULL },
+		{ NULL }
+	};
+
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, entries, NULL);
+	g_option_context_set_summary (context, "Benchmark the activation of a connection by nm-openvpn-service.");
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("Error parsing options: %s\n", error->message);
+		g_option_context_free (context);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+
+	if (iterations < 1) {
+		g_printerr ("Usage: %s [-i N] [--probe]\n", g_get_prgname ());
+		return EXIT_FAILURE;
+	}
+
+	dbus_daemon = g_find_program_in_path ("dbus-daemon");
+	if (!dbus_daemon) {
+		g_printerr ("dbus-daemon not found, skipping\n");
+		return 77;
+	}
+
+	tmpdir = g_dir_make_tmp ("nm-openvpn-bench-XXXXXX", &error);
+	if (!tmpdir) {
+		g_printerr ("Error creating temporary directory: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+	stub_log = g_build_filename (tmpdir, "stub.log", NULL);
+	caps_file = g_build_filename (tmpdir, "nm-openvpn-caps", NULL);
+
+	for (j = 0; j < _TIME_NUM; j++)
+		samples[j] = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+	dbus = g_test_dbus_new (G_TEST_DBUS_NONE);
+	g_test_dbus_up (dbus);
+
+	bench.bus = g_dbus_connection_new_for_address_sync (g_test_dbus_get_bus_address (dbus),
+	                                                    G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+	                                                    | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+	                                                    NULL, NULL, &error);
+	if (!bench.bus) {
+		g_printerr ("Error connecting to the bus: %s\n", error->message);
+		g_clear_error (&error);
+		goto out;
+	}
+
+	signal_id = g_dbus_connection_signal_subscribe (bench.bus,
+	                                                BENCH_BUS_NAME,
+	                                                NM_VPN_DBUS_PLUGIN_INTERFACE,
+	                                                NULL,
+	                                                NM_VPN_DBUS_PLUGIN_PATH,
+	                                                NULL,
+	                                                G_DBUS_SIGNAL_FLAGS_NONE,
+	                                                signal_cb,
+	                                                &bench,
+	                                                NULL);
+	watch_id = g_bus_watch_name_on_connection (bench.bus,
+	                                           BENCH_BUS_NAME,
+	                                           G_BUS_NAME_WATCHER_FLAGS_NONE,
+	                                           name_appeared_cb,
+	                                           name_vanished_cb,
+	                                           &bench,
+	                                           NULL);
+
+	/* the service and everything it starts talk to our bus, and don't
+	 * try to drop privileges or to chroot. */
+	envp = g_get_environ ();
+	envp = g_environ_setenv (envp, "DBUS_SYSTEM_BUS_ADDRESS", g_test_dbus_get_bus_address (dbus), TRUE);
+	envp = g_environ_setenv (envp, "NM_OPENVPN_RUNDIR", tmpdir, TRUE);
+	envp = g_environ_setenv (envp, "NM_OPENVPN_BINARY", stub, TRUE);
+	envp = g_environ_setenv (envp, "NM_OPENVPN_HELPER_PATH", helper, TRUE);
+	envp = g_environ_setenv (envp, "NM_OPENVPN_USER", "", TRUE);
+	envp = g_environ_setenv (envp, "NM_OPENVPN_GROUP", "", TRUE);
+	envp = g_environ_setenv (envp, "NM_OPENVPN_CHROOT", "", TRUE);
+	envp = g_environ_setenv (envp, "NM_OPENVPN_STUB_LOG", stub_log, TRUE);
+	envp = g_environ_setenv (envp, "NM_VPN_LOG_SYSLOG", "0", TRUE);
+	if (debug)
+		envp = g_environ_setenv (envp, "NM_VPN_LOG_LEVEL", "7", TRUE);
+
+	if (!g_spawn_async (NULL,
+	                    (char *[]) { service, "--persist", "--bus-name", BENCH_BUS_NAME, NULL },
+	                    envp,
+	                    G_SPAWN_DO_NOT_REAP_CHILD,
+	                    NULL, NULL, &pid, &error)) {
+		g_printerr ("Error starting %s: %s\n", service, error->message);
+		g_clear_error (&error);
+		goto out;
+	}
+
+	if (!bench_wait (&bench, cond_name_owned)) {
+		g_printerr ("The service did not show up on the bus\n");
+		goto out;
+	}
+
+	exit_status = EXIT_SUCCESS;
+	for (i = 0; i < iterations; i++) {
+		gint64 times[_TIME_NUM];
+
+		if (!run_iteration (&bench, stub_log, caps_file, probe, times, &error)) {
+			g_printerr ("Iteration %d failed: %s\n", i, error->message);
+			g_clear_error (&error);
+			exit_status = EXIT_FAILURE;
+			break;
+		}
+		print_times (i, times);
+		for (j = 0; j < _TIME_NUM; j++) {
+			if (times[j] >= 0)
+				g_array_append_val (samples[j], times[j]);
+		}
+	}
+	if (exit_status == EXIT_SUCCESS)
+		print_summary (samples);
+
+out:
+	if (pid) {
+		kill (pid, SIGTERM);
+		waitpid (pid, NULL, 0);
+		g_spawn_close_pid (pid);
+	}
+	if (watch_id)
+		g_bus_unwatch_name (watch_id);
+	if (signal_id)
+		g_dbus_connection_signal_unsubscribe (bench.bus, signal_id);
+	g_clear_object (&bench.bus);
+	g_test_dbus_down (dbus);
+	g_object_unref (dbus);
+
+	for (j = 0; j < _TIME_NUM; j++)
+		g_array_unref (samples[j]);
+
+	unlink (stub_log);
+	unlink (caps_file);
+	rmdir (tmpdir);
+	return exit_status;
+}
@@ -0,0 +1,373 @@
+/*
+ * network-manager-openvpn - OpenVPN integration with NetworkManager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ */
+
+/* A fake openvpn, to benchmark nm-openvpn-service without a server.
+ *
+ * It answers the capability probes (--version, --show-ciphers, ...).
+ * Otherwise it behaves like a client whose tunnel comes up instantly: it
+ * listens on the --management unix socket, asks for the user name and
+ * password, runs the --up command with the environment openvpn would
+ * pass, reports the CONNECTED state and then byte counts every second
+ * until it gets terminated.
+ *
+ * If NM_OPENVPN_STUB_LOG is set, the monotonic time of each step is
+ * appended to that file. */
+
+#include "nm-default.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t quit;
+
+static void
+signal_handler (int signo)
+{
+	quit = 1;
+}
+
+static void
+stub_log (const char *event)
+{
+	const char *path;
+	char buf[100];
+	int fd;
+
+	path = getenv ("NM_OPENVPN_STUB_LOG");
+	if (!path)
+		return;
+
+	fd = open (path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return;
+	nm_sprintf_buf (buf, "%s %" G_GINT64_FORMAT "\n", event, g_get_monotonic_time ());
+	if (write (fd, buf, strlen (buf)) < 0) {
+		/* ignore */
+	}
+	close (fd);
+}
+
+static gboolean
+mgt_write (int fd, const char *line)
+{
+	gsize len = strlen (line);
+
+	while (len > 0) {
+		gssize n;
+
+		n = write (fd, line, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		line += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+_nm_printf (2, 3)
+static gboolean
+mgt_writef (int fd, const char *fmt, ...)
+{
+	gs_free char *line = NULL;
+	va_list ap;
+
+	va_start (ap, fmt);
+	line = g_strdup_vprintf (fmt, ap);
+	va_end (ap);
+	return mgt_write (fd, line);
+}
+
+static int
+mgt_accept (const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd, client;
+
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+	unlink (path);
+	if (   bind (fd, (struct sockaddr *) &addr, sizeof (addr)) != 0
+	    || listen (fd, 1) != 0) {
+		close (fd);
+		return -1;
+	}
+
+	do {
+		client = accept4 (fd, NULL, NULL, SOCK_CLOEXEC);
+	} while (client < 0 && errno == EINTR && !quit);
+	close (fd);
+	return client;
+}
+
+/* waits for the user name and password, like openvpn does after
+ * ">PASSWORD:Need 'Auth'". */
+static gboolean
+mgt_read_auth (int fd)
+{
+	nm_auto_free_gstring GString *buf = g_string_new (NULL);
+	gboolean have_username = FALSE;
+	gboolean have_password = FALSE;
+
+	while (!have_username || !have_password) {
+		char chunk[256];
+		gssize n;
+		char *eol;
+
+		n = read (fd, chunk, sizeof (chunk));
+		if (n < 0 && errno == EINTR && !quit)
+			continue;
+		if (n <= 0)
+			return FALSE;
+		g_string_append_len (buf, chunk, n);
+
+		while ((eol = memchr (buf->str, '\n', buf->len))) {
+			*eol = '\0';
+			if (g_str_has_prefix (buf->str, "username \"Auth\" ")) {
+				have_username = TRUE;
+				mgt_write (fd, "SUCCESS: 'Auth' username entered, but not yet verified\r\n");
+			} else if (g_str_has_prefix (buf->str, "password \"Auth\" ")) {
+				have_password = TRUE;
+				mgt_write (fd, "SUCCESS: 'Auth' password entered, but not yet verified\r\n");
+			} else if (nm_streq (buf->str, "log on all") || nm_streq (buf->str, "log on all\r")) {
+				mgt_write (fd, "SUCCESS: real-time log notification set to ON\r\n");
+				mgt_write (fd, "1530000000,I,OpenVPN 2.4.6 x86_64-pc-linux-gnu (stub)\r\n");
+				mgt_write (fd, "END\r\n");
+			}
+			g_string_erase (buf, 0, eol - buf->str + 1);
+		}
+	}
+	return TRUE;
+}
+
+/* runs the --up command with the arguments and (part of) the environment
+ * of openvpn 2.4 for a tun device in subnet topology. */
+static gboolean
+run_up (const char *up)
+{
+	static const char *const env[] = {
+		"script_type",          "up",
+		"dev",                  "tun0",
+		"dev_type",             "tun",
+		"tun_mtu",              "1500",
+		"link_mtu",             "1558",
+		"script_context",       "init",
+		"ifconfig_local",       "10.8.0.6",
+		"ifconfig_netmask",     "255.255.255.0",
+		"route_vpn_gateway",    "10.8.0.1",
+		"route_net_gateway",    "192.168.1.1",
+		"trusted_ip",           "192.0.2.1",
+		"trusted_port",         "1194",
+		"untrusted_ip",         "192.0.2.1",
+		"untrusted_port",       "1194",
+		"remote_1",             "192.0.2.1",
+		"remote_port_1",        "1194",
+		"proto_1",              "udp",
+		"common_name",          "vpn.example.com",
+		"route_network_1",      "10.10.0.0",
+		"route_netmask_1",      "255.255.0.0",
+		"route_gateway_1",      "10.8.0.1",
+		"route_network_2",      "10.20.0.0",
+		"route_netmask_2",      "255.255.0.0",
+		"route_gateway_2",      "10.8.0.1",
+		"foreign_option_1",     "dhcp-option DNS 10.8.0.1",
+		"foreign_option_2",     "dhcp-option DOMAIN example.com",
+		"verb",                 "1",
+	};
+	gs_strfreev char **up_argv = NULL;
+	gs_strfreev char **envp = NULL;
+	GPtrArray *argv;
+	GError *error = NULL;
+	int exit_status;
+	gboolean success;
+	guint i;
+
+	if (!g_shell_parse_argv (up, NULL, &up_argv, &error)) {
+		g_printerr ("openvpn-stub: invalid --up command: %s\n", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	argv = g_ptr_array_new ();
+	for (i = 0; up_argv[i]; i++)
+		g_ptr_array_add (argv, up_argv[i]);
+	g_ptr_array_add (argv, (char *) "tun0");
+	g_ptr_array_add (argv, (char *) "1500");
+	g_ptr_array_add (argv, (char *) "1558");
+	g_ptr_array_add (argv, (char *) "10.8.0.6");
+	g_ptr_array_add (argv, (char *) "255.255.255.0");
+	g_ptr_array_add (argv, (char *) "init");
+	g_ptr_array_add (argv, NULL);
+
+	envp = g_get_environ ();
+	for (i = 0; i < G_N_ELEMENTS (env); i += 2)
+		envp = g_environ_setenv (envp, env[i], env[i + 1], TRUE);
+
+	success = g_spawn_sync (NULL, (char **) argv->pdata, envp, 0,
+	                        NULL, NULL, NULL, NULL, &exit_status, &error);
+	g_ptr_array_free (argv, TRUE);
+	if (!success) {
+		g_printerr ("openvpn-stub: cannot run --up command: %s\n", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+	if (!WIFEXITED (exit_status) || WEXITSTATUS (exit_status) != 0) {
+		g_printerr ("openvpn-stub: --up command failed\n");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static int
+run (const char *mgt_path, const char *up)
+{
+	guint64 bytes_in = 0, bytes_out = 0;
+	int fd = -1;
+
+	if (mgt_path) {
+		fd = mgt_accept (mgt_path);
+		if (fd < 0) {
+			g_printerr ("openvpn-stub: cannot accept on %s\n", mgt_path);
+			return EXIT_FAILURE;
+		}
+		stub_log ("management-connected");
+
+		mgt_write (fd, ">INFO:OpenVPN Management Interface Version 1 -- type 'help' for more info\r\n");
+		mgt_write (fd, ">PASSWORD:Need 'Auth' username/password\r\n");
+		if (!mgt_read_auth (fd)) {
+			close (fd);
+			return quit ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		stub_log ("authenticated");
+
+		mgt_writef (fd, ">STATE:%ld,ASSIGN_IP,,10.8.0.6,,,,\r\n", (long) time (NULL));
+	}
+
+	if (up && !run_up (up)) {
+		if (fd >= 0)
+			close (fd);
+		return EXIT_FAILURE;
+	}
+	stub_log ("up");
+
+	if (fd >= 0)
+		mgt_writef (fd, ">LOG:%ld,I,Initialization Sequence Completed\r\n", (long) time (NULL));
+		mgt_writef (fd, ">STATE:%ld,CONNECTED,SUCCESS,10.8.0.6,192.0.2.1,1194,,\r\n", (long) time (NULL));
+
+	while (!quit) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		char buf[256];
+		int r;
+
+		r = poll (&pfd, 1, 1000);
+		if (r < 0)
+			continue;
+		if (r == 0) {
+			bytes_in += 1300;
+			bytes_out += 700;
+			if (fd >= 0)
+				mgt_writef (fd, ">BYTECOUNT:%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT "\r\n", bytes_in, bytes_out);
+			continue;
+		}
+
+		/* commands are not answered. If the management client went away,
+		 * keep running without one, like openvpn. */
+		if (read (fd, buf, sizeof (buf)) <= 0) {
+			close (fd);
+			fd = -1;
+		}
+	}
+
+	if (fd >= 0)
+		close (fd);
+	return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char *argv[])
+{
+	struct sigaction sa = { .sa_handler = signal_handler };
+	const char *mgt_path = NULL;
+	const char *up = NULL;
+	int exit_status;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (nm_streq (argv[i], "--version")) {
+			printf ("OpenVPN 2.4.6 x86_64-redhat-linux-gnu [SSL (OpenSSL)] [LZO] [LZ4] [EPOLL] [PKCS11] [MH/PKTINFO] [AEAD] built on Apr 26 2018\n"
+			        "library versions: OpenSSL 1.1.0h-fips  27 Mar 2018, LZO 2.08\n");
+			return 1;
+		} else if (nm_streq (argv[i], "--show-ciphers")) {
+			printf ("The following ciphers and cipher modes are available for use\n"
+			        "with OpenVPN.\n"
+			        "\n"
+			        "AES-128-CBC  (128 bit key, 128 bit block)\n"
+			        "AES-128-GCM  (128 bit key, 128 bit block, TLS client/server mode only)\n"
+			        "AES-256-CBC  (256 bit key, 128 bit block)\n"
+			        "AES-256-GCM  (256 bit key, 128 bit block, TLS client/server mode only)\n");
+			return 0;
+		} else if (nm_streq (argv[i], "--show-digests")) {
+			printf ("The following message digests are available for use with\n"
+			        "OpenVPN.\n"
+			        "\n"
+			        "SHA1 160 bit digest size\n"
+			        "SHA256 256 bit digest size\n"
+			        "SHA512 512 bit digest size\n");
+			return 0;
+		} else if (nm_streq (argv[i], "--show-tls")) {
+			printf ("Available TLS Ciphers,\n"
+			        "listed in order of preference:\n"
+			        "\n"
+			        "TLS-ECDHE-RSA-WITH-AES-256-GCM-SHA384\n"
+			        "TLS-ECDHE-RSA-WITH-AES-128-GCM-SHA256\n");
+			return 0;
+		} else if (nm_streq (argv[i], "--management") && i + 1 < argc)
+			mgt_path = argv[++i];
+		else if (nm_streq (argv[i], "--up") && i + 1 < argc)
+			up = argv[++i];
+	}
+
+	stub_log ("spawned");
+
+	/* no SA_RESTART, so that blocking calls return on SIGTERM. */
+	sigaction (SIGTERM, &sa, NULL);
+	sigaction (SIGINT, &sa, NULL);
+	signal (SIGPIPE, SIG_IGN);
+
+	exit_status = run (mgt_path, up);
+
+	if (mgt_path)
+		unlink (mgt_path);
+	return exit_status;
+}
@@ -0,0 +1,686 @@
+/*
+ * network-manager-openvpn - OpenVPN integration with NetworkManager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ */
+
+/* Pull in the helper itself, so that we can call its static functions. */
+#define NMOVPN_HELPER_NO_MAIN
+#include "nm-openvpn-service-openvpn-helper.c"
+
+#include "nm-utils/nm-test-utils.h"
+
+/*****************************************************************************/
+
+/* Count the heap allocations done while the helper builds its configuration. */
+#include "openvpn-alloc-count.h"
+
+/*****************************************************************************/
+
+static GPtrArray *_env_keys;
+
+static void
+_env_set (const char *key, const char *value)
+{
+	if (!_env_keys)
+		_env_keys = g_ptr_array_new_with_free_func (g_free);
+	g_ptr_array_add (_env_keys, g_strdup (key));
+	g_assert (setenv (key, value, 1) == 0);
+}
+
+_nm_printf (2, 3)
+static void
+_env_setf (const char *key, const char *fmt, ...)
+{
+	gs_free char *value = NULL;
+	va_list ap;
+
+	va_start (ap, fmt);
+	value = g_strdup_vprintf (fmt, ap);
+	va_end (ap);
+	_env_set (key, value);
+}
+
+static void
+_env_reset (void)
+{
+	guint i;
+
+	if (!_env_keys)
+		return;
+	for (i = 0; i < _env_keys->len; i++)
+		unsetenv (_env_keys->pdata[i]);
+	g_ptr_array_set_size (_env_keys, 0);
+}
+
+static void
+_env_add_ip4_routes (guint n)
+{
+	char key[100];
+	guint i;
+
+	for (i = 1; i <= n; i++) {
+		nm_sprintf_buf (key, "route_network_%u", i);
+		_env_setf (key, "10.%u.%u.0", (i >> 8) & 0xFF, i & 0xFF);
+		nm_sprintf_buf (key, "route_netmask_%u", i);
+		_env_set (key, "255.255.255.0");
+		nm_sprintf_buf (key, "route_gateway_%u", i);
+		_env_set (key, "10.8.0.1");
+		nm_sprintf_buf (key, "route_metric_%u", i);
+		_env_setf (key, "%u", i % 100);
+	}
+}
+
+static void
+_env_add_ip6_routes (guint n)
+{
+	char key[100];
+	guint i;
+
+	for (i = 1; i <= n; i++) {
+		nm_sprintf_buf (key, "route_ipv6_network_%u", i);
+		_env_setf (key, "fd01:%x::/64", i);
+		if (i % 2) {
+			nm_sprintf_buf (key, "route_ipv6_gateway_%u", i);
+			_env_set (key, "fd00::1");
+		}
+	}
+}
+
+/* Adds @n foreign options, cycling through DNS (IPv4 and IPv6), WINS and
+ * DOMAIN, plus an option the helper must skip. */
+static void
+_env_add_foreign_options (guint n, guint *out_n_dns4, guint *out_n_dns6, guint *out_n_wins, guint *out_n_domains)
+{
+	char key[100];
+	guint i;
+
+	*out_n_dns4 = 0;
+	*out_n_dns6 = 0;
+	*out_n_wins = 0;
+	*out_n_domains = 0;
+
+	for (i = 1; i <= n; i++) {
+		nm_sprintf_buf (key, "foreign_option_%u", i);
+		switch (i % 5) {
+		case 0:
+			_env_setf (key, "dhcp-option DNS 192.168.%u.%u", (i >> 8) & 0xFF, i & 0xFF);
+			(*out_n_dns4)++;
+			break;
+		case 1:
+			_env_setf (key, "dhcp-option DNS fd00::%x", i);
+			(*out_n_dns6)++;
+			break;
+		case 2:
+			_env_setf (key, "dhcp-option WINS 172.16.%u.%u", (i >> 8) & 0xFF, i & 0xFF);
+			(*out_n_wins)++;
+			break;
+		case 3:
+			_env_setf (key, "dhcp-option DOMAIN d%u.example.com", i);
+			(*out_n_domains)++;
+			break;
+		default:
+			_env_set (key, "dhcp-option PROXY_HTTP proxy.example.com 8080");
+			break;
+		}
+	}
+}
+
+static void
+_env_add_ip4 (gboolean subnet)
+{
+	_env_set ("dev", "tun0");
+	_env_set ("trusted_ip", "192.0.2.1");
+	_env_set ("ifconfig_local", "10.8.0.6");
+	if (subnet) {
+		_env_set ("ifconfig_remote", "255.255.255.0");
+		_env_set ("route_vpn_gateway", "10.8.0.1");
+	} else {
+		_env_set ("ifconfig_remote", "10.8.0.5");
+		_env_set ("route_vpn_gateway", "10.8.0.5");
+	}
+	_env_set ("tun_mtu", "1500");
+}
+
+static void
+_env_add_ip6 (void)
+{
+	_env_set ("ifconfig_ipv6_local", "fd00::1000");
+	_env_set ("ifconfig_ipv6_netbits", "64");
+	_env_set ("ifconfig_ipv6_remote", "fd00::1");
+}
+
+/*****************************************************************************/
+
+typedef struct {
+	GVariant *config;
+	GVariant *ip4config;
+	GVariant *ip6config;
+	const char *failure;
+	gint64 parse_usec;
+	gint64 serialize_usec;
+	gsize n_allocs;
+	gsize size;
+} BuildResult;
+
+static void
+_build_result_clear (BuildResult *r)
+{
+	g_clear_pointer (&r->config, g_variant_unref);
+	g_clear_pointer (&r->ip4config, g_variant_unref);
+	g_clear_pointer (&r->ip6config, g_variant_unref);
+}
+
+static gboolean
+_build (BuildResult *r, const char *const*argv, int tapdev)
+{
+	gs_strfreev char **argv_copy = g_strdupv ((char **) argv);
+	gint64 t;
+	gsize n_allocs;
+	gboolean success;
+	GVariant **v[3];
+	guint i;
+
+	memset (r, 0, sizeof (*r));
+
+	n_allocs = nmovpn_alloc_count_get ();
+	t = g_get_monotonic_time ();
+	success = build_config (g_strv_length (argv_copy), argv_copy, tapdev,
+	                        &r->config, &r->ip4config, &r->ip6config, &r->failure);
+	r->parse_usec = g_get_monotonic_time () - t;
+	r->n_allocs = nmovpn_alloc_count_get () - n_allocs;
+
+	if (!success)
+		return FALSE;
+
+	/* Serialize the variants like GDBus will do when sending them. */
+	t = g_get_monotonic_time ();
+	v[0] = &r->config;
+	v[1] = &r->ip4config;
+	v[2] = &r->ip6config;
+	for (i = 0; i < G_N_ELEMENTS (v); i++) {
+		if (!*v[i])
+			continue;
+		g_variant_ref_sink (*v[i]);
+		g_assert (g_variant_get_data (*v[i]));
+		r->size += g_variant_get_size (*v[i]);
+	}
+	r->serialize_usec = g_get_monotonic_time () - t;
+
+	return TRUE;
+}
+
+static void
+_build_report (const char *name, const BuildResult *r)
+{
+	g_test_message ("helper[%s]: parse %" G_GINT64_FORMAT " usec, serialize %" G_GINT64_FORMAT " usec (%" G_GSIZE_FORMAT " bytes), allocations %s%" G_GSIZE_FORMAT,
+	                name,
+	                r->parse_usec,
+	                r->serialize_usec,
+	                r->size,
+	                NMOVPN_HAVE_ALLOC_COUNT ? "" : "n/a ",
+	                r->n_allocs);
+}
+
+static guint32
+_lookup_u (GVariant *dict, const char *key)
+{
+	guint32 u;
+
+	g_assert (dict);
+	if (!g_variant_lookup (dict, key, "u", &u))
+		g_error ("missing key \"%s\"", key);
+	return u;
+}
+
+static gsize
+_lookup_n_children (GVariant *dict, const char *key)
+{
+	gs_unref_variant GVariant *v = NULL;
+
+	g_assert (dict);
+	v = g_variant_lookup_value (dict, key, NULL);
+	if (!v)
+		return 0;
+	return g_variant_n_children (v);
+}
+
+static guint32
+_ip4 (const char *str)
+{
+	in_addr_t a;
+
+	g_assert (inet_pton (AF_INET, str, &a) == 1);
+	return a;
+}
+
+/*****************************************************************************/
+
+static const char *const argv_init[] = { "helper", "tun0", "1500", "1558", "10.8.0.6", "10.8.0.5", "init", NULL };
+
+static void
+test_ip4_net30 (void)
+{
+	BuildResult r;
+
+	_env_reset ();
+	_env_add_ip4 (FALSE);
+	_env_add_ip4_routes (3);
+
+	g_assert (_build (&r, argv_init, -1));
+	_build_report ("ip4-net30", &r);
+
+	g_assert (!r.ip6config);
+	g_assert_cmpint (_lookup_u (r.config, NM_VPN_PLUGIN_CONFIG_EXT_GATEWAY), ==, _ip4 ("192.0.2.1"));
+	g_assert_cmpint (_lookup_u (r.config, NM_VPN_PLUGIN_CONFIG_MTU), ==, 1500);
+	g_assert_cmpint (_lookup_u (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_ADDRESS), ==, _ip4 ("10.8.0.6"));
+	g_assert_cmpint (_lookup_u (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_PTP), ==, _ip4 ("10.8.0.5"));
+	g_assert_cmpint (_lookup_u (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_PREFIX), ==, 32);
+	g_assert_cmpint (_lookup_n_children (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_ROUTES), ==, 3);
+
+	_build_result_clear (&r);
+}
+
+static void
+test_ip4_subnet (void)
+{
+	BuildResult r;
+
+	_env_reset ();
+	_env_add_ip4 (TRUE);
+
+	g_assert (_build (&r, argv_init, -1));
+	_build_report ("ip4-subnet", &r);
+
+	g_assert_cmpint (_lookup_u (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_PREFIX), ==, 24);
+	g_assert_cmpint (_lookup_u (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_INT_GATEWAY), ==, _ip4 ("10.8.0.1"));
+	g_assert (!g_variant_lookup (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_PTP, "u", NULL));
+
+	_build_result_clear (&r);
+}
+
+static void
+test_ip6 (void)
+{
+	BuildResult r;
+	guint n_dns4, n_dns6, n_wins, n_domains;
+	gs_unref_variant GVariant *gw = NULL;
+
+	_env_reset ();
+	_env_add_ip4 (TRUE);
+	_env_set ("trusted_ip6", "2001:db8::1");
+	_env_add_ip6 ();
+	_env_add_ip6_routes (5);
+	_env_add_foreign_options (10, &n_dns4, &n_dns6, &n_wins, &n_domains);
+
+	g_assert (_build (&r, argv_init, -1));
+	_build_report ("ip6", &r);
+
+	gw = g_variant_lookup_value (r.config, NM_VPN_PLUGIN_CONFIG_EXT_GATEWAY, G_VARIANT_TYPE ("ay"));
+	g_assert (gw);
+	g_assert_cmpint (g_variant_n_children (gw), ==, 16);
+
+	g_assert (r.ip6config);
+	g_assert_cmpint (_lookup_u (r.ip6config, NM_VPN_PLUGIN_IP6_CONFIG_PREFIX), ==, 64);
+	g_assert_cmpint (_lookup_n_children (r.ip6config, NM_VPN_PLUGIN_IP6_CONFIG_ROUTES), ==, 5);
+	g_assert_cmpint (_lookup_n_children (r.ip6config, NM_VPN_PLUGIN_IP6_CONFIG_DNS), ==, n_dns6);
+	g_assert_cmpint (_lookup_n_children (r.ip6config, NM_VPN_PLUGIN_IP6_CONFIG_DOMAINS), ==, n_domains);
+	g_assert_cmpint (_lookup_n_children (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_DNS), ==, n_dns4);
+	g_assert_cmpint (_lookup_n_children (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_NBNS), ==, n_wins);
+
+	_build_result_clear (&r);
+}
+
+static void
+test_gateway_hostname (void)
+{
+	BuildResult r;
+
+	_env_reset ();
+	_env_add_ip4 (FALSE);
+	unsetenv ("trusted_ip");
+	_env_set ("remote_1", "vpn.example.com");
+
+	/* never resolved; without an address the configuration is rejected. */
+	g_assert (!_build (&r, argv_init, -1));
+	g_assert_cmpstr (r.failure, ==, "VPN Gateway");
+	_build_result_clear (&r);
+
+	/* the literal the service passed to openvpn as --remote. */
+	_env_set ("remote_1", "198.51.100.7");
+	g_assert (_build (&r, argv_init, -1));
+	g_assert_cmpint (_lookup_u (r.config, NM_VPN_PLUGIN_CONFIG_EXT_GATEWAY), ==, _ip4 ("198.51.100.7"));
+	_build_result_clear (&r);
+
+	/* what openvpn reports still wins. */
+	_env_set ("trusted_ip", "192.0.2.1");
+	g_assert (_build (&r, argv_init, -1));
+	g_assert_cmpint (_lookup_u (r.config, NM_VPN_PLUGIN_CONFIG_EXT_GATEWAY), ==, _ip4 ("192.0.2.1"));
+	_build_result_clear (&r);
+}
+
+static void
+test_restart (void)
+{
+	static const char *const argv[] = { "helper", "tun0", "1500", "1558", "10.8.0.10", "10.8.0.9", "restart", NULL };
+	BuildResult r;
+	gboolean preserve = FALSE;
+
+	_env_reset ();
+	_env_set ("dev", "tun0");
+	_env_set ("trusted_ip", "192.0.2.1");
+
+	g_assert (_build (&r, argv, -1));
+	_build_report ("restart", &r);
+
+	g_assert_cmpint (_lookup_u (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_ADDRESS), ==, _ip4 ("10.8.0.10"));
+	g_assert_cmpint (_lookup_u (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_PTP), ==, _ip4 ("10.8.0.9"));
+	g_assert (g_variant_lookup (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_PRESERVE_ROUTES, "b", &preserve));
+	g_assert (preserve);
+
+	_build_result_clear (&r);
+}
+
+static void
+test_failure (void)
+{
+	BuildResult r;
+
+	_env_reset ();
+	_env_set ("trusted_ip", "192.0.2.1");
+	g_assert (!_build (&r, argv_init, -1));
+	g_assert_cmpstr (r.failure, ==, "Tunnel Device");
+
+	_env_set ("dev", "tun0");
+	_env_set ("ifconfig_local", "10.8.0.256");
+	g_assert (!_build (&r, argv_init, -1));
+	g_assert_cmpstr (r.failure, ==, "IP4 Address");
+
+	unsetenv ("ifconfig_local");
+	g_assert (!_build (&r, argv_init, -1));
+	g_assert_cmpstr (r.failure, ==, "IPv4 or IPv6 configuration");
+}
+
+/*****************************************************************************/
+
+static void
+test_scale (gconstpointer test_data)
+{
+	const guint n_routes = GPOINTER_TO_UINT (test_data);
+	gs_free char *name = g_strdup_printf ("scale-%u", n_routes);
+	guint n_dns4, n_dns6, n_wins, n_domains;
+	BuildResult r;
+
+	_env_reset ();
+	_env_add_ip4 (TRUE);
+	_env_add_ip6 ();
+	_env_add_ip4_routes (n_routes);
+	_env_add_ip6_routes (n_routes / 4);
+	_env_add_foreign_options (n_routes / 10, &n_dns4, &n_dns6, &n_wins, &n_domains);
+
+	g_assert (_build (&r, argv_init, -1));
+	_build_report (name, &r);
+
+	g_assert_cmpint (_lookup_n_children (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_ROUTES), ==, n_routes);
+	g_assert_cmpint (_lookup_n_children (r.ip6config, NM_VPN_PLUGIN_IP6_CONFIG_ROUTES), ==, n_routes / 4);
+	g_assert_cmpint (_lookup_n_children (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_DNS), ==, n_dns4);
+	g_assert_cmpint (_lookup_n_children (r.ip6config, NM_VPN_PLUGIN_IP6_CONFIG_DNS), ==, n_dns6);
+	g_assert_cmpint (_lookup_n_children (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_NBNS), ==, n_wins);
+	g_assert_cmpint (_lookup_n_children (r.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_DOMAINS), ==, n_domains);
+
+	_build_result_clear (&r);
+	_env_reset ();
+}
+
+/*****************************************************************************/
+
+/* A fake nm-openvpn-service on a private bus, served from its own thread
+ * because send_config() blocks on each call. */
+
+static const char mock_introspection[] =
+	"<node>"
+	"  <interface name='" NM_VPN_DBUS_PLUGIN_INTERFACE "'>"
+	"    <method name='SetConfig'><arg name='config' type='a{sv}' direction='in'/></method>"
+	"    <method name='SetIp4Config'><arg name='config' type='a{sv}' direction='in'/></method>"
+	"    <method name='SetIp6Config'><arg name='config' type='a{sv}' direction='in'/></method>"
+	"    <method name='SetFailure'><arg name='reason' type='s' direction='in'/></method>"
+	"  </interface>"
+	"</node>";
+
+typedef struct {
+	GMutex lock;
+	GCond cond;
+	const char *address;
+	GMainContext *context;
+	GMainLoop *loop;
+	GDBusConnection *connection;
+	char *unique_name;
+	gboolean ready;
+	GVariant *config;
+	GVariant *ip4config;
+	GVariant *ip6config;
+	guint n_calls;
+} MockPeer;
+
+static void
+_mock_method_call (GDBusConnection *connection,
+                   const char *sender,
+                   const char *object_path,
+                   const char *interface_name,
+                   const char *method_name,
+                   GVariant *parameters,
+                   GDBusMethodInvocation *invocation,
+                   gpointer user_data)
+{
+	MockPeer *peer = user_data;
+	GVariant **target = NULL;
+
+	if (nm_streq (method_name, "SetConfig"))
+		target = &peer->config;
+	else if (nm_streq (method_name, "SetIp4Config"))
+		target = &peer->ip4config;
+	else if (nm_streq (method_name, "SetIp6Config"))
+		target = &peer->ip6config;
+
+	g_mutex_lock (&peer->lock);
+	if (target) {
+		g_clear_pointer (target, g_variant_unref);
+		g_variant_get (parameters, "(@a{sv})", target);
+	}
+	peer->n_calls++;
+	g_mutex_unlock (&peer->lock);
+
+	g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static gpointer
+_mock_thread (gpointer user_data)
+{
+	static const GDBusInterfaceVTable vtable = {
+		.method_call = _mock_method_call,
+	};
+	MockPeer *peer = user_data;
+	gs_unref_object GDBusConnection *connection = NULL;
+	GDBusNodeInfo *info;
+	GError *error = NULL;
+	guint id;
+
+	g_main_context_push_thread_default (peer->context);
+
+	connection = g_dbus_connection_new_for_address_sync (peer->address,
+	                                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+	                                                     | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+	                                                     NULL, NULL, &error);
+	nmtst_assert_success (connection, error);
+
+	info = g_dbus_node_info_new_for_xml (mock_introspection, &error);
+	nmtst_assert_success (info, error);
+
+	id = g_dbus_connection_register_object (connection,
+	                                        NM_VPN_DBUS_PLUGIN_PATH,
+	                                        info->interfaces[0],
+	                                        &vtable,
+	                                        peer, NULL, &error);
+	nmtst_assert_success (id, error);
+	g_dbus_node_info_unref (info);
+
+	g_mutex_lock (&peer->lock);
+	peer->unique_name = g_strdup (g_dbus_connection_get_unique_name (connection));
+	peer->ready = TRUE;
+	g_cond_signal (&peer->cond);
+	g_mutex_unlock (&peer->lock);
+
+	g_main_loop_run (peer->loop);
+
+	g_dbus_connection_unregister_object (connection, id);
+	g_main_context_pop_thread_default (peer->context);
+	return NULL;
+}
+
+static void
+test_dbus_delivery (void)
+{
+#if GLIB_CHECK_VERSION (2, 34, 0)
+	GTestDBus *bus;
+	MockPeer peer = { 0 };
+	GThread *thread;
+	gs_unref_object GDBusConnection *connection = NULL;
+	gs_unref_object GDBusProxy *proxy = NULL;
+	GError *error = NULL;
+	guint n_dns4, n_dns6, n_wins, n_domains;
+	gs_free char *dbus_daemon = NULL;
+	BuildResult r;
+	gint64 t;
+	gsize n_allocs;
+
+	dbus_daemon = g_find_program_in_path ("dbus-daemon");
+	if (!dbus_daemon) {
+		g_test_skip ("dbus-daemon not available");
+		return;
+	}
+
+	bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+	g_test_dbus_up (bus);
+
+	g_mutex_init (&peer.lock);
+	g_cond_init (&peer.cond);
+	peer.address = g_test_dbus_get_bus_address (bus);
+	peer.context = g_main_context_new ();
+	peer.loop = g_main_loop_new (peer.context, FALSE);
+	thread = g_thread_new ("mock-peer", _mock_thread, &peer);
+
+	g_mutex_lock (&peer.lock);
+	while (!peer.ready)
+		g_cond_wait (&peer.cond, &peer.lock);
+	g_mutex_unlock (&peer.lock);
+
+	connection = g_dbus_connection_new_for_address_sync (peer.address,
+	                                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+	                                                     | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+	                                                     NULL, NULL, &error);
+	nmtst_assert_success (connection, error);
+
+	proxy = g_dbus_proxy_new_sync (connection,
+	                               G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES
+	                               | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+	                               NULL,
+	                               peer.unique_name,
+	                               NM_VPN_DBUS_PLUGIN_PATH,
+	                               NM_VPN_DBUS_PLUGIN_INTERFACE,
+	                               NULL, &error);
+	nmtst_assert_success (proxy, error);
+
+	_env_reset ();
+	_env_add_ip4 (TRUE);
+	_env_add_ip6 ();
+	_env_add_ip4_routes (1000);
+	_env_add_ip6_routes (100);
+	_env_add_foreign_options (100, &n_dns4, &n_dns6, &n_wins, &n_domains);
+
+	g_assert (_build (&r, argv_init, -1));
+	_build_report ("dbus", &r);
+
+	n_allocs = nmovpn_alloc_count_get ();
+	t = g_get_monotonic_time ();
+	send_config (proxy, r.config, r.ip4config, r.ip6config);
+	g_test_message ("helper[dbus]: delivery %" G_GINT64_FORMAT " usec, allocations %s%" G_GSIZE_FORMAT,
+	                g_get_monotonic_time () - t,
+	                NMOVPN_HAVE_ALLOC_COUNT ? "" : "n/a ",
+	                nmovpn_alloc_count_get () - n_allocs);
+
+	g_mutex_lock (&peer.lock);
+	g_assert_cmpint (peer.n_calls, ==, 3);
+	g_assert (peer.config);
+	g_assert_cmpint (_lookup_u (peer.config, NM_VPN_PLUGIN_CONFIG_MTU), ==, 1500);
+	g_assert_cmpint (_lookup_n_children (peer.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_ROUTES), ==, 1000);
+	g_assert_cmpint (_lookup_n_children (peer.ip6config, NM_VPN_PLUGIN_IP6_CONFIG_ROUTES), ==, 100);
+	g_assert_cmpint (_lookup_n_children (peer.ip4config, NM_VPN_PLUGIN_IP4_CONFIG_DNS), ==, n_dns4);
+	g_mutex_unlock (&peer.lock);
+
+	_build_result_clear (&r);
+
+	g_main_loop_quit (peer.loop);
+	g_thread_join (thread);
+
+	g_clear_pointer (&peer.config, g_variant_unref);
+	g_clear_pointer (&peer.ip4config, g_variant_unref);
+	g_clear_pointer (&peer.ip6config, g_variant_unref);
+	g_free (peer.unique_name);
+	g_main_loop_unref (peer.loop);
+	g_main_context_unref (peer.context);
+	g_cond_clear (&peer.cond);
+	g_mutex_clear (&peer.lock);
+
+	g_clear_object (&proxy);
+	g_dbus_connection_close_sync (connection, NULL, NULL);
+	g_clear_object (&connection);
+
+	g_test_dbus_down (bus);
+	g_object_unref (bus);
+	_env_reset ();
+#else
+	g_test_skip ("GTestDBus requires glib 2.34");
+#endif
+}
+
+/*****************************************************************************/
+
+NMTST_DEFINE ();
+
+int main (int argc, char **argv)
+{
+	nmtst_init (&argc, &argv, TRUE);
+
+#define _add_test_func_simple(func)       g_test_add_func ("/ovpn/helper/" #func, func)
+
+	_add_test_func_simple (test_ip4_net30);
+	_add_test_func_simple (test_ip4_subnet);
+	_add_test_func_simple (test_ip6);
+	_add_test_func_simple (test_gateway_hostname);
+	_add_test_func_simple (test_restart);
+	_add_test_func_simple (test_failure);
+
+	g_test_add_data_func ("/ovpn/helper/scale/100", GUINT_TO_POINTER (100), test_scale);
+	g_test_add_data_func ("/ovpn/helper/scale/1000", GUINT_TO_POINTER (1000), test_scale);
+	g_test_add_data_func ("/ovpn/helper/scale/2000", GUINT_TO_POINTER (2000), test_scale);
+	if (!nmtst_test_quick ())
+		g_test_add_data_func ("/ovpn/helper/scale/8000", GUINT_TO_POINTER (8000), test_scale);
+
+	_add_test_func_simple (test_dbus_delivery);
+
+	return g_test_run ();
+}